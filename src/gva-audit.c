@@ -18,7 +18,9 @@
 
 #include "gva-audit.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "gva-columns.h"
 #include "gva-db.h"
@@ -27,76 +29,337 @@
 #include "gva-mame.h"
 #include "gva-ui.h"
 #include "gva-util.h"
+#include "gva-verify.h"
 
 #define SQL_SELECT_BAD_GAMES \
         "SELECT name, description FROM game WHERE romset == 'bad'"
 
+#define SQL_SELECT_ROMSETS \
+        "SELECT name FROM game"
+
+/* MAME gives every game with samples a "sampleof" attribute,
+ * even when the samples are its own. */
+#define SQL_SELECT_SAMPLESETS \
+        "SELECT name FROM game WHERE sampleof NOT NULL"
+
+/* The snapshot table holds the ROM or sample set files found by the
+ * most recent scan of a search path, in the form of the manifest table.
+ * It is compared against the manifest to find changed sets, and copied
+ * into the manifest once those sets have been audited. */
+#define SQL_CREATE_SNAPSHOT \
+        "CREATE TEMP TABLE IF NOT EXISTS snapshot (" \
+                "kind NOT NULL, " \
+                "path NOT NULL, " \
+                "name NOT NULL, " \
+                "size, " \
+                "mtime, " \
+                "inode, " \
+                "PRIMARY KEY (kind, path) ON CONFLICT REPLACE);"
+
+#define SQL_INSERT_SNAPSHOT \
+        "INSERT INTO temp.snapshot VALUES (?1, ?2, ?3, ?4, ?5, ?6)"
+
+/* Names of the sets whose files were added, removed or modified
+ * since they were last audited. */
+#define SQL_SELECT_CHANGED_SETS(kind) \
+        "SELECT name FROM temp.snapshot AS s WHERE kind = '" kind "' " \
+        "AND NOT EXISTS (SELECT * FROM manifest AS m " \
+                "WHERE m.kind = s.kind AND m.path = s.path " \
+                "AND m.size = s.size AND m.mtime = s.mtime " \
+                "AND m.inode = s.inode) " \
+        "UNION SELECT name FROM manifest AS m WHERE kind = '" kind "' " \
+        "AND NOT EXISTS (SELECT * FROM temp.snapshot AS s " \
+                "WHERE s.kind = m.kind AND s.path = m.path)"
+
+/* The changed table collects the games affected by changed sets.  A
+ * ROM set change affects the game itself, its parent, and any game
+ * that takes ROMs from it, such as clones of a parent or games using
+ * a BIOS.  A sample set change affects the games that use it. */
+#define SQL_CREATE_CHANGED \
+        "CREATE TEMP TABLE IF NOT EXISTS changed (" \
+                "name PRIMARY KEY ON CONFLICT IGNORE); " \
+        "DELETE FROM temp.changed; " \
+        "INSERT INTO temp.changed " \
+                SQL_SELECT_CHANGED_SETS ("romset") "; " \
+        "INSERT INTO temp.changed SELECT cloneof FROM game " \
+                "WHERE name IN (SELECT name FROM temp.changed) " \
+                "AND cloneof NOT NULL;"
+
+#define SQL_INSERT_CHANGED_DEPENDENTS \
+        "INSERT INTO temp.changed SELECT name FROM game " \
+        "WHERE romof IN (SELECT name FROM temp.changed) " \
+        "OR cloneof IN (SELECT name FROM temp.changed)"
+
+#define SQL_INSERT_CHANGED_SAMPLESETS \
+        "INSERT INTO temp.changed SELECT name FROM game " \
+        "WHERE sampleof IN (" SQL_SELECT_CHANGED_SETS ("sampleset") ")"
+
+#define SQL_COUNT_CHANGED \
+        "SELECT count(*) FROM temp.changed"
+
+#define SQL_INSERT_UNAUDITED_CHANGED \
+        "INSERT INTO unaudited SELECT name FROM temp.changed " \
+        "WHERE name IN (SELECT name FROM game)"
+
+/* Returns a row if sets were found but no manifest was ever recorded. */
+#define SQL_SELECT_NEW_MANIFEST \
+        "SELECT * FROM temp.snapshot " \
+        "WHERE NOT EXISTS (SELECT * FROM manifest) LIMIT 1"
+
+#define SQL_INSERT_UNAUDITED_ALL \
+        "INSERT INTO unaudited SELECT name FROM game"
+
+/* The audit_result table collects statuses as verify output arrives,
+ * to be applied to the game table in one statement when the audit
+ * finishes.  ROM and sample audits may run at the same time, so rows
+ * are tagged with the column they belong in. */
+#define SQL_CREATE_AUDIT_RESULT \
+        "CREATE TEMP TABLE IF NOT EXISTS audit_result (" \
+                "kind NOT NULL, " \
+                "name NOT NULL, " \
+                "status NOT NULL, " \
+                "PRIMARY KEY (kind, name) ON CONFLICT REPLACE);"
+
+#define SQL_INSERT_AUDIT_RESULT \
+        "INSERT INTO temp.audit_result VALUES (?1, ?2, ?3)"
+
+/* The audit_output table collects the lines MAME writes about each
+ * game in a ROM audit, to be copied into the audit_detail table along
+ * with the statuses. */
+#define SQL_CREATE_AUDIT_OUTPUT \
+        "CREATE TEMP TABLE IF NOT EXISTS audit_output (" \
+                "name NOT NULL, " \
+                "line_no NOT NULL, " \
+                "text NOT NULL); " \
+        "DELETE FROM temp.audit_output;"
+
+#define SQL_INSERT_AUDIT_OUTPUT \
+        "INSERT INTO temp.audit_output VALUES (?1, ?2, ?3)"
+
+#define SQL_SELECT_AUDIT_DETAIL \
+        "SELECT text FROM audit_detail WHERE name = ?1 ORDER BY line_no"
+
+/* Size of the ring buffer for reading verify output. */
+#define AUDIT_BUFFER_SIZE (64 * 1024)
+
+/* Games are split into more shards than there are verify processes
+ * running at once, so a shard of slow games doesn't hold up the rest.
+ * Shards are kept small enough for a command line, and big enough to
+ * be worth starting MAME for. */
+#define AUDIT_SHARDS_PER_JOB    4
+#define AUDIT_MIN_SHARD_SIZE    50
+#define AUDIT_MAX_SHARD_SIZE    1000
+
+typedef GvaProcess * (*GvaAuditSpawnFunc) (gchar **names, GError **error);
+
 typedef struct _GvaAuditData GvaAuditData;
+typedef struct _GvaAuditDetect GvaAuditDetect;
+typedef struct _GvaAuditShard GvaAuditShard;
 
 struct _GvaAuditData
 {
-        GPtrArray *output;
-        GHashTable *output_index;
-        GHashTable *status_index;
         const gchar *column;
+
+        /* Inserts statuses into the audit_result table. */
+        sqlite3_stmt *insert_stmt;
+
+        /* Inserts lines into the audit_output table,
+         * or NULL if the lines are not kept. */
+        sqlite3_stmt *output_stmt;
+
+        /* Whether the snapshot table holds a fresh scan
+         * of the search path, to be recorded in the manifest. */
+        gboolean scanned;
+
+        /* Quoted, comma-separated list of the games
+         * being audited, or NULL if auditing all games. */
+        gchar *names;
+
+        /* The games are split into shards, each verified by its own
+         * process.  At most max_running processes run at once.  The
+         * native verifier may take some games off the list first. */
+        GvaAuditSpawnFunc spawn;
+        gboolean native;
+        gchar **all_names;
+        guint n_names;
+        guint n_shards;
+        guint next_shard;
+        guint max_running;
+        GSList *running;
+
+        guint n_audited;
+        guint n_total;
+        GvaAuditProgressFunc progress_callback;
+        gpointer progress_data;
+
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+        gulong cancelled_id;
+        GError *error;
 };
 
-static void
-audit_string_free (GString *string)
+/* Change detection looks up the ROM and sample paths in turn. */
+struct _GvaAuditDetect
 {
-        g_string_free (string, TRUE);
-}
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+        gchar **rom_paths;
+};
+
+struct _GvaAuditShard
+{
+        GvaAuditData *data;
+        GvaProcess *process;
+
+        /* Partial line carried over to the next read. */
+        GString *line;
+
+        /* Lines about the game being verified, written all at once
+         * when its status line arrives.  Lines from a shard that ends
+         * without a status line are discarded. */
+        GPtrArray *pending;
+};
+
+/* The number of audits in progress. */
+static guint audit_n_running;
+
+/* Whether the snapshot table holds the scan made by
+ * the last change-detection pass, for audits to reuse. */
+static gboolean audit_snapshot_fresh;
 
 static GvaAuditData *
-audit_data_new (const gchar *column)
+audit_data_new (const gchar *column,
+                gchar **names)
 {
         GvaAuditData *data;
-        GHashTable *output_index;
-        GHashTable *status_index;
-
-        output_index = g_hash_table_new_full (
-                g_str_hash, g_str_equal,
-                (GDestroyNotify) g_free,
-                (GDestroyNotify) NULL);
-
-        status_index = g_hash_table_new_full (
-                g_str_hash, g_str_equal,
-                (GDestroyNotify) g_free,
-                (GDestroyNotify) audit_string_free);
-
-        data = g_slice_new (GvaAuditData);
-        data->output = g_ptr_array_new ();
-        data->output_index = output_index;
-        data->status_index = status_index;
+
+        data = g_slice_new0 (GvaAuditData);
         data->column = column;
 
+        audit_n_running++;
+
+        if (names != NULL)
+        {
+                GString *string;
+                guint ii;
+
+                string = g_string_sized_new (1024);
+                for (ii = 0; names[ii] != NULL; ii++)
+                        g_string_append_printf (
+                                string, "%s\"%s\"",
+                                (ii > 0) ? ", " : "", names[ii]);
+                data->names = g_string_free (string, FALSE);
+        }
+
         return data;
 }
 
 static void
 audit_data_free (GvaAuditData *data)
 {
-        g_ptr_array_foreach (data->output, (GFunc) g_free, NULL);
-        g_ptr_array_free (data->output, TRUE);
-        g_hash_table_destroy (data->output_index);
-        g_hash_table_destroy (data->status_index);
+        g_assert (data->running == NULL);
+
+        if (data->cancelled_id > 0)
+                g_cancellable_disconnect (
+                        data->cancellable, data->cancelled_id);
+
+        if (data->cancellable != NULL)
+                g_object_unref (data->cancellable);
+
+        if (data->error != NULL)
+                g_error_free (data->error);
+
+        sqlite3_finalize (data->insert_stmt);
+        sqlite3_finalize (data->output_stmt);
+        g_free (data->names);
+        g_strfreev (data->all_names);
+        g_object_unref (data->simple);
         g_slice_free (GvaAuditData, data);
+
+        audit_n_running--;
+}
+
+static GvaAuditShard *
+audit_shard_new (GvaAuditData *data,
+                 GvaProcess *process)
+{
+        GvaAuditShard *shard;
+
+        shard = g_slice_new0 (GvaAuditShard);
+        shard->data = data;
+        shard->process = process;
+        shard->line = g_string_sized_new (256);
+        shard->pending = g_ptr_array_new ();
+
+        return shard;
+}
+
+static void
+audit_shard_free (GvaAuditShard *shard)
+{
+        if (shard->process != NULL)
+                g_object_unref (shard->process);
+        g_string_free (shard->line, TRUE);
+        g_ptr_array_foreach (shard->pending, (GFunc) g_free, NULL);
+        g_ptr_array_free (shard->pending, TRUE);
+        g_slice_free (GvaAuditShard, shard);
+}
+
+/* Writes the shard's pending lines about @name to the audit_output
+ * table, or discards them if @name is NULL. */
+static void
+audit_shard_flush (GvaAuditShard *shard,
+                   const gchar *name)
+{
+        GvaAuditData *data = shard->data;
+        sqlite3_stmt *stmt = data->output_stmt;
+        guint ii;
+
+        for (ii = 0; ii < shard->pending->len && stmt != NULL; ii++)
+        {
+                const gchar *line;
+
+                line = g_ptr_array_index (shard->pending, ii);
+
+                /* Keep only the lines about the game's files. */
+                if (name == NULL || !g_str_has_prefix (line, name))
+                        continue;
+
+                sqlite3_bind_text (stmt, 1, name, -1, SQLITE_STATIC);
+                sqlite3_bind_int (stmt, 2, ii);
+                sqlite3_bind_text (stmt, 3, line, -1, SQLITE_STATIC);
+
+                if (sqlite3_step (stmt) != SQLITE_DONE)
+                        if (data->error == NULL)
+                                gva_db_set_error (&data->error, 0, NULL);
+
+                sqlite3_reset (stmt);
+        }
+
+        g_ptr_array_foreach (shard->pending, (GFunc) g_free, NULL);
+        g_ptr_array_set_size (shard->pending, 0);
 }
 
 static gboolean
 audit_build_model (GtkTreeStore *tree_store,
-                   GvaAuditData *data,
                    GError **error)
 {
         GtkTreeModel *game_store;
         GtkTreeIter iter;
         gboolean iter_valid;
+        sqlite3_stmt *stmt;
 
         game_store = gva_game_store_new_from_query (
                 SQL_SELECT_BAD_GAMES, error);
         if (game_store == NULL)
                 return FALSE;
 
+        if (!gva_db_prepare (SQL_SELECT_AUDIT_DETAIL, &stmt, error))
+        {
+                g_object_unref (game_store);
+                return FALSE;
+        }
+
         gtk_tree_store_clear (tree_store);
 
         iter_valid = gtk_tree_model_get_iter_first (game_store, &iter);
@@ -105,7 +368,6 @@ audit_build_model (GtkTreeStore *tree_store,
         {
                 GtkTreeIter parent;
                 GtkTreeIter child;
-                guint index;
                 gchar *name;
                 gchar *description;
 
@@ -118,22 +380,20 @@ audit_build_model (GtkTreeStore *tree_store,
                 gtk_tree_store_append (tree_store, &parent, NULL);
                 gtk_tree_store_set (tree_store, &parent, 0, description, -1);
 
-                index = GPOINTER_TO_UINT (g_hash_table_lookup (
-                        data->output_index, name));
+                sqlite3_bind_text (stmt, 1, name, -1, SQLITE_STATIC);
 
-                while (index > 0)
+                while (sqlite3_step (stmt) == SQLITE_ROW)
                 {
                         const gchar *line;
 
-                        line = g_ptr_array_index (data->output, --index);
+                        line = (const gchar *) sqlite3_column_text (stmt, 0);
 
-                        if (!g_str_has_prefix (line, name))
-                                break;
-
-                        gtk_tree_store_prepend (tree_store, &child, &parent);
+                        gtk_tree_store_append (tree_store, &child, &parent);
                         gtk_tree_store_set (tree_store, &child, 0, line, -1);
                 }
 
+                sqlite3_reset (stmt);
+
                 g_free (name);
                 g_free (description);
 
@@ -143,90 +403,189 @@ audit_build_model (GtkTreeStore *tree_store,
         gtk_tree_sortable_set_sort_column_id (
                 GTK_TREE_SORTABLE (tree_store), 0, GTK_SORT_ASCENDING);
 
+        sqlite3_finalize (stmt);
         g_object_unref (game_store);
 
         return TRUE;
 }
 
 static void
-audit_read (GvaProcess *process,
-            GvaAuditData *data)
+audit_read_line (GvaAuditShard *shard,
+                 gchar *line)
 {
-        gchar *line;
+        GvaAuditData *data = shard->data;
         gchar *name;
         gchar *status;
-        GString *string;
-        gpointer value;
 
-        line = g_strchomp (gva_process_stdout_read_line (process));
+        g_strchomp (line);
 
-        value = GUINT_TO_POINTER (data->output->len);
-        g_ptr_array_add (data->output, g_strdup (line));
+        g_ptr_array_add (shard->pending, g_strdup (line));
 
         if (!gva_mame_verify_parse (line, &name, &status))
-                goto exit;
+                return;
 
-        g_hash_table_insert (data->output_index, g_strdup (name), value);
+        audit_shard_flush (shard, name);
+        data->n_audited++;
 
-        /* Build a quoted, comma-separated list of games. */
-        string = g_hash_table_lookup (data->status_index, status);
-        if (string != NULL)
-                g_string_append_printf (string, ", \"%s\"", name);
-        else
+        /* Games MAME did not find keep the NULL status they were
+         * reset to, which the schema requires anyway. */
+        if (strcmp (status, "not found") == 0 ||
+            strcmp (status, "not supported") == 0)
         {
-                string = g_string_sized_new (1024);
-                g_string_printf (string, "\"%s\"", name);
-
-                g_hash_table_insert (
-                        data->status_index,
-                        g_strdup (status), string);
+                g_free (name);
+                g_free (status);
+                return;
         }
 
-        g_free (name);
-        g_free (status);
+        /* The statement owns the strings now. */
+        sqlite3_bind_text (data->insert_stmt, 2, name, -1, g_free);
+        sqlite3_bind_text (data->insert_stmt, 3, status, -1, g_free);
 
-exit:
-        g_free (line);
+        if (sqlite3_step (data->insert_stmt) != SQLITE_DONE)
+                if (data->error == NULL)
+                        gva_db_set_error (&data->error, 0, NULL);
+
+        sqlite3_reset (data->insert_stmt);
 }
 
-/* Helper for audit_exit() */
 static void
-audit_exit_foreach (gchar *status,
-                    GString *names,
-                    GvaAuditData *data)
+audit_read (GvaProcess *process,
+            GvaAuditShard *shard)
+{
+        GvaAuditData *data = shard->data;
+        const gchar *buffer;
+        gsize length;
+
+        /* Split the output into lines straight from the process' ring
+         * buffer, carrying a partial line over to the next read in a
+         * reusable buffer. */
+        while ((length = gva_process_stdout_peek (process, &buffer)) > 0)
+        {
+                const gchar *cp = buffer;
+                const gchar *end = buffer + length;
+                const gchar *newline;
+
+                while ((newline = memchr (cp, '\n', end - cp)) != NULL)
+                {
+                        g_string_append_len (shard->line, cp, newline - cp);
+                        audit_read_line (shard, shard->line->str);
+                        g_string_truncate (shard->line, 0);
+                        cp = newline + 1;
+                }
+
+                g_string_append_len (shard->line, cp, end - cp);
+                gva_process_stdout_consume (process, length);
+        }
+
+        if (data->progress_callback != NULL)
+                data->progress_callback (
+                        data->n_audited, data->n_total,
+                        data->progress_data);
+}
+
+/* Replaces the manifest entries for the audited sets with the ones
+ * found when the audit started.  Files changed since then will show
+ * up as changes the next time around. */
+static gboolean
+audit_write_manifest (GvaAuditData *data,
+                      GError **error)
 {
+        gchar *sets;
         gchar *sql;
-        GError *error = NULL;
+        gboolean success;
+
+        if (data->names == NULL)
+        {
+                sql = g_strdup_printf (
+                        "DELETE FROM manifest WHERE kind = '%s'; "
+                        "INSERT INTO manifest SELECT * FROM temp.snapshot "
+                        "WHERE kind = '%s';",
+                        data->column, data->column);
+                success = gva_db_execute (sql, error);
+                g_free (sql);
+
+                return success;
+        }
+
+        /* Sample sets are named by the games' "sampleof" attribute. */
+        if (strcmp (data->column, "sampleset") == 0)
+                sets = g_strdup_printf (
+                        "SELECT sampleof FROM game WHERE name IN (%s)",
+                        data->names);
+        else
+                sets = g_strdup (data->names);
 
         sql = g_strdup_printf (
-                "UPDATE game SET %s=\"%s\" WHERE name IN (%s)",
-                data->column, status, names->str);
-        gva_db_execute (sql, &error);
-        gva_error_handle (&error);
+                "DELETE FROM manifest WHERE kind = '%s' "
+                "AND name IN (%s); "
+                "INSERT INTO manifest SELECT * FROM temp.snapshot "
+                "WHERE kind = '%s' AND name IN (%s);",
+                data->column, sets, data->column, sets);
+        success = gva_db_execute (sql, error);
         g_free (sql);
+
+        g_free (sets);
+
+        return success;
 }
 
 static void
-audit_exit (GvaProcess *process,
-            gint status,
-            GvaAuditData *data)
+audit_write (GvaAuditData *data)
 {
         gchar *sql;
         GError *error = NULL;
 
-        if (process->error != NULL)
-                return;
-
         gva_db_transaction_begin (&error);
         gva_error_handle (&error);
 
-        sql = g_strdup_printf ("UPDATE game SET %s=NULL", data->column);
+        if (data->names != NULL)
+                sql = g_strdup_printf (
+                        "UPDATE game SET %s=NULL WHERE name IN (%s)",
+                        data->column, data->names);
+        else
+                sql = g_strdup_printf (
+                        "UPDATE game SET %s=NULL", data->column);
+        gva_db_execute (sql, &error);
+        gva_error_handle (&error);
+        g_free (sql);
+
+        sql = g_strdup_printf (
+                "UPDATE game SET %s = (SELECT status "
+                "FROM temp.audit_result AS r "
+                "WHERE r.kind = '%s' AND r.name = game.name) "
+                "WHERE name IN (SELECT name FROM temp.audit_result "
+                "WHERE kind = '%s'); "
+                "DELETE FROM temp.audit_result WHERE kind = '%s';",
+                data->column, data->column, data->column, data->column);
         gva_db_execute (sql, &error);
         gva_error_handle (&error);
         g_free (sql);
 
-        g_hash_table_foreach (
-                data->status_index, (GHFunc) audit_exit_foreach, data);
+        /* Replace the report lines for the games just audited. */
+        if (data->output_stmt != NULL)
+        {
+                if (data->names != NULL)
+                        sql = g_strdup_printf (
+                                "DELETE FROM audit_detail "
+                                "WHERE name IN (%s); ", data->names);
+                else
+                        sql = g_strdup ("DELETE FROM audit_detail; ");
+                gva_db_execute (sql, &error);
+                gva_error_handle (&error);
+                g_free (sql);
+
+                gva_db_execute (
+                        "INSERT INTO audit_detail "
+                        "SELECT * FROM temp.audit_output; "
+                        "DELETE FROM temp.audit_output;", &error);
+                gva_error_handle (&error);
+        }
+
+        if (data->scanned)
+        {
+                audit_write_manifest (data, &error);
+                gva_error_handle (&error);
+        }
 
         gva_db_transaction_commit (&error);
         gva_error_handle (&error);
@@ -292,112 +651,663 @@ audit_run_save_dialog (void)
 }
 
 static void
-audit_show_dialog (GvaProcess *process,
-                   gint status,
-                   GvaAuditData *data)
+audit_finish (GvaAuditData *data)
 {
-        GtkTreeView *tree_view;
-        GtkTreeModel *model;
-        GError *error = NULL;
+        if (data->error == NULL)
+                audit_write (data);
+        else
+                g_simple_async_result_set_from_error (
+                        data->simple, data->error);
+
+        g_simple_async_result_complete_in_idle (data->simple);
+
+        audit_data_free (data);
+}
+
+static void
+audit_kill_shards (GvaAuditData *data)
+{
+        GSList *link;
+
+        for (link = data->running; link != NULL; link = link->next)
+        {
+                GvaAuditShard *shard = link->data;
+                gva_process_kill (shard->process);
+        }
+}
+
+static void
+audit_cancelled_cb (GCancellable *cancellable,
+                    GvaAuditData *data)
+{
+        /* audit_run() reports the cancellation. */
+        audit_kill_shards (data);
+}
+
+static void
+audit_shard_exited (GvaProcess *process,
+                    gint status,
+                    GvaAuditShard *shard)
+{
+        GvaAuditData *data = shard->data;
+
+        data->running = g_slist_remove (data->running, shard);
 
         if (process->error != NULL)
+        {
+                /* The other shards' results would be incomplete. */
+                if (data->error == NULL)
+                {
+                        data->error = g_error_copy (process->error);
+                        audit_kill_shards (data);
+                }
+        }
+        else
+        {
+                /* Handle a final line with no trailing newline. */
+                audit_read (process, shard);
+                if (shard->line->len > 0)
+                        audit_read_line (shard, shard->line->str);
+                audit_shard_flush (shard, NULL);
+        }
+
+        audit_shard_free (shard);
+}
+
+/* Keeps up to max_running verify processes going until every shard has
+ * been verified, then finishes the audit.  Called to start the audit
+ * and again as each process exits. */
+static void
+audit_run (GvaAuditData *data)
+{
+        guint n_names;
+
+        if (data->error == NULL)
+                g_cancellable_set_error_if_cancelled (
+                        data->cancellable, &data->error);
+
+        n_names = data->n_names;
+
+        while (data->error == NULL &&
+               data->next_shard < data->n_shards &&
+               g_slist_length (data->running) < data->max_running)
+        {
+                GvaAuditShard *shard;
+                GvaProcess *process;
+                gchar **names;
+                gchar *save;
+                guint first, last;
+
+                /* Shards are contiguous runs of names, so clones
+                 * tend to be verified along with their parents. */
+                first = n_names * data->next_shard / data->n_shards;
+                last = n_names * (data->next_shard + 1) / data->n_shards;
+                data->next_shard++;
+
+                /* Terminate the shard in place while spawning. */
+                names = data->all_names + first;
+                save = names[last - first];
+                names[last - first] = NULL;
+                process = data->spawn (names, &data->error);
+                names[last - first] = save;
+
+                if (process == NULL)
+                {
+                        audit_kill_shards (data);
+                        break;
+                }
+
+                gva_process_set_stream_mode (process, AUDIT_BUFFER_SIZE);
+
+                shard = audit_shard_new (data, process);
+
+                g_signal_connect (
+                        process, "data-ready",
+                        G_CALLBACK (audit_read), shard);
+
+                g_signal_connect (
+                        process, "exited",
+                        G_CALLBACK (audit_shard_exited), shard);
+
+                g_signal_connect_swapped (
+                        process, "exited",
+                        G_CALLBACK (audit_run), data);
+
+                data->running = g_slist_prepend (data->running, shard);
+        }
+
+        if (data->running == NULL)
+                audit_finish (data);
+}
+
+static gchar **
+audit_list_games (const gchar *sql,
+                  GError **error)
+{
+        sqlite3_stmt *stmt;
+        GPtrArray *array;
+        gint errcode;
+
+        if (!gva_db_prepare (sql, &stmt, error))
+                return NULL;
+
+        array = g_ptr_array_new ();
+
+        while ((errcode = sqlite3_step (stmt)) == SQLITE_ROW)
+                g_ptr_array_add (array, g_strdup (
+                        (const gchar *) sqlite3_column_text (stmt, 0)));
+
+        if (errcode != SQLITE_DONE)
+                gva_db_set_error (error, 0, NULL);
+
+        sqlite3_finalize (stmt);
+
+        g_ptr_array_add (array, NULL);
+
+        if (errcode != SQLITE_DONE)
+        {
+                g_strfreev ((gchar **) g_ptr_array_free (array, FALSE));
+                return NULL;
+        }
+
+        return (gchar **) g_ptr_array_free (array, FALSE);
+}
+
+/* Folds the files in a set directory into the directory's own status,
+ * since adding, removing or rewriting a file inside it may not touch
+ * the directory itself. */
+static void
+audit_scan_set_directory (const gchar *directory,
+                          struct stat *st)
+{
+        GDir *dir;
+        const gchar *basename;
+
+        dir = g_dir_open (directory, 0, NULL);
+        if (dir == NULL)
                 return;
 
-        tree_view = GTK_TREE_VIEW (GVA_WIDGET_AUDIT_TREE_VIEW);
-        model = gtk_tree_view_get_model (tree_view);
+        while ((basename = g_dir_read_name (dir)) != NULL)
+        {
+                struct stat file_st;
+                gchar *filename;
+
+                filename = g_build_filename (directory, basename, NULL);
+
+                if (g_stat (filename, &file_st) == 0)
+                {
+                        st->st_size += file_st.st_size;
+                        st->st_mtime = MAX (st->st_mtime, file_st.st_mtime);
+                }
+
+                g_free (filename);
+        }
+
+        g_dir_close (dir);
+}
+
+/* Adds the sets in a search path directory to the snapshot.  A set is
+ * either a ZIP or 7-Zip archive, or a directory named after the set. */
+static gboolean
+audit_scan_directory (sqlite3_stmt *stmt,
+                      const gchar *directory,
+                      GError **error)
+{
+        GDir *dir;
+        const gchar *basename;
+        gboolean success = TRUE;
 
-        if (!audit_build_model (GTK_TREE_STORE (model), data, &error))
+        /* Skip paths that don't exist or are not directories. */
+        dir = g_dir_open (directory, 0, NULL);
+        if (dir == NULL)
+                return TRUE;
+
+        while (success && (basename = g_dir_read_name (dir)) != NULL)
         {
-                gva_error_handle (&error);
+                struct stat st;
+                gchar *filename;
+                gchar *name;
+
+                filename = g_build_filename (directory, basename, NULL);
+
+                if (g_stat (filename, &st) < 0)
+                        name = NULL;
+                else if (S_ISDIR (st.st_mode))
+                {
+                        name = g_strdup (basename);
+                        audit_scan_set_directory (filename, &st);
+                }
+                else if (g_str_has_suffix (basename, ".zip") ||
+                         g_str_has_suffix (basename, ".7z"))
+                        name = g_strndup (
+                                basename, strrchr (basename, '.') - basename);
+                else
+                        name = NULL;
+
+                if (name != NULL)
+                {
+                        sqlite3_bind_text (stmt, 2, filename, -1, g_free);
+                        sqlite3_bind_text (stmt, 3, name, -1, g_free);
+                        sqlite3_bind_int64 (stmt, 4, st.st_size);
+                        sqlite3_bind_int64 (stmt, 5, st.st_mtime);
+                        sqlite3_bind_int64 (stmt, 6, st.st_ino);
+
+                        if (sqlite3_step (stmt) != SQLITE_DONE)
+                        {
+                                gva_db_set_error (error, 0, NULL);
+                                success = FALSE;
+                        }
+
+                        sqlite3_reset (stmt);
+                }
+                else
+                        g_free (filename);
+        }
+
+        g_dir_close (dir);
+
+        return success;
+}
+
+/* The configuration key for the search path of @kind,
+ * which is "romset" or "sampleset". */
+static const gchar *
+audit_get_config_key (const gchar *kind)
+{
+        if (strcmp (kind, "sampleset") == 0)
+                return "samplepath";
+
+        return "rompath";
+}
+
+/* Fills the snapshot table with the sets of @kind found in
+ * @directories, the search path for @kind.  If an error occurs,
+ * it returns %FALSE and sets @error. */
+static gboolean
+audit_scan (const gchar *kind,
+            gchar **directories,
+            GError **error)
+{
+        sqlite3_stmt *stmt;
+        gboolean success;
+        gchar *sql;
+        guint ii;
+
+        sql = g_strdup_printf (
+                SQL_CREATE_SNAPSHOT
+                "DELETE FROM temp.snapshot WHERE kind = '%s';", kind);
+        success = gva_db_execute (sql, error);
+        g_free (sql);
+
+        if (success)
+                success = gva_db_prepare (SQL_INSERT_SNAPSHOT, &stmt, error);
+
+        if (!success)
+                return FALSE;
+
+        sqlite3_bind_text (stmt, 1, kind, -1, SQLITE_STATIC);
+
+        if (gva_db_transaction_begin (error))
+        {
+                for (ii = 0; success && directories[ii] != NULL; ii++)
+                        success = audit_scan_directory (
+                                stmt, directories[ii], error);
+
+                if (success)
+                        success = gva_db_transaction_commit (error);
+                else
+                        gva_db_transaction_rollback (NULL);
+        }
+        else
+                success = FALSE;
+
+        sqlite3_finalize (stmt);
+
+        return success;
+}
+
+/* The number of verify processes to run at once. */
+static guint
+audit_get_max_running (void)
+{
+        GSettings *settings;
+        gint jobs;
+
+        settings = gva_get_settings ();
+        jobs = g_settings_get_int (settings, GVA_SETTING_AUDIT_JOBS);
+
+        if (jobs <= 0)
+                jobs = (gint) sysconf (_SC_NPROCESSORS_ONLN);
+
+        return (guint) MAX (jobs, 1);
+}
+
+/* Readies the audit_result table for statuses from this audit. */
+static gboolean
+audit_prepare_results (GvaAuditData *data,
+                       GError **error)
+{
+        gchar *sql;
+        gboolean success;
+
+        sql = g_strdup_printf (
+                SQL_CREATE_AUDIT_RESULT
+                "DELETE FROM temp.audit_result WHERE kind = '%s';",
+                data->column);
+        success = gva_db_execute (sql, error);
+        g_free (sql);
+
+        if (success)
+                success = gva_db_prepare (
+                        SQL_INSERT_AUDIT_RESULT, &data->insert_stmt, error);
+
+        if (success)
+                sqlite3_bind_text (
+                        data->insert_stmt, 1, data->column,
+                        -1, SQLITE_STATIC);
+
+        /* Only the ROM audit keeps a report. */
+        if (success && strcmp (data->column, "romset") == 0)
+                success = gva_db_execute (SQL_CREATE_AUDIT_OUTPUT, error);
+
+        if (success && strcmp (data->column, "romset") == 0)
+                success = gva_db_prepare (
+                        SQL_INSERT_AUDIT_OUTPUT, &data->output_stmt, error);
+
+        return success;
+}
+
+/* Splits the games left to verify into shards. */
+static void
+audit_plan_shards (GvaAuditData *data)
+{
+        guint n_shards;
+
+        if (data->all_names != NULL)
+                data->n_names = g_strv_length (data->all_names);
+
+        n_shards = data->max_running * AUDIT_SHARDS_PER_JOB;
+        n_shards = MIN (n_shards,
+                (data->n_names + AUDIT_MIN_SHARD_SIZE - 1) /
+                AUDIT_MIN_SHARD_SIZE);
+        n_shards = MAX (n_shards,
+                (data->n_names + AUDIT_MAX_SHARD_SIZE - 1) /
+                AUDIT_MAX_SHARD_SIZE);
+        if (data->n_names > 0)
+                data->n_shards = MAX (n_shards, 1);
+
+        g_log (
+                G_LOG_DOMAIN, GVA_DEBUG_MAME,
+                "Auditing %u %ss in %u shards, %u at a time.",
+                data->n_names, data->column,
+                data->n_shards, data->max_running);
+}
+
+static void
+audit_verify_cb (GObject *source_object,
+                 GAsyncResult *result,
+                 GvaAuditData *data)
+{
+        GvaAuditShard *shard;
+        gchar **deferred = NULL;
+        gchar **lines;
+        guint ii;
+
+        lines = gva_verify_roms_finish (result, &deferred, &data->error);
+
+        if (lines != NULL)
+        {
+                /* Take the results as if MAME had written them. */
+                shard = audit_shard_new (data, NULL);
+                for (ii = 0; lines[ii] != NULL; ii++)
+                        audit_read_line (shard, lines[ii]);
+                audit_shard_flush (shard, NULL);
+                audit_shard_free (shard);
+
+                if (data->progress_callback != NULL)
+                        data->progress_callback (
+                                data->n_audited, data->n_total,
+                                data->progress_data);
+
+                /* MAME verifies whatever is left. */
+                g_strfreev (data->all_names);
+                data->all_names = deferred;
+
+                g_strfreev (lines);
+        }
+
+        audit_plan_shards (data);
+        audit_run (data);
+}
+
+static void
+audit_verify_sets (GvaAuditData *data)
+{
+        /* Verify what we can without MAME first. */
+        if (data->native && data->n_total > 0 && data->error == NULL)
+        {
+                gva_verify_roms_async (
+                        data->all_names, data->max_running,
+                        data->cancellable, (GAsyncReadyCallback)
+                        audit_verify_cb, data);
                 return;
         }
 
-        if (gtk_tree_model_iter_n_children (model, NULL) > 0)
-                gtk_window_present (GTK_WINDOW (GVA_WIDGET_AUDIT_WINDOW));
+        audit_plan_shards (data);
+        audit_run (data);
 }
 
-/**
- * gva_audit_roms:
- * @error: return location for a #GError, or %NULL
- *
- * Starts the lengthy process of auditing the integrity of the available
- * ROM sets and returns a #GvaProcess to track it.  The results of the
- * audit are written to the "romset" column of the game database.  If an
- * error occurs while starting the audit, it returns %NULL and sets @error.
- *
- * Returns: a new #GvaProcess, or %NULL
- **/
-GvaProcess *
-gva_audit_roms (GError **error)
+static void
+audit_search_paths_cb (GObject *source_object,
+                       GAsyncResult *result,
+                       GvaAuditData *data)
+{
+        gchar **directories;
+        GError *error = NULL;
+
+        /* The audit goes ahead without updating the manifest if the
+         * scan fails, at the cost of auditing the sets again later.
+         * A cancelled audit reports the cancellation itself. */
+        directories = gva_mame_get_search_paths_finish (result, &error);
+
+        if (directories != NULL)
+                data->scanned = audit_scan (
+                        data->column, directories, &error);
+
+        if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                g_clear_error (&error);
+        gva_error_handle (&error);
+
+        g_strfreev (directories);
+
+        audit_verify_sets (data);
+}
+
+static void
+audit_start (const gchar *column,
+             gchar **names,
+             const gchar *sql,
+             GvaAuditSpawnFunc spawn,
+             gboolean native,
+             GvaAuditProgressFunc progress_callback,
+             gpointer progress_data,
+             GCancellable *cancellable,
+             GAsyncReadyCallback callback,
+             gpointer user_data,
+             gpointer source_tag)
 {
-        GvaProcess *process;
         GvaAuditData *data;
 
-        process = gva_mame_verify_all_roms (error);
-        if (process == NULL)
-                return NULL;
+        data = audit_data_new (column, names);
+        data->spawn = spawn;
+        data->native = native;
+        data->progress_callback = progress_callback;
+        data->progress_data = progress_data;
+        data->max_running = audit_get_max_running ();
+        data->simple = g_simple_async_result_new (
+                NULL, callback, user_data, source_tag);
+
+        audit_prepare_results (data, &data->error);
+
+        if (names != NULL)
+                data->all_names = g_strdupv (names);
+        else if (data->error == NULL)
+                data->all_names = audit_list_games (sql, &data->error);
 
-        data = audit_data_new ("romset");
+        if (data->all_names != NULL)
+                data->n_total = g_strv_length (data->all_names);
+
+        if (cancellable != NULL)
+        {
+                data->cancellable = g_object_ref (cancellable);
+                data->cancelled_id = g_cancellable_connect (
+                        cancellable, G_CALLBACK (audit_cancelled_cb),
+                        data, NULL);
+        }
+
+        /* Take stock of the set files before verifying them, unless
+         * a change-detection pass just did.  Files changed since then
+         * show up as changes the next time around. */
+        if (audit_snapshot_fresh)
+        {
+                data->scanned = TRUE;
+                audit_verify_sets (data);
+                return;
+        }
 
-        g_signal_connect (
-                process, "stdout-ready",
-                G_CALLBACK (audit_read), data);
+        gva_mame_get_search_paths_async (
+                audit_get_config_key (column), data->cancellable,
+                (GAsyncReadyCallback) audit_search_paths_cb, data);
+}
 
-        g_signal_connect (
-                process, "exited",
-                G_CALLBACK (audit_exit), data);
+static gboolean
+audit_finish_common (GAsyncResult *result,
+                     gpointer source_tag,
+                     GError **error)
+{
+        GSimpleAsyncResult *simple;
 
-        g_signal_connect (
-                process, "exited",
-                G_CALLBACK (audit_show_dialog), data);
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, source_tag), FALSE);
 
-        g_signal_connect_swapped (
-                process, "exited",
-                G_CALLBACK (audit_data_free), data);
+        simple = G_SIMPLE_ASYNC_RESULT (result);
 
-        return process;
+        return !g_simple_async_result_propagate_error (simple, error);
 }
 
 /**
- * gva_audit_samples:
- * @error: return location for a #GError, or %NULL
+ * gva_audit_roms_async:
+ * @names: a %NULL-terminated array of game names, or %NULL
+ * @progress_callback: a #GvaAuditProgressFunc, or %NULL
+ * @progress_data: data to pass to @progress_callback
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the audit finishes
+ * @user_data: data to pass to @callback
  *
- * Starts the length process of auditing the integrity of the available
- * sample sets and returns a #GvaProcess to track it.  The results of the
- * audit are written to the "sampleset" column of the game database.  If
- * an error occurs while starting the audit, it returns %NULL and sets
- * @error.
+ * Starts the lengthy process of auditing the integrity of the ROM sets
+ * for the games in @names, or for all games if @names is %NULL.  The
+ * results of the audit are written to the "romset" column of the game
+ * database, and results for other games are left untouched.  Call
+ * gva_audit_show_results() afterward to show any bad ROM sets.
  *
- * Returns: a new #GvaProcess, or %NULL
+ * The games are split into shards that are verified by several MAME
+ * processes at once.  The "audit-jobs" setting limits how many run at
+ * once, and defaults to one per processor.  If the "audit-native"
+ * setting is enabled, gva_verify_roms_async() checks the ROM sets it
+ * can first, on as many threads, and MAME verifies the rest.
+ *
+ * Call gva_audit_roms_finish() from @callback to find out whether the
+ * audit succeeded.
  **/
-GvaProcess *
-gva_audit_samples (GError **error)
+void
+gva_audit_roms_async (gchar **names,
+                      GvaAuditProgressFunc progress_callback,
+                      gpointer progress_data,
+                      GCancellable *cancellable,
+                      GAsyncReadyCallback callback,
+                      gpointer user_data)
 {
-        GvaProcess *process;
-        GvaAuditData *data;
-
-        process = gva_mame_verify_all_samples (error);
-        if (process == NULL)
-                return NULL;
-
-        data = audit_data_new ("sampleset");
+        GSettings *settings;
+        gboolean native;
 
-        g_signal_connect (
-                process, "stdout-ready",
-                G_CALLBACK (audit_read), data);
+        settings = gva_get_settings ();
+        native = g_settings_get_boolean (settings, GVA_SETTING_AUDIT_NATIVE);
+
+        audit_start (
+                "romset", names, SQL_SELECT_ROMSETS,
+                gva_mame_verify_some_roms, native,
+                progress_callback, progress_data,
+                cancellable, callback, user_data,
+                gva_audit_roms_async);
+}
 
-        g_signal_connect (
-                process, "exited",
-                G_CALLBACK (audit_exit), data);
+/**
+ * gva_audit_roms_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_audit_roms_async().  If the
+ * audit failed or was cancelled, it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE if the audit completed successfully
+ **/
+gboolean
+gva_audit_roms_finish (GAsyncResult *result,
+                       GError **error)
+{
+        return audit_finish_common (result, gva_audit_roms_async, error);
+}
 
-        g_signal_connect_swapped (
-                process, "exited",
-                G_CALLBACK (audit_data_free), data);
+/**
+ * gva_audit_samples_async:
+ * @names: a %NULL-terminated array of game names, or %NULL
+ * @progress_callback: a #GvaAuditProgressFunc, or %NULL
+ * @progress_data: data to pass to @progress_callback
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the audit finishes
+ * @user_data: data to pass to @callback
+ *
+ * Like gva_audit_roms_async(), but audits sample sets and writes the
+ * results to the "sampleset" column of the game database.  If @names
+ * is %NULL, only games that use samples are audited.
+ *
+ * Call gva_audit_samples_finish() from @callback to find out whether
+ * the audit succeeded.
+ **/
+void
+gva_audit_samples_async (gchar **names,
+                         GvaAuditProgressFunc progress_callback,
+                         gpointer progress_data,
+                         GCancellable *cancellable,
+                         GAsyncReadyCallback callback,
+                         gpointer user_data)
+{
+        audit_start (
+                "sampleset", names, SQL_SELECT_SAMPLESETS,
+                gva_mame_verify_some_samples, FALSE,
+                progress_callback, progress_data,
+                cancellable, callback, user_data,
+                gva_audit_samples_async);
+}
 
-        return process;
+/**
+ * gva_audit_samples_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_audit_samples_async().  If the
+ * audit failed or was cancelled, it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE if the audit completed successfully
+ **/
+gboolean
+gva_audit_samples_finish (GAsyncResult *result,
+                          GError **error)
+{
+        return audit_finish_common (result, gva_audit_samples_async, error);
 }
 
-/* Helper for audit_save_errors() */
 static gboolean
 audit_save_errors_foreach (GtkTreeModel *model,
                            GtkTreePath *path,
@@ -416,12 +1326,51 @@ audit_save_errors_foreach (GtkTreeModel *model,
 }
 
 /**
- * gva_audit_save_errors:
+ * gva_audit_is_running:
  *
- * Saves the results of the most recent ROM file audit to a file.
+ * Returns %TRUE if an audit started by gva_audit_roms_async() or
+ * gva_audit_samples_async() has not finished yet.
+ *
+ * Returns: %TRUE if an audit is in progress
+ **/
+gboolean
+gva_audit_is_running (void)
+{
+        return (audit_n_running > 0);
+}
+
+/**
+ * gva_audit_show_results:
+ *
+ * Shows the games with bad ROM sets and the problems the most recent
+ * ROM file audit found with their files, if there are any.  The report
+ * is read back from the game database, so it remains available long
+ * after the audit.
  **/
 void
-gva_audit_save_errors (void)
+gva_audit_show_results (void)
+{
+        GtkTreeView *tree_view;
+        GtkTreeModel *model;
+        GError *error = NULL;
+
+        tree_view = GTK_TREE_VIEW (GVA_WIDGET_AUDIT_TREE_VIEW);
+        model = gtk_tree_view_get_model (tree_view);
+
+        if (!audit_build_model (GTK_TREE_STORE (model), &error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        if (gtk_tree_model_iter_n_children (model, NULL) > 0)
+                gtk_window_present (GTK_WINDOW (GVA_WIDGET_AUDIT_WINDOW));
+}
+
+static void
+audit_save_errors_cb (GObject *source_object,
+                      GAsyncResult *result,
+                      gpointer user_data)
 {
         GtkTreeView *view;
         GtkTreeModel *model;
@@ -432,9 +1381,8 @@ gva_audit_save_errors (void)
 
         view = GTK_TREE_VIEW (GVA_WIDGET_AUDIT_TREE_VIEW);
         model = gtk_tree_view_get_model (view);
-        g_return_if_fail (model != NULL);
 
-        mame_version = gva_mame_get_version (&error);
+        mame_version = gva_mame_get_version_finish (result, &error);
         gva_error_handle (&error);
 
         /* Build the contents of the file. */
@@ -464,44 +1412,222 @@ gva_audit_save_errors (void)
 }
 
 /**
- * gva_audit_detect_changes:
- *
- * Attempts to detect ROM and sample file changes since the last program
- * execution by scanning the timestamps on the directories listed in the
- * "rompath" and "samplepath" configuration values.  It returns %TRUE if
- * any of those timestamps are more recent than the game database.
+ * gva_audit_save_errors:
  *
- * Returns: %TRUE if changes were detected
+ * Saves the results of the most recent ROM file audit to a file.
  **/
-gboolean
-gva_audit_detect_changes (void)
+void
+gva_audit_save_errors (void)
 {
-        gboolean changes = FALSE;
-        gchar **directories;
-        struct stat st;
-        guint length, ii;
+        GtkTreeView *view;
+        GtkTreeModel *model;
+        GError *error = NULL;
+
+        view = GTK_TREE_VIEW (GVA_WIDGET_AUDIT_TREE_VIEW);
+        model = gtk_tree_view_get_model (view);
+        g_return_if_fail (model != NULL);
+
+        /* Read the report afresh, in case it was not shown yet. */
+        if (!audit_build_model (GTK_TREE_STORE (model), &error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        /* The report is headed by the MAME version. */
+        gva_mame_get_version_async (NULL, audit_save_errors_cb, NULL);
+}
+
+/* Marks the games affected by changes to the sets found in the search
+ * paths, and returns %TRUE if any games were marked. */
+static gboolean
+audit_detect_changes (gchar **rom_paths,
+                      gchar **sample_paths)
+{
+        gchar **result = NULL;
+        gint rows = 0;
+        gint last = -1;
+        gboolean success;
         GError *error = NULL;
 
-        if (g_stat (gva_db_get_filename (), &st) < 0)
+        audit_snapshot_fresh =
+                audit_scan ("romset", rom_paths, &error) &&
+                audit_scan ("sampleset", sample_paths, &error);
+
+        success =
+                audit_snapshot_fresh &&
+                gva_db_get_table (
+                        SQL_SELECT_NEW_MANIFEST, NULL, &rows, NULL, &error);
+
+        if (success && rows > 0)
+        {
+                /* Start a manifest with a full audit. */
+                success = gva_db_execute (SQL_INSERT_UNAUDITED_ALL, &error);
+                goto exit;
+        }
+
+        if (success)
+                success = gva_db_execute (SQL_CREATE_CHANGED, &error);
+
+        /* Follow ROM sharing until no more games turn up.  The chains
+         * are short: a BIOS, a parent, and its clones. */
+        while (success)
+        {
+                gint count;
+
+                success =
+                        gva_db_execute (
+                                SQL_INSERT_CHANGED_DEPENDENTS, &error) &&
+                        gva_db_get_table (
+                                SQL_COUNT_CHANGED, &result,
+                                NULL, NULL, &error);
+
+                if (!success)
+                        break;
+
+                count = atoi (result[1]);
+                g_strfreev (result);
+                result = NULL;
+
+                if (count == last)
+                        break;
+
+                last = count;
+        }
+
+        if (success)
+                success = gva_db_execute (
+                        SQL_INSERT_CHANGED_SAMPLESETS, &error);
+
+        if (success)
+                success = gva_db_execute (
+                        SQL_INSERT_UNAUDITED_CHANGED, &error);
+
+exit:
+        gva_error_handle (&error);
+
+        if (!success)
                 return FALSE;
 
-        directories = gva_mame_get_search_paths ("rompath", &error);
-        length = (directories != NULL) ? g_strv_length (directories) : 0;
+        result = gva_db_get_unaudited (&error);
         gva_error_handle (&error);
 
-        for (ii = 0; ii < length; ii++)
-                changes |= gva_db_is_older_than (directories[ii]);
+        success = (result != NULL && result[0] != NULL);
 
-        g_strfreev (directories);
+        g_strfreev (result);
 
-        directories = gva_mame_get_search_paths ("samplepath", &error);
-        length = (directories != NULL) ? g_strv_length (directories) : 0;
-        gva_error_handle (&error);
+        return success;
+}
+
+static void
+audit_detect_changes_cb (GObject *source_object,
+                         GAsyncResult *result,
+                         GvaAuditDetect *detect)
+{
+        GSimpleAsyncResult *simple = detect->simple;
+        gchar **directories;
+        GError *error = NULL;
+
+        directories = gva_mame_get_search_paths_finish (result, &error);
+
+        if (directories == NULL)
+        {
+                g_simple_async_result_take_error (simple, error);
+                goto exit;
+        }
+
+        /* Look up the sample paths after the ROM paths. */
+        if (detect->rom_paths == NULL)
+        {
+                detect->rom_paths = directories;
+                gva_mame_get_search_paths_async (
+                        "samplepath", detect->cancellable,
+                        (GAsyncReadyCallback) audit_detect_changes_cb,
+                        detect);
+                return;
+        }
 
-        for (ii = 0; ii < length; ii++)
-                changes |= gva_db_is_older_than (directories[ii]);
+        g_simple_async_result_set_op_res_gboolean (
+                simple, audit_detect_changes (
+                detect->rom_paths, directories));
 
         g_strfreev (directories);
 
-        return changes;
+exit:
+        g_simple_async_result_complete (simple);
+        g_object_unref (simple);
+
+        if (detect->cancellable != NULL)
+                g_object_unref (detect->cancellable);
+        g_strfreev (detect->rom_paths);
+        g_slice_free (GvaAuditDetect, detect);
+}
+
+/**
+ * gva_audit_detect_changes_async:
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when detection finishes
+ * @user_data: data to pass to @callback
+ *
+ * Attempts to detect ROM and sample file changes since the last audit
+ * by scanning the directories listed in the "rompath" and "samplepath"
+ * configuration values and comparing the size, modification time and
+ * inode of each set against the manifest recorded by the last audit.
+ * Games affected by added, removed or modified sets are marked for
+ * auditing (see gva_db_get_unaudited()), along with their parents and
+ * clones and any games sharing ROMs with them.  If there is no manifest
+ * yet, every game is marked.
+ *
+ * Audits started afterward take stock of the sets from this scan rather
+ * than scanning the directories again.
+ *
+ * Call gva_audit_detect_changes_finish() from @callback to find out
+ * whether any games were marked.
+ **/
+void
+gva_audit_detect_changes_async (GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data)
+{
+        GvaAuditDetect *detect;
+
+        detect = g_slice_new0 (GvaAuditDetect);
+        detect->simple = g_simple_async_result_new (
+                NULL, callback, user_data,
+                gva_audit_detect_changes_async);
+        if (cancellable != NULL)
+                detect->cancellable = g_object_ref (cancellable);
+
+        gva_mame_get_search_paths_async (
+                "rompath", cancellable, (GAsyncReadyCallback)
+                audit_detect_changes_cb, detect);
+}
+
+/**
+ * gva_audit_detect_changes_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_audit_detect_changes_async().
+ * If the search paths could not be determined, it returns %FALSE and
+ * sets @error.
+ *
+ * Returns: %TRUE if changes were detected
+ **/
+gboolean
+gva_audit_detect_changes_finish (GAsyncResult *result,
+                                 GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_audit_detect_changes_async), FALSE);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return FALSE;
+
+        return g_simple_async_result_get_op_res_gboolean (simple);
 }
@@ -32,10 +32,42 @@
 
 G_BEGIN_DECLS
 
-GvaProcess *    gva_audit_roms                  (GError **error);
-GvaProcess *    gva_audit_samples               (GError **error);
+/**
+ * GvaAuditProgressFunc:
+ * @n_audited: the number of games audited so far
+ * @n_total: the number of games being audited
+ * @user_data: data passed along with the function
+ *
+ * Reports the progress of an audit.
+ **/
+typedef void (*GvaAuditProgressFunc) (guint n_audited,
+                                      guint n_total,
+                                      gpointer user_data);
+
+void            gva_audit_roms_async            (gchar **names,
+                                                 GvaAuditProgressFunc progress_callback,
+                                                 gpointer progress_data,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gboolean        gva_audit_roms_finish           (GAsyncResult *result,
+                                                 GError **error);
+void            gva_audit_samples_async         (gchar **names,
+                                                 GvaAuditProgressFunc progress_callback,
+                                                 gpointer progress_data,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gboolean        gva_audit_samples_finish        (GAsyncResult *result,
+                                                 GError **error);
+gboolean        gva_audit_is_running            (void);
+void            gva_audit_show_results          (void);
 void            gva_audit_save_errors           (void);
-gboolean        gva_audit_detect_changes        (void);
+void            gva_audit_detect_changes_async  (GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gboolean        gva_audit_detect_changes_finish (GAsyncResult *result,
+                                                 GError **error);
 
 G_END_DECLS
 
@@ -1012,12 +1012,14 @@ column_info[GVA_GAME_STORE_NUM_COLUMNS] =
         { "description",        N_("Title"),
                                 columns_factory_description,
                                 columns_tooltip_summary },
+        { "description_key",    NULL },
         { "year",               N_("Year"),
                                 columns_factory_year,
                                 columns_tooltip_summary },
         { "manufacturer",       N_("Manufacturer"),
                                 columns_factory_manufacturer,
                                 columns_tooltip_summary },
+        { "manufacturer_key",   NULL },
         { "sound_channels",     NULL },
         { "input_service",      NULL },
         { "input_tilt",         NULL },
@@ -1511,6 +1513,10 @@ gva_columns_get_names_full (GtkTreeView *view)
                 }
         }
 
+        /* The type-ahead search matches on the description's key,
+         * whether or not the description is shown. */
+        columns_add_dependency (&names, "description_key");
+
         return names;
 }
 
@@ -38,6 +38,8 @@
 #include <libsoup/soup.h>
 
 #define GVA_SETTING_ALL_COLUMNS                 "all-columns"
+#define GVA_SETTING_AUDIT_JOBS                  "audit-jobs"
+#define GVA_SETTING_AUDIT_NATIVE                "audit-native"
 #define GVA_SETTING_AUTO_SAVE                   "auto-save"
 #define GVA_SETTING_COLUMNS                     "columns"
 #define GVA_SETTING_FAVORITES                   "favorites"
@@ -46,6 +48,7 @@
 #define GVA_SETTING_PROPERTIES_PAGE             "properties-page"
 #define GVA_SETTING_PROPERTIES_PREFIX           "properties"
 #define GVA_SETTING_SEARCH                      "search"
+#define GVA_SETTING_SEARCH_AS_YOU_TYPE          "search-as-you-type"
 #define GVA_SETTING_SELECTED_GAME               "selected-game"
 #define GVA_SETTING_SELECTED_MATCH              "selected-match"
 #define GVA_SETTING_SELECTED_VIEW               "selected-view"
@@ -18,8 +18,11 @@
 
 #include "gva-db.h"
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "gva-audit.h"
 #include "gva-categories.h"
 #include "gva-error.h"
 #include "gva-favorites.h"
@@ -27,12 +30,44 @@
 #include "gva-nplayers.h"
 #include "gva-util.h"
 
-#define ASSERT_OK(code) \
-        if ((code) != SQLITE_OK) g_error ("%s", sqlite3_errmsg (db));
-
 /* Based on MAME's DTD */
 #define MAX_ELEMENT_DEPTH 4
 
+/* Read "MAME -listxml" output as a byte stream rather than line by
+ * line.  The output is hundreds of megabytes, so per-line overhead
+ * dominates the build time. */
+#define LISTXML_BUFFER_SIZE (256 * 1024)
+
+/* The build runs as a pipeline: the main thread hands raw chunks of
+ * output to a parser thread, which hands batches of rows to a writer
+ * thread with its own database connection.  These limits bound the
+ * amount of work in flight, so the tail of the build after MAME exits
+ * stays short and memory use stays flat. */
+#define MAX_QUEUED_CHUNKS 4
+#define MAX_QUEUED_BATCHES 2
+#define GAMES_PER_BATCH 256
+
+/* "MAME -listxml" output is cached in compressed form, keyed by the
+ * MAME executable and its version.  Rebuilds for other reasons (e.g. a
+ * new category file) replay the cache instead of running MAME. */
+#define LISTXML_CACHE_FILE "listxml.gz"
+#define LISTXML_CACHE_KEY_FILE "listxml.key"
+#define LISTXML_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* Initial value for 64-bit FNV-1a digests */
+#define DB_HASH_INIT G_GUINT64_CONSTANT (0xcbf29ce484222325)
+
+/* Progress is sampled rather than signalled for every game. */
+#define PROGRESS_INTERVAL 100  /* milliseconds */
+
+/* How often to try again to install a finished build. */
+#define INSTALL_RETRY_INTERVAL 500  /* milliseconds */
+
+/* Names found by a background query are handed to the main thread in
+ * batches, except the first, which is handed over as soon as it turns
+ * up so something shows right away. */
+#define SELECT_BATCH_SIZE 200
+
 /* The new <dipswitch> and <configuration> attributes in 0.136 are
  * REQUIRED, but we are leaving them as optional in the table schema
  * for backward compatibility with older MAME versions. */
@@ -43,7 +78,9 @@
                 "complete DEFAULT 'no' " \
                 "CHECK (complete in ('yes', 'no')), " \
                 "debug DEFAULT 'no' " \
-                "CHECK (debug in ('yes', 'no')));"
+                "CHECK (debug in ('yes', 'no')), " \
+                "sets DEFAULT 'no' " \
+                "CHECK (sets in ('yes', 'no')));"
 
 #define SQL_CREATE_TABLE_GAME \
         "CREATE TABLE IF NOT EXISTS game (" \
@@ -68,8 +105,10 @@
                 "CHECK (sampleset in " \
                 "('good', 'best available', 'bad')), " \
                 "description NOT NULL, " \
+                "description_key, " \
                 "year, " \
                 "manufacturer, " \
+                "manufacturer_key, " \
                 "sound_channels, " \
                 "input_service DEFAULT 'no' " \
                 "CHECK (input_service in ('yes', 'no')), " \
@@ -215,6 +254,30 @@
                 "name NOT NULL, " \
                 "default_ NOT NULL);"
 
+/* The gamehash table holds a digest of each game's XML data, so an
+ * incremental build can tell which games changed. */
+#define SQL_CREATE_TABLE_GAMEHASH \
+        "CREATE TABLE IF NOT EXISTS gamehash (" \
+                "name PRIMARY KEY, " \
+                "hash NOT NULL);"
+
+/* The unaudited table lists games whose ROM and sample sets have not
+ * been audited since they were added or changed by a database build,
+ * or since gva_audit_detect_changes_async() found changes to their files. */
+#define SQL_CREATE_TABLE_UNAUDITED \
+        "CREATE TABLE IF NOT EXISTS unaudited (" \
+                "name PRIMARY KEY ON CONFLICT IGNORE);"
+
+/* The audit_detail table holds what the last ROM audit of each game
+ * with a bad ROM set had to say about its files, one row per line, so
+ * the audit results can be shown again without another audit. */
+#define SQL_CREATE_TABLE_AUDIT_DETAIL \
+        "CREATE TABLE IF NOT EXISTS audit_detail (" \
+                "name NOT NULL, " \
+                "line_no NOT NULL, " \
+                "text NOT NULL, " \
+                "PRIMARY KEY (name, line_no));"
+
 /* The lastplayed table survives database builds. */
 #define SQL_CREATE_TABLE_LASTPLAYED \
         "CREATE TABLE IF NOT EXISTS lastplayed (" \
@@ -238,6 +301,30 @@
                 "height, " \
                 "maximized);"
 
+/* The emulator table survives database builds.  It records what MAME
+ * reported about itself so startup need not run MAME again until the
+ * executable or its configuration files change. */
+#define SQL_CREATE_TABLE_EMULATOR \
+        "CREATE TABLE IF NOT EXISTS emulator (" \
+                "path PRIMARY KEY ON CONFLICT REPLACE, " \
+                "fingerprint NOT NULL, " \
+                "version, " \
+                "showconfig NOT NULL);"
+
+/* The manifest table survives database builds.  It records the size,
+ * modification time and inode of each ROM and sample set file as of
+ * the last audit of that set, so changes can be traced back to the
+ * sets they affect. */
+#define SQL_CREATE_TABLE_MANIFEST \
+        "CREATE TABLE IF NOT EXISTS manifest (" \
+                "kind NOT NULL CHECK (kind in ('romset', 'sampleset')), " \
+                "path NOT NULL, " \
+                "name NOT NULL, " \
+                "size, " \
+                "mtime, " \
+                "inode, " \
+                "PRIMARY KEY (kind, path) ON CONFLICT REPLACE);"
+
 #define SQL_CREATE_VIEW_AVAILABLE \
         "CREATE VIEW IF NOT EXISTS available AS " \
                 "SELECT game.*, bios.description AS bios, " \
@@ -251,6 +338,81 @@
                 "AND isdevice = 'no' " \
                 "AND ismechanical = 'no');"
 
+/* Marks games whose detail tables (sample, dipvalue, etc.) have been
+ * filled in by gva_db_load_details(), along with the game's digest at
+ * the time.
+ * The details are stale once the digest in gamehash changes. */
+#define SQL_CREATE_TABLE_DETAIL \
+        "CREATE TABLE IF NOT EXISTS detail (" \
+                "name PRIMARY KEY ON CONFLICT REPLACE, " \
+                "hash NOT NULL);"
+
+/* The search table holds the searchable text of each game as collation
+ * keys (see gva_search_collate_key()), one line per field, so a search
+ * is a substring match on precomputed keys.  SQLite 3.34 and later can
+ * index it with trigrams, which keeps the substring match from scanning
+ * every row. */
+#define SQL_CREATE_TABLE_SEARCH \
+        "CREATE TABLE IF NOT EXISTS search (" \
+                "name PRIMARY KEY, " \
+                "key NOT NULL);"
+
+#define SQL_CREATE_TABLE_SEARCH_FTS5 \
+        "CREATE VIRTUAL TABLE IF NOT EXISTS search USING fts5 (" \
+                "name UNINDEXED, " \
+                "key, " \
+                "tokenize = 'trigram case_sensitive 1');"
+
+/* Fills the search table once every game is written. */
+#define SQL_INSERT_SEARCH \
+        "DELETE FROM search; " \
+        "INSERT INTO search (name, key) " \
+                "SELECT game.name, searchkey (bios.description, " \
+                "game.category, game.description, game.manufacturer) " \
+                "FROM game LEFT JOIN game AS bios " \
+                "ON game.romof = bios.name AND bios.isbios = 'yes';"
+
+#define SQL_CREATE_TABLES \
+        SQL_CREATE_TABLE_MAME \
+        SQL_CREATE_TABLE_GAME \
+        SQL_CREATE_TABLE_ADJUSTER \
+        SQL_CREATE_TABLE_BIOSSET \
+        SQL_CREATE_TABLE_ROM \
+        SQL_CREATE_TABLE_DISK \
+        SQL_CREATE_TABLE_SAMPLE \
+        SQL_CREATE_TABLE_CHIP \
+        SQL_CREATE_TABLE_CONFSETTING \
+        SQL_CREATE_TABLE_DISPLAY \
+        SQL_CREATE_TABLE_CONTROL \
+        SQL_CREATE_TABLE_DIPVALUE \
+        SQL_CREATE_TABLE_GAMEHASH \
+        SQL_CREATE_TABLE_UNAUDITED \
+        SQL_CREATE_TABLE_AUDIT_DETAIL \
+        SQL_CREATE_TABLE_DETAIL \
+        SQL_CREATE_TABLE_LASTPLAYED \
+        SQL_CREATE_TABLE_PLAYBACK \
+        SQL_CREATE_TABLE_WINDOW \
+        SQL_CREATE_TABLE_EMULATOR \
+        SQL_CREATE_TABLE_MANIFEST \
+        SQL_CREATE_VIEW_AVAILABLE
+
+/* Indexes are created after the bulk load, which is much faster than
+ * updating them with every insert.  Dropping a table drops its indexes. */
+#define SQL_CREATE_INDEXES \
+        "CREATE INDEX IF NOT EXISTS game_cloneof ON game (cloneof); " \
+        "CREATE INDEX IF NOT EXISTS game_romof ON game (romof); " \
+        "CREATE INDEX IF NOT EXISTS biosset_game ON biosset (game); " \
+        "CREATE INDEX IF NOT EXISTS rom_game ON rom (game); " \
+        "CREATE INDEX IF NOT EXISTS disk_game ON disk (game); " \
+        "CREATE INDEX IF NOT EXISTS sample_game ON sample (game); " \
+        "CREATE INDEX IF NOT EXISTS chip_game ON chip (game, type); " \
+        "CREATE INDEX IF NOT EXISTS display_game ON display (game); " \
+        "CREATE INDEX IF NOT EXISTS control_game ON control (game); " \
+        "CREATE INDEX IF NOT EXISTS dipvalue_game ON dipvalue (game); " \
+        "CREATE INDEX IF NOT EXISTS confsetting_game " \
+                "ON confsetting (game); " \
+        "CREATE INDEX IF NOT EXISTS adjuster_game ON adjuster (game);"
+
 #define SQL_DROP_TABLES \
         "DROP TABLE IF EXISTS mame; " \
         "DROP TABLE IF EXISTS game; " \
@@ -264,8 +426,49 @@
         "DROP TABLE IF EXISTS dipvalue; " \
         "DROP TABLE IF EXISTS confsetting; " \
         "DROP TABLE IF EXISTS adjuster; " \
+        "DROP TABLE IF EXISTS gamehash; " \
+        "DROP TABLE IF EXISTS unaudited; " \
+        "DROP TABLE IF EXISTS audit_detail; " \
+        "DROP TABLE IF EXISTS detail; " \
+        "DROP TABLE IF EXISTS search; " \
         "DROP VIEW IF EXISTS available"
 
+/* The shadow database is private to the writer thread and is discarded
+ * if the build fails, so trade durability for speed.  The "main" prefix
+ * keeps these from applying to the live database when it's attached. */
+#define SQL_SHADOW_PRAGMAS \
+        "PRAGMA main.page_size=8192; " \
+        "PRAGMA main.cache_size=16384; " \
+        "PRAGMA main.journal_mode=OFF; " \
+        "PRAGMA main.synchronous=OFF; " \
+        "PRAGMA main.locking_mode=EXCLUSIVE;"
+
+#define SQL_COPY_SURVIVING_TABLES \
+        "BEGIN TRANSACTION; " \
+        "DELETE FROM shadow.lastplayed; " \
+        "INSERT INTO shadow.lastplayed SELECT * FROM main.lastplayed; " \
+        "DELETE FROM shadow.playback; " \
+        "INSERT INTO shadow.playback SELECT * FROM main.playback; " \
+        "DELETE FROM shadow.window; " \
+        "INSERT INTO shadow.window SELECT * FROM main.window; " \
+        "DELETE FROM shadow.emulator; " \
+        "INSERT INTO shadow.emulator SELECT * FROM main.emulator; " \
+        "DELETE FROM shadow.manifest; " \
+        "INSERT INTO shadow.manifest SELECT * FROM main.manifest; " \
+        "COMMIT TRANSACTION;"
+
+#define SQL_INSERT_GAMEHASH \
+        "INSERT INTO gamehash VALUES (@name, @hash);"
+
+#define SQL_INSERT_UNAUDITED \
+        "INSERT INTO unaudited VALUES (@name);"
+
+#define SQL_SELECT_GAMEHASH \
+        "SELECT name, hash FROM gamehash"
+
+#define SQL_INSERT_MAME \
+        "INSERT INTO mame (build) VALUES (@build);"
+
 #define SQL_INSERT_GAME \
         "INSERT INTO game VALUES (" \
                 "@name, " \
@@ -281,8 +484,10 @@
                 "@sampleof, " \
                 "@sampleset, " \
                 "@description, " \
+                "@description_key, " \
                 "@year, " \
                 "@manufacturer, " \
+                "@manufacturer_key, " \
                 "@sound_channels, " \
                 "@input_service, " \
                 "@input_tilt, " \
@@ -399,24 +604,152 @@
                 "@name, " \
                 "@default_);"
 
+typedef enum
+{
+        DB_TABLE_MAME,
+        DB_TABLE_GAMEHASH,
+        DB_TABLE_GAME,
+        DB_TABLE_BIOSSET,
+        DB_TABLE_ROM,
+        DB_TABLE_DISK,
+        DB_TABLE_SAMPLE,
+        DB_TABLE_CHIP,
+        DB_TABLE_DISPLAY,
+        DB_TABLE_CONTROL,
+        DB_TABLE_DIPVALUE,
+        DB_TABLE_CONFSETTING,
+        DB_TABLE_ADJUSTER,
+        DB_NUM_TABLES
+} DbTable;
+
+/* Indexed by DbTable */
+static const gchar *db_insert_sql[DB_NUM_TABLES] =
+{
+        SQL_INSERT_MAME,
+        SQL_INSERT_GAMEHASH,
+        SQL_INSERT_GAME,
+        SQL_INSERT_BIOSSET,
+        SQL_INSERT_ROM,
+        SQL_INSERT_DISK,
+        SQL_INSERT_SAMPLE,
+        SQL_INSERT_CHIP,
+        SQL_INSERT_DISPLAY,
+        SQL_INSERT_CONTROL,
+        SQL_INSERT_DIPVALUE,
+        SQL_INSERT_CONFSETTING,
+        SQL_INSERT_ADJUSTER
+};
+
+/* Tables that builds leave empty, since parsing them for every game
+ * takes too long.  gva_db_load_details() fills them in for one game.
+ * Builds fill in the rom and disk tables only for native audits (see
+ * gva-verify.c), and nothing else reads them. */
+static const DbTable db_detail_tables[] =
+{
+        DB_TABLE_BIOSSET,
+        DB_TABLE_SAMPLE,
+        DB_TABLE_CONTROL,
+        DB_TABLE_DIPVALUE,
+        DB_TABLE_CONFSETTING,
+        DB_TABLE_ADJUSTER
+};
+
+/* Indexed by DbTable, with the column naming the game each row
+ * belongs to.  Used to delete games during an incremental build. */
+static const struct
+{
+        const gchar *name;
+        const gchar *game_column;
+}
+db_tables[DB_NUM_TABLES] =
+{
+        { "mame",        NULL },
+        { "gamehash",    "name" },
+        { "game",        "name" },
+        { "biosset",     "game" },
+        { "rom",         "game" },
+        { "disk",        "game" },
+        { "sample",      "game" },
+        { "chip",        "game" },
+        { "display",     "game" },
+        { "control",     "game" },
+        { "dipvalue",    "game" },
+        { "confsetting", "game" },
+        { "adjuster",    "game" }
+};
+
+typedef struct _DbBatch DbBatch;
+typedef struct _DbPending DbPending;
+typedef struct _DbQueue DbQueue;
+typedef struct _DbRow DbRow;
+typedef struct _DbSelect DbSelect;
+typedef struct _DbValue DbValue;
 typedef struct _ParserData ParserData;
 
+/* A parameter binding.  Parameter names are static strings and text
+ * values live in the batch's string chunk.  A NULL text value denotes
+ * an integer.  The slot is the parameter's index in the table's insert
+ * statement, resolved by the parser thread. */
+struct _DbValue
+{
+        const gchar *param;
+        const gchar *text;
+        gint number;
+        gint slot;
+};
+
+/* A row to insert, as a range of values in the batch. */
+struct _DbRow
+{
+        DbTable table;
+        guint first;
+        guint length;
+};
+
+/* A unit of work passed from the parser thread to the writer thread. */
+struct _DbBatch
+{
+        GArray *rows;
+        GArray *values;
+        GStringChunk *strings;
+        guint n_games;
+};
+
+/* A row under construction.  A <game> row is assembled across several
+ * elements, with rows for child elements completed in between. */
+struct _DbPending
+{
+        DbTable table;
+        GArray *values;
+};
+
+/* A simple blocking queue.  NULL items are allowed and are used to
+ * signal the end of the stream. */
+struct _DbQueue
+{
+        GQueue queue;
+        GMutex *mutex;
+        GCond *cond;
+        guint max_length;  /* zero means unbounded */
+};
+
 struct _ParserData
 {
-        GMarkupParseContext *context;
+        volatile gint ref_count;
         GvaProcess *process;
 
-        sqlite3_stmt *insert_game_stmt;
-        sqlite3_stmt *insert_biosset_stmt;
-        sqlite3_stmt *insert_rom_stmt;
-        sqlite3_stmt *insert_disk_stmt;
-        sqlite3_stmt *insert_sample_stmt;
-        sqlite3_stmt *insert_chip_stmt;
-        sqlite3_stmt *insert_display_stmt;
-        sqlite3_stmt *insert_control_stmt;
-        sqlite3_stmt *insert_dipvalue_stmt;
-        sqlite3_stmt *insert_confsetting_stmt;
-        sqlite3_stmt *insert_adjuster_stmt;
+        /* Used only by the parser thread */
+        GString *scan_carry;
+        GString *scan_text;
+        guint skip_depth;
+        DbPending game_row;
+        DbPending element_row;
+        DbBatch *batch;
+        guint hash_row;
+        guint64 hash;
+        GOutputStream *cache_stream;
+        GFileOutputStream *cache_file_stream;
+        gchar *cache_key;
 
         const gchar *element_stack[MAX_ELEMENT_DEPTH];
         guint element_stack_depth;
@@ -425,6 +758,81 @@ struct _ParserData
         gchar *game;
         gchar *mask;
         gchar *tag;
+
+        /* Used only by the writer thread */
+        sqlite3 *connection;
+        sqlite3_stmt *insert_stmt[DB_NUM_TABLES];
+        sqlite3_stmt *delete_stmt[DB_NUM_TABLES];
+        sqlite3_stmt *unaudited_stmt;
+        GHashTable *old_hashes;
+        gboolean skip_game;
+
+        /* Set before the threads start */
+        GHashTable *slots[DB_NUM_TABLES];
+        gboolean incremental;
+        gboolean store_sets;  /* fill in the rom and disk tables */
+        gchar *details;  /* game whose details we're loading */
+        gboolean replay;
+        GInputStream *replay_stream;  /* read by the parser thread */
+        GCancellable *cancellable;
+        GvaDbProgressFunc progress_callback;
+        gpointer progress_data;
+        GSimpleAsyncResult *simple;
+
+        /* Set before the end of the stream */
+        gint exit_status;
+
+        /* Written by the writer thread, read after joining */
+        guint games_added;
+        guint games_changed;
+        guint games_removed;
+
+        /* Used only by the main thread */
+        guint progress_source_id;
+        gulong cancelled_id;
+        gboolean finished;
+        GTimer *timer;
+        GError *error;  /* the first error, once reported */
+
+        GThread *parser_thread;
+        GThread *writer_thread;
+        GError *parser_error;  /* read after joining */
+        GError *writer_error;  /* read after joining */
+
+        DbQueue *chunk_queue;  /* main thread -> parser thread */
+        DbQueue *batch_queue;  /* parser thread -> writer thread */
+        volatile gint games_written;
+        volatile gint stalled;
+        volatile gint failed;
+
+        /* Throughput statistics */
+        guint64 bytes_parsed;
+};
+
+/* A query running on its own connection in a background thread. */
+struct _DbSelect
+{
+        volatile gint ref_count;
+        gchar *sql;
+
+        /* Favorites as of the start of the query, since the
+         * main thread may change the list while it runs. */
+        GHashTable *favorites;
+
+        GvaDbNamesFunc names_callback;
+        gpointer names_data;
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+
+        /* Open while the query thread runs */
+        sqlite3 *connection;
+
+        /* Batches of names waiting for the main thread */
+        GMutex *mutex;
+        GQueue batches;
+        gboolean idle_pending;
+        gboolean finished;
+        GError *error;
 };
 
 /* Canonical names of XML elements and attributes */
@@ -516,65 +924,484 @@ static struct
 
 } intern;
 
+typedef struct _DbName DbName;
+
+struct _DbName
+{
+        const gchar *name;
+        const gchar **canonical;
+};
+
+/* A perfect hash of the canonical names, in the style of gperf.  The
+ * name's length plus the associated values of its first, third and last
+ * characters gives each name a slot of its own.  The values came from
+ * a random search, so adding a name means searching again. */
+
+#define DB_NAME_MIN_LENGTH 3
+#define DB_NAME_MAX_LENGTH 13
+
+static const guint8 db_name_asso[256] =
+{
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,  26,   0,   0,   0, 162,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0, 180,  67,  54, 168,  43,  54, 234,  54, 253,  95,  69, 114, 198, 171,  62,
+        167,   0,   2,  70,  57, 169, 131, 195,  50, 246,  15,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0
+};
+
+static const DbName db_names[256] =
+{
+        [  3] = { "romof", &intern.romof },
+        [  9] = { "vbstart", &intern.vbstart },
+        [ 13] = { "md5", &intern.md5 },
+        [ 14] = { "hbend", &intern.hbend },
+        [ 15] = { "type", &intern.type },
+        [ 16] = { "tag", &intern.tag },
+        [ 24] = { "sha1", &intern.sha1 },
+        [ 29] = { "adjuster", &intern.adjuster },
+        [ 30] = { "default", &intern.default_ },
+        [ 32] = { "dispose", &intern.dispose },
+        [ 36] = { "sourcefile", &intern.sourcefile },
+        [ 37] = { "value", &intern.value },
+        [ 38] = { "pixclock", &intern.pixclock },
+        [ 46] = { "machine", &intern.machine },
+        [ 47] = { "complete", &intern.complete },
+        [ 55] = { "disk", &intern.disk },
+        [ 56] = { "channels", &intern.channels },
+        [ 57] = { "vtotal", &intern.vtotal },
+        [ 61] = { "sample", &intern.sample },
+        [ 62] = { "minimum", &intern.minimum },
+        [ 65] = { "ismechanical", &intern.ismechanical },
+        [ 70] = { "status", &intern.status },
+        [ 74] = { "sampleof", &intern.sampleof },
+        [ 79] = { "palettesize", &intern.palettesize },
+        [ 85] = { "mask", &intern.mask },
+        [ 88] = { "aspecty", &intern.aspecty },
+        [ 90] = { "control", &intern.control },
+        [ 91] = { "vbend", &intern.vbend },
+        [106] = { "flipx", &intern.flipx },
+        [108] = { "rotate", &intern.rotate },
+        [114] = { "height", &intern.height },
+        [117] = { "refresh", &intern.refresh },
+        [122] = { "service", &intern.service },
+        [126] = { "coins", &intern.coins },
+        [127] = { "manufacturer", &intern.manufacturer },
+        [130] = { "dipvalue", &intern.dipvalue },
+        [132] = { "size", &intern.size },
+        [136] = { "emulation", &intern.emulation },
+        [140] = { "isbios", &intern.isbios },
+        [142] = { "dipswitch", &intern.dipswitch },
+        [145] = { "rom", &intern.rom },
+        [148] = { "aspectx", &intern.aspectx },
+        [153] = { "configuration", &intern.configuration },
+        [154] = { "protection", &intern.protection },
+        [156] = { "sound", &intern.sound },
+        [157] = { "region", &intern.region },
+        [160] = { "name", &intern.name },
+        [164] = { "description", &intern.description },
+        [165] = { "crc", &intern.crc },
+        [166] = { "width", &intern.width },
+        [168] = { "players", &intern.players },
+        [173] = { "driver", &intern.driver },
+        [175] = { "color", &intern.color },
+        [176] = { "year", &intern.year },
+        [177] = { "cloneof", &intern.cloneof },
+        [179] = { "offset", &intern.offset },
+        [183] = { "reverse", &intern.reverse },
+        [187] = { "mame", &intern.mame },
+        [188] = { "hbstart", &intern.hbstart },
+        [190] = { "clock", &intern.clock },
+        [193] = { "biosset", &intern.biosset },
+        [197] = { "maximum", &intern.maximum },
+        [201] = { "buttons", &intern.buttons },
+        [203] = { "bios", &intern.bios },
+        [214] = { "confsetting", &intern.confsetting },
+        [216] = { "isdevice", &intern.isdevice },
+        [219] = { "graphic", &intern.graphic },
+        [220] = { "index", &intern.index_ },
+        [222] = { "chip", &intern.chip },
+        [223] = { "game", &intern.game },
+        [224] = { "runnable", &intern.runnable },
+        [226] = { "input", &intern.input },
+        [230] = { "cocktail", &intern.cocktail },
+        [232] = { "tilt", &intern.tilt },
+        [235] = { "display", &intern.display },
+        [236] = { "htotal", &intern.htotal },
+        [237] = { "build", &intern.build },
+        [241] = { "orientation", &intern.orientation },
+        [242] = { "sensitivity", &intern.sensitivity },
+        [247] = { "keydelta", &intern.keydelta },
+        [248] = { "merge", &intern.merge },
+        [249] = { "screen", &intern.screen },
+        [253] = { "savestate", &intern.savestate }
+};
+
+/* Maps a name from MAME's XML to its canonical form without touching
+ * GLib's string table, which is guarded by a global lock.  Returns NULL
+ * for names we don't know. */
+static const gchar *
+db_lookup_name (const gchar *name)
+{
+        const DbName *entry;
+        gsize length;
+        guint key;
+
+        length = strlen (name);
+        if (length < DB_NAME_MIN_LENGTH || length > DB_NAME_MAX_LENGTH)
+                return NULL;
+
+        key = length +
+                db_name_asso[(guchar) name[0]] +
+                db_name_asso[(guchar) name[2]] +
+                db_name_asso[(guchar) name[length - 1]];
+        entry = &db_names[key % G_N_ELEMENTS (db_names)];
+
+        if (entry->name == NULL || strcmp (entry->name, name) != 0)
+                return NULL;
+
+        return *entry->canonical;
+}
+
 static sqlite3 *db = NULL;
 
+static DbQueue *
+db_queue_new (guint max_length)
+{
+        DbQueue *queue;
+
+        queue = g_slice_new0 (DbQueue);
+        g_queue_init (&queue->queue);
+        queue->mutex = g_mutex_new ();
+        queue->cond = g_cond_new ();
+        queue->max_length = max_length;
+
+        return queue;
+}
+
 static void
-db_parser_bind_int (sqlite3_stmt *stmt,
-                    const gchar *param,
-                    gint value)
+db_queue_free (DbQueue *queue)
 {
-        gint index;
-        gint errcode;
-        GError *error = NULL;
+        /* The queue should have been drained. */
+        g_warn_if_fail (g_queue_is_empty (&queue->queue));
 
-        index = sqlite3_bind_parameter_index (stmt, param);
-        errcode = sqlite3_bind_int (stmt, index, value);
+        g_mutex_free (queue->mutex);
+        g_cond_free (queue->cond);
 
-        if (errcode != SQLITE_OK)
-        {
-                gva_db_set_error (&error, 0, NULL);
-                gva_error_handle (&error);
-        }
+        g_slice_free (DbQueue, queue);
 }
 
 static void
-db_parser_bind_text (sqlite3_stmt *stmt,
-                     const gchar *param,
-                     const gchar *value)
+db_queue_push (DbQueue *queue,
+               gpointer item)
 {
-        gint index;
-        gint errcode;
-        gchar *utf8;
-        GError *error = NULL;
+        g_mutex_lock (queue->mutex);
 
-        index = sqlite3_bind_parameter_index (stmt, param);
-        utf8 = g_locale_to_utf8 (value, -1, NULL, NULL, &error);
-        gva_error_handle (&error);
+        while (queue->max_length > 0 &&
+               queue->queue.length >= queue->max_length)
+                g_cond_wait (queue->cond, queue->mutex);
 
-        g_return_if_fail (utf8 != NULL);
-        errcode = sqlite3_bind_text (stmt, index, utf8, -1, g_free);
+        g_queue_push_tail (&queue->queue, item);
+        g_cond_broadcast (queue->cond);
 
-        if (errcode != SQLITE_OK)
+        g_mutex_unlock (queue->mutex);
+}
+
+static gpointer
+db_queue_pop (DbQueue *queue)
+{
+        gpointer item;
+
+        g_mutex_lock (queue->mutex);
+
+        while (g_queue_is_empty (&queue->queue))
+                g_cond_wait (queue->cond, queue->mutex);
+
+        item = g_queue_pop_head (&queue->queue);
+        g_cond_broadcast (queue->cond);
+
+        g_mutex_unlock (queue->mutex);
+
+        return item;
+}
+
+static guint
+db_queue_length (DbQueue *queue)
+{
+        guint length;
+
+        g_mutex_lock (queue->mutex);
+        length = queue->queue.length;
+        g_mutex_unlock (queue->mutex);
+
+        return length;
+}
+
+static DbBatch *
+db_batch_new (void)
+{
+        DbBatch *batch;
+
+        batch = g_slice_new0 (DbBatch);
+        batch->rows = g_array_new (FALSE, FALSE, sizeof (DbRow));
+        batch->values = g_array_new (FALSE, FALSE, sizeof (DbValue));
+        batch->strings = g_string_chunk_new (64 * 1024);
+
+        return batch;
+}
+
+static void
+db_batch_free (DbBatch *batch)
+{
+        g_array_free (batch->rows, TRUE);
+        g_array_free (batch->values, TRUE);
+        g_string_chunk_free (batch->strings);
+
+        g_slice_free (DbBatch, batch);
+}
+
+static guint64
+db_hash_bytes (guint64 hash,
+               const gchar *bytes,
+               gsize length)
+{
+        /* FNV-1a */
+        const guchar *cp = (const guchar *) bytes;
+        const guchar *end = cp + length;
+
+        while (cp < end)
         {
-                gva_db_set_error (&error, 0, NULL);
-                gva_error_handle (&error);
+                hash ^= *cp++;
+                hash *= G_GUINT64_CONSTANT (0x100000001b3);
         }
+
+        return hash;
 }
 
-static gboolean
-db_parser_exec_stmt (sqlite3_stmt *stmt,
-                     GError **error)
+static guint64
+db_hash_string (guint64 hash,
+                const gchar *string)
 {
-        if (sqlite3_step (stmt) != SQLITE_DONE)
+        /* Include the terminating nul byte. */
+        return db_hash_bytes (hash, string, strlen (string) + 1);
+}
+
+static guint64
+db_hash_values (guint64 hash,
+                const DbValue *values,
+                guint n_values)
+{
+        guint ii;
+
+        for (ii = 0; ii < n_values; ii++)
         {
-                gva_db_set_error (error, 0, NULL);
-                return FALSE;
+                hash = db_hash_string (hash, values[ii].param);
+
+                if (values[ii].text != NULL)
+                        hash = db_hash_string (hash, values[ii].text);
+                else
+                {
+                        gchar buffer[16];
+
+                        g_snprintf (
+                                buffer, sizeof (buffer),
+                                "%d", values[ii].number);
+                        hash = db_hash_string (hash, buffer);
+                }
+        }
+
+        return hash;
+}
+
+static DbPending *
+db_parser_row_begin (ParserData *data,
+                     DbTable table)
+{
+        DbPending *row;
+
+        if (table == DB_TABLE_GAME)
+                row = &data->game_row;
+        else
+                row = &data->element_row;
+
+        row->table = table;
+        g_array_set_size (row->values, 0);
+
+        return row;
+}
+
+static void
+db_parser_row_end (ParserData *data,
+                   DbPending *row)
+{
+        DbBatch *batch = data->batch;
+        DbRow new_row;
+
+        new_row.table = row->table;
+        new_row.first = batch->values->len;
+        new_row.length = row->values->len;
+
+        g_array_append_vals (
+                batch->values, row->values->data, row->values->len);
+        g_array_append_val (batch->rows, new_row);
+}
+
+/* Maps each parameter name in an insert statement to its index, so
+ * binding a value needs no lookups by SQLite.  SQLite numbers named
+ * parameters in order of first appearance. */
+static GHashTable *
+db_parser_slots_new (const gchar *sql)
+{
+        GHashTable *slots;
+        const gchar *cp;
+        gint slot = 0;
+
+        slots = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        for (cp = strchr (sql, '@'); cp != NULL; cp = strchr (cp + 1, '@'))
+        {
+                gchar *param;
+                gsize length;
+
+                length = 1 + strspn (
+                        cp + 1, "abcdefghijklmnopqrstuvwxyz_0123456789");
+                param = g_strndup (cp, length);
+
+                if (g_hash_table_lookup (slots, param) == NULL)
+                        g_hash_table_insert (
+                                slots, param, GINT_TO_POINTER (++slot));
+                else
+                        g_free (param);
         }
 
-        ASSERT_OK (sqlite3_reset (stmt));
-        ASSERT_OK (sqlite3_clear_bindings (stmt));
+        return slots;
+}
+
+/* Returns zero for unknown parameters, which SQLite rejects. */
+static gint
+db_parser_lookup_slot (ParserData *data,
+                       DbTable table,
+                       const gchar *param)
+{
+        return GPOINTER_TO_INT (
+                g_hash_table_lookup (data->slots[table], param));
+}
 
-        return TRUE;
+static void
+db_parser_bind_int (ParserData *data,
+                    DbPending *row,
+                    const gchar *param,
+                    gint value)
+{
+        DbValue new_value;
+
+        new_value.param = param;
+        new_value.text = NULL;
+        new_value.number = value;
+        new_value.slot = db_parser_lookup_slot (data, row->table, param);
+
+        g_array_append_val (row->values, new_value);
+}
+
+static void
+db_parser_bind_text (ParserData *data,
+                     DbPending *row,
+                     const gchar *param,
+                     const gchar *value)
+{
+        DbValue new_value;
+
+        g_return_if_fail (value != NULL);
+
+        /* Later bindings of the same parameter take precedence,
+         * which is how default values get overridden. */
+        new_value.param = param;
+        new_value.text = g_string_chunk_insert (data->batch->strings, value);
+        new_value.number = 0;
+        new_value.slot = db_parser_lookup_slot (data, row->table, param);
+
+        g_array_append_val (row->values, new_value);
+}
+
+/* Binds the search collation key of @value (see gva_search_collate_key()),
+ * so interactive searches can match on stored keys. */
+static void
+db_parser_bind_key (ParserData *data,
+                    DbPending *row,
+                    const gchar *param,
+                    const gchar *value)
+{
+        gchar buffer[256];
+        gchar *key = buffer;
+        gsize length;
+
+        length = gva_search_collate_key_to_buffer (
+                value, buffer, sizeof (buffer));
+        if (length >= sizeof (buffer))
+                key = gva_search_collate_key (value);
+
+        db_parser_bind_text (data, row, param, key);
+
+        if (key != buffer)
+                g_free (key);
+}
+
+/* Fills in the gamehash row reserved when the game element started.
+ * The digest covers the game's XML data, including elements we do not
+ * store, plus values from other sources such as the category file. */
+static void
+db_parser_hash_game (ParserData *data)
+{
+        DbBatch *batch = data->batch;
+        DbValue values[2];
+        DbRow *row;
+        gchar buffer[17];
+        guint64 hash;
+
+        hash = db_hash_values (
+                data->hash, (DbValue *) data->game_row.values->data,
+                data->game_row.values->len);
+
+        g_snprintf (
+                buffer, sizeof (buffer),
+                "%016" G_GINT64_MODIFIER "x", hash);
+
+        values[0].param = "@name";
+        values[0].text = g_string_chunk_insert (
+                batch->strings, (data->game != NULL) ? data->game : "");
+        values[0].number = 0;
+        values[0].slot = db_parser_lookup_slot (
+                data, DB_TABLE_GAMEHASH, values[0].param);
+
+        values[1].param = "@hash";
+        values[1].text = g_string_chunk_insert (batch->strings, buffer);
+        values[1].number = 0;
+        values[1].slot = db_parser_lookup_slot (
+                data, DB_TABLE_GAMEHASH, values[1].param);
+
+        row = &g_array_index (batch->rows, DbRow, data->hash_row);
+        row->table = DB_TABLE_GAMEHASH;
+        row->first = batch->values->len;
+        row->length = G_N_ELEMENTS (values);
+
+        g_array_append_vals (batch->values, values, row->length);
+}
+
+static void
+db_parser_flush_batch (ParserData *data)
+{
+        db_queue_push (data->batch_queue, data->batch);
+        data->batch = db_batch_new ();
 }
 
 static void
@@ -583,10 +1410,10 @@ db_parser_start_element_adjuster (ParserData *data,
                                   const gchar **attribute_value,
                                   GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_adjuster_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_ADJUSTER);
         gint ii;
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -599,7 +1426,7 @@ db_parser_start_element_adjuster (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -609,13 +1436,13 @@ db_parser_start_element_biosset (ParserData *data,
                                  const gchar **attribute_value,
                                  GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_biosset_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_BIOSSET);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@default_", "no");
+        db_parser_bind_text (data, row, "@default_", "no");
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -630,7 +1457,7 @@ db_parser_start_element_biosset (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -640,10 +1467,10 @@ db_parser_start_element_chip (ParserData *data,
                               const gchar **attribute_value,
                               GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_chip_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_CHIP);
         gint ii;
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -658,7 +1485,7 @@ db_parser_start_element_chip (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -687,11 +1514,11 @@ db_parser_start_element_confsetting (ParserData *data,
                                      const gchar **attribute_value,
                                      GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_confsetting_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_CONFSETTING);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@default_", "no");
+        db_parser_bind_text (data, row, "@default_", "no");
 
         /* XXX Combining the <configuration> and <confsetting> elements
          *     into one table is biting us now since 0.136 added "tag"
@@ -699,10 +1526,10 @@ db_parser_start_element_confsetting (ParserData *data,
          *     have to duplicate those values in each "confsetting" row.
          *     We may need to redesign these tables if we ever actually
          *     use them. */
-        db_parser_bind_text (stmt, "@game", data->game);
-        db_parser_bind_text (stmt, "@tag", data->tag);
-        db_parser_bind_text (stmt, "@mask", data->mask);
-        db_parser_bind_text (stmt, "@configuration", data->configuration);
+        db_parser_bind_text (data, row, "@game", data->game);
+        db_parser_bind_text (data, row, "@tag", data->tag);
+        db_parser_bind_text (data, row, "@mask", data->mask);
+        db_parser_bind_text (data, row, "@configuration", data->configuration);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -717,7 +1544,7 @@ db_parser_start_element_confsetting (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -727,13 +1554,13 @@ db_parser_start_element_control (ParserData *data,
                                  const gchar **attribute_value,
                                  GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_control_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_CONTROL);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@reverse", "no");
+        db_parser_bind_text (data, row, "@reverse", "no");
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -754,7 +1581,7 @@ db_parser_start_element_control (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -783,11 +1610,11 @@ db_parser_start_element_dipvalue (ParserData *data,
                                   const gchar **attribute_value,
                                   GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_dipvalue_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_DIPVALUE);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@default_", "no");
+        db_parser_bind_text (data, row, "@default_", "no");
 
         /* XXX Combining the <dipswitch> and <dipvalue> elements into
          *     one table is biting us now since 0.136 added "tag" and
@@ -795,10 +1622,10 @@ db_parser_start_element_dipvalue (ParserData *data,
          *     to duplicate those values in each "dipvalue" row.  We
          *     may need to redesign these tables if we ever actually
          *     use them. */
-        db_parser_bind_text (stmt, "@game", data->game);
-        db_parser_bind_text (stmt, "@tag", data->tag);
-        db_parser_bind_text (stmt, "@mask", data->mask);
-        db_parser_bind_text (stmt, "@dipswitch", data->dipswitch);
+        db_parser_bind_text (data, row, "@game", data->game);
+        db_parser_bind_text (data, row, "@tag", data->tag);
+        db_parser_bind_text (data, row, "@mask", data->mask);
+        db_parser_bind_text (data, row, "@dipswitch", data->dipswitch);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -813,7 +1640,7 @@ db_parser_start_element_dipvalue (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -823,13 +1650,13 @@ db_parser_start_element_disk (ParserData *data,
                               const gchar **attribute_value,
                               GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_disk_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_DISK);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@status", "good");
+        db_parser_bind_text (data, row, "@status", "good");
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -852,7 +1679,7 @@ db_parser_start_element_disk (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -862,13 +1689,13 @@ db_parser_start_element_display (ParserData *data,
                                  const gchar **attribute_value,
                                  GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_display_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_DISPLAY);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@flipx", "no");
+        db_parser_bind_text (data, row, "@flipx", "no");
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -903,7 +1730,7 @@ db_parser_start_element_display (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -913,7 +1740,7 @@ db_parser_start_element_driver (ParserData *data,
                                 const gchar **attribute_value,
                                 GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_game_stmt;
+        DbPending *row = &data->game_row;
         gint ii;
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
@@ -941,7 +1768,7 @@ db_parser_start_element_driver (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -951,7 +1778,7 @@ db_parser_start_element_game (ParserData *data,
                               const gchar **attribute_value,
                               GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_game_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_GAME);
         gint ii;
 
 #ifdef CATEGORY_FILE
@@ -960,11 +1787,16 @@ db_parser_start_element_game (ParserData *data,
         GError *local_error = NULL;
 #endif
 
+        /* Reserve a row for the game's digest, so it precedes the
+         * rows for the game and its child elements in the batch. */
+        data->hash_row = data->batch->rows->len;
+        g_array_set_size (data->batch->rows, data->hash_row + 1);
+
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@isbios", "no");
-        db_parser_bind_text (stmt, "@isdevice", "no");
-        db_parser_bind_text (stmt, "@ismechanical", "no");
-        db_parser_bind_text (stmt, "@runnable", "yes");
+        db_parser_bind_text (data, row, "@isbios", "no");
+        db_parser_bind_text (data, row, "@isdevice", "no");
+        db_parser_bind_text (data, row, "@ismechanical", "no");
+        db_parser_bind_text (data, row, "@runnable", "yes");
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -994,7 +1826,7 @@ db_parser_start_element_game (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 
 #ifdef CATEGORY_FILE
@@ -1013,7 +1845,7 @@ db_parser_start_element_game (ParserData *data,
                 g_clear_error (&local_error);
 
         if (category != NULL)
-                db_parser_bind_text (stmt, "@category", category);
+                db_parser_bind_text (data, row, "@category", category);
         else if (local_error != NULL)
                 g_propagate_error (error, local_error);
 
@@ -1027,7 +1859,7 @@ db_parser_start_element_input (ParserData *data,
                                const gchar **attribute_value,
                                GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_game_stmt;
+        DbPending *row = &data->game_row;
         gint ii;
 
 #ifdef NPLAYERS_FILE
@@ -1038,8 +1870,8 @@ db_parser_start_element_input (ParserData *data,
 #endif
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@input_service", "no");
-        db_parser_bind_text (stmt, "@input_tilt", "no");
+        db_parser_bind_text (data, row, "@input_service", "no");
+        db_parser_bind_text (data, row, "@input_tilt", "no");
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -1058,7 +1890,7 @@ db_parser_start_element_input (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 
 #ifdef NPLAYERS_FILE
@@ -1078,14 +1910,14 @@ db_parser_start_element_input (ParserData *data,
         if (g_error_matches (local_error, G_KEY_FILE_ERROR, error_code))
                 g_clear_error (&local_error);
 
-        db_parser_bind_int (stmt, "@input_players_alt", max_alternating);
-        db_parser_bind_int (stmt, "@input_players_sim", max_simultaneous);
+        db_parser_bind_int (data, row, "@input_players_alt", max_alternating);
+        db_parser_bind_int (data, row, "@input_players_sim", max_simultaneous);
 
         /* Override "input_players" if we can, because nplayers.ini
          * seems to be more accurate than MAME's own XML data. */
         if (max_alternating > 0 || max_simultaneous > 0)
                 db_parser_bind_int (
-                        stmt, "@input_players",
+                        data, row, "@input_players",
                         MAX (max_alternating, max_simultaneous));
         else if (local_error != NULL)
                 g_propagate_error (error, local_error);
@@ -1107,12 +1939,11 @@ db_parser_start_element_mame (ParserData *data,
 
         if (build != NULL)
         {
-                char *sql;
+                DbPending *row;
 
-                sql = sqlite3_mprintf (
-                        "INSERT INTO mame (build) VALUES (%Q)", build);
-                gva_db_execute (sql, error);
-                sqlite3_free (sql);
+                row = db_parser_row_begin (data, DB_TABLE_MAME);
+                db_parser_bind_text (data, row, "@build", build);
+                db_parser_row_end (data, row);
         }
 }
 
@@ -1122,14 +1953,14 @@ db_parser_start_element_rom (ParserData *data,
                              const gchar **attribute_value,
                              GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_rom_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_ROM);
         gint ii;
 
         /* Bind default values. */
-        db_parser_bind_text (stmt, "@status", "good");
-        db_parser_bind_text (stmt, "@dispose", "no");
+        db_parser_bind_text (data, row, "@status", "good");
+        db_parser_bind_text (data, row, "@dispose", "no");
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -1160,7 +1991,7 @@ db_parser_start_element_rom (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -1170,10 +2001,10 @@ db_parser_start_element_sample (ParserData *data,
                                 const gchar **attribute_value,
                                 GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_sample_stmt;
+        DbPending *row = db_parser_row_begin (data, DB_TABLE_SAMPLE);
         gint ii;
 
-        db_parser_bind_text (stmt, "@game", data->game);
+        db_parser_bind_text (data, row, "@game", data->game);
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
         {
@@ -1184,7 +2015,7 @@ db_parser_start_element_sample (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
@@ -1194,7 +2025,7 @@ db_parser_start_element_sound (ParserData *data,
                                const gchar **attribute_value,
                                GError **error)
 {
-        sqlite3_stmt *stmt = data->insert_game_stmt;
+        DbPending *row = &data->game_row;
         gint ii;
 
         for (ii = 0; attribute_name[ii] != NULL; ii++)
@@ -1206,65 +2037,22 @@ db_parser_start_element_sound (ParserData *data,
                 else
                         continue;
 
-                db_parser_bind_text (stmt, param, attribute_value[ii]);
+                db_parser_bind_text (data, row, param, attribute_value[ii]);
         }
 }
 
+/* Called by the scanner with canonical element and attribute names,
+ * for the elements db_scanner_is_stored() accepts. */
 static void
-db_parser_start_element (GMarkupParseContext *context,
+db_parser_start_element (ParserData *data,
                          const gchar *element_name,
                          const gchar **attribute_name,
                          const gchar **attribute_value,
-                         gpointer user_data,
                          GError **error)
 {
-        ParserData *data = user_data;
-        const gchar **interned_name;
-        guint length, ii;
-
-        element_name = g_intern_string (element_name);
         g_assert (data->element_stack_depth < MAX_ELEMENT_DEPTH);
         data->element_stack[data->element_stack_depth++] = element_name;
 
-        /* Build an array of interned attribute names.
-         * Note: g_intern_string (NULL) returns NULL */
-        length = g_strv_length ((gchar **) attribute_name) + 1;
-        interned_name = g_newa (const gchar *, length);
-        for (ii = 0; ii < length; ii++)
-                interned_name[ii] = g_intern_string (attribute_name[ii]);
-        attribute_name = interned_name;
-
-        /* XXX Copied from below... */
-
-        if (element_name == intern.chip)
-                db_parser_start_element_chip (
-                        data, attribute_name, attribute_value, error);
-
-        else if (element_name == intern.display)
-                db_parser_start_element_display (
-                        data, attribute_name, attribute_value, error);
-
-        else if (element_name == intern.driver)
-                db_parser_start_element_driver (
-                        data, attribute_name, attribute_value, error);
-
-        /* XXX The <game> element was renamed to <machine> in 0.162. */
-        else if (element_name == intern.game ||
-                 element_name == intern.machine)
-                db_parser_start_element_game (
-                        data, attribute_name, attribute_value, error);
-
-        else if (element_name == intern.input)
-                db_parser_start_element_input (
-                        data, attribute_name, attribute_value, error);
-
-        else if (element_name == intern.mame)
-                db_parser_start_element_mame (
-                        data, attribute_name, attribute_value, error);
-
-        /* Skip unused elements to speed up parsing. */
-
-#if 0
         if (element_name == intern.adjuster)
                 db_parser_start_element_adjuster (
                         data, attribute_name, attribute_value, error);
@@ -1309,7 +2097,9 @@ db_parser_start_element (GMarkupParseContext *context,
                 db_parser_start_element_driver (
                         data, attribute_name, attribute_value, error);
 
-        else if (element_name == intern.game)
+        /* XXX The <game> element was renamed to <machine> in 0.162. */
+        else if (element_name == intern.game ||
+                 element_name == intern.machine)
                 db_parser_start_element_game (
                         data, attribute_name, attribute_value, error);
 
@@ -1332,7 +2122,6 @@ db_parser_start_element (GMarkupParseContext *context,
         else if (element_name == intern.sound)
                 db_parser_start_element_sound (
                         data, attribute_name, attribute_value, error);
-#endif
 }
 
 static void
@@ -1367,387 +2156,2195 @@ static void
 db_parser_end_element_game (ParserData *data,
                             GError **error)
 {
-        if (!db_parser_exec_stmt (data->insert_game_stmt, error))
-                return;
+        db_parser_hash_game (data);
+        db_parser_row_end (data, &data->game_row);
 
-        gva_process_inc_progress (data->process);
+        /* Details are written all at once, by the main thread. */
+        if (++data->batch->n_games >= GAMES_PER_BATCH &&
+            data->details == NULL)
+                db_parser_flush_batch (data);
 
         g_free (data->game);
         data->game = NULL;
 }
 
 static void
-db_parser_end_element (GMarkupParseContext *context,
-                       const gchar *element_name,
-                       gpointer user_data,
+db_parser_end_element (ParserData *data,
                        GError **error)
 {
-        ParserData *data = user_data;
+        const gchar *element_name;
 
         g_assert (data->element_stack_depth > 0);
         element_name = data->element_stack[--data->element_stack_depth];
 
-        /* XXX Copied from below... */
-
-        if (element_name == intern.chip)
-                db_parser_exec_stmt (data->insert_chip_stmt, error);
-
-        else if (element_name == intern.display)
-                db_parser_exec_stmt (data->insert_display_stmt, error);
-
-        /* XXX The <game> element was renamed to <machine> in 0.162. */
-        else if (element_name == intern.game ||
-                 element_name == intern.machine)
-                db_parser_end_element_game (data, error);
-
-        /* Skip unused elements to speed up parsing. */
-
-#if 0
         if (element_name == intern.adjuster)
-                db_parser_exec_stmt (data->insert_adjuster_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.biosset)
-                db_parser_exec_stmt (data->insert_biosset_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.chip)
-                db_parser_exec_stmt (data->insert_chip_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.configuration)
                 db_parser_end_element_configuration (data, error);
 
         else if (element_name == intern.confsetting)
-                db_parser_exec_stmt (data->insert_confsetting_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.control)
-                db_parser_exec_stmt (data->insert_control_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.dipswitch)
                 db_parser_end_element_dipswitch (data, error);
 
         else if (element_name == intern.dipvalue)
-                db_parser_exec_stmt (data->insert_dipvalue_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.disk)
-                db_parser_exec_stmt (data->insert_disk_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.display)
-                db_parser_exec_stmt (data->insert_display_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
-        else if (element_name == intern.game)
+        /* XXX The <game> element was renamed to <machine> in 0.162. */
+        else if (element_name == intern.game ||
+                 element_name == intern.machine)
                 db_parser_end_element_game (data, error);
 
         else if (element_name == intern.rom)
-                db_parser_exec_stmt (data->insert_rom_stmt, error);
+                db_parser_row_end (data, &data->element_row);
 
         else if (element_name == intern.sample)
-                db_parser_exec_stmt (data->insert_sample_stmt, error);
-#endif
+                db_parser_row_end (data, &data->element_row);
 }
 
 static void
-db_parser_text (GMarkupParseContext *context,
+db_parser_text (ParserData *data,
                 const gchar *text,
-                gsize text_len,
-                gpointer user_data,
                 GError **error)
 {
-        ParserData *data = user_data;
-        sqlite3_stmt *stmt = data->insert_game_stmt;
+        DbPending *row = &data->game_row;
         const gchar *element_name;
 
         g_assert (data->element_stack_depth > 0);
         element_name = data->element_stack[data->element_stack_depth - 1];
 
         if (element_name == intern.description)
-                db_parser_bind_text (stmt, "@description", text);
+        {
+                db_parser_bind_text (data, row, "@description", text);
+                db_parser_bind_key (data, row, "@description_key", text);
+        }
 
         else if (element_name == intern.manufacturer)
-                db_parser_bind_text (stmt, "@manufacturer", text);
+        {
+                db_parser_bind_text (data, row, "@manufacturer", text);
+                db_parser_bind_key (data, row, "@manufacturer_key", text);
+        }
 
         else if (element_name == intern.year)
-                db_parser_bind_text (stmt, "@year", text);
+                db_parser_bind_text (data, row, "@year", text);
 }
 
-static GMarkupParser parser =
-{
-        db_parser_start_element,
-        db_parser_end_element,
-        db_parser_text,
-        NULL,
-        NULL
-};
+/* MAME's -listxml output runs to hundreds of megabytes, most of it
+ * elements we don't store, like <rom> and <dipswitch>.  Rather than
+ * tokenizing all of it with GMarkup, scan for the tags with memchr(),
+ * skip whole subtrees we don't store, and only pick apart attributes of
+ * elements we do store.  Those are unescaped and NUL-terminated in
+ * place, so the scanner needs no allocations.
+ *
+ * This is not a general XML parser.  It expects double-quoted attribute
+ * values and well-formed output, as MAME writes it. */
 
-static ParserData *
-db_parser_data_new (GvaProcess *process)
+#define MAX_ATTRIBUTES 32
+
+static gboolean
+db_scanner_is_stored (ParserData *data,
+                      const gchar *element_name)
 {
-        ParserData *data;
-        GError *error = NULL;
+        /* Keep this in sync with db_parser_start_element(). */
+        if (element_name == NULL)
+                return FALSE;
 
-        data = g_slice_new0 (ParserData);
-        data->context = g_markup_parse_context_new (&parser, 0, data, NULL);
-        data->process = g_object_ref (process);
+        if (data->details != NULL && (
+                (element_name == intern.adjuster)
+                || (element_name == intern.biosset)
+                || (element_name == intern.configuration)
+                || (element_name == intern.confsetting)
+                || (element_name == intern.control)
+                || (element_name == intern.dipswitch)
+                || (element_name == intern.dipvalue)
+                || (element_name == intern.sample)))
+                return TRUE;
+
+        if (data->store_sets && (
+                (element_name == intern.disk)
+                || (element_name == intern.rom)))
+                return TRUE;
+
+        return (element_name == intern.chip)
+                || (element_name == intern.description)
+                || (element_name == intern.display)
+                || (element_name == intern.driver)
+                || (element_name == intern.game)
+                || (element_name == intern.input)
+                || (element_name == intern.machine)
+                || (element_name == intern.mame)
+                || (element_name == intern.manufacturer)
+                || (element_name == intern.sound)
+                || (element_name == intern.year);
+}
 
-        if (!gva_db_prepare (SQL_INSERT_GAME, &data->insert_game_stmt, &error))
-                g_error ("%s", error->message);
+static gboolean
+db_scanner_wants_text (ParserData *data)
+{
+        const gchar *element_name;
+
+        /* Keep this in sync with db_parser_text(). */
+        if (data->skip_depth > 0 || data->element_stack_depth == 0)
+                return FALSE;
+
+        element_name = data->element_stack[data->element_stack_depth - 1];
+
+        return (element_name == intern.description)
+                || (element_name == intern.manufacturer)
+                || (element_name == intern.year);
+}
+
+static void
+db_scanner_set_error (GError **error,
+                      const gchar *message)
+{
+        g_set_error (
+                error, G_MARKUP_ERROR, G_MARKUP_ERROR_PARSE,
+                _("Failed to parse MAME output: %s"), message);
+}
+
+static gboolean
+db_scanner_is_space (gchar c)
+{
+        return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+}
+
+/* Replaces entity references in the string from @start to @end, and
+ * NUL-terminates the result.  The result is never longer. */
+static void
+db_scanner_unescape (gchar *start,
+                     gchar *end)
+{
+        gchar *in, *out;
+
+        in = out = memchr (start, '&', end - start);
+
+        if (in == NULL)
+        {
+                *end = '\0';
+                return;
+        }
+
+        while (in < end)
+        {
+                gchar *semicolon;
+                gsize length;
+
+                if (*in != '&')
+                {
+                        *out++ = *in++;
+                        continue;
+                }
+
+                semicolon = memchr (in, ';', end - in);
+                if (semicolon == NULL)
+                {
+                        *out++ = *in++;
+                        continue;
+                }
+
+                length = semicolon - in - 1;
+
+                if (length == 3 && strncmp (in + 1, "amp", 3) == 0)
+                        *out++ = '&';
+                else if (length == 2 && strncmp (in + 1, "lt", 2) == 0)
+                        *out++ = '<';
+                else if (length == 2 && strncmp (in + 1, "gt", 2) == 0)
+                        *out++ = '>';
+                else if (length == 4 && strncmp (in + 1, "quot", 4) == 0)
+                        *out++ = '"';
+                else if (length == 4 && strncmp (in + 1, "apos", 4) == 0)
+                        *out++ = '\'';
+                else if (length > 1 && in[1] == '#')
+                {
+                        gunichar c;
+
+                        if (in[2] == 'x')
+                                c = strtoul (in + 3, NULL, 16);
+                        else
+                                c = strtoul (in + 2, NULL, 10);
+
+                        /* "&#N;" is never shorter than its UTF-8. */
+                        if (g_unichar_validate (c) && c != 0)
+                                out += g_unichar_to_utf8 (c, out);
+                }
+                else
+                {
+                        /* Leave unknown references alone. */
+                        memmove (out, in, length + 2);
+                        out += length + 2;
+                }
+
+                in = semicolon + 1;
+        }
+
+        *out = '\0';
+}
+
+/* Picks apart the attributes of a stored element's start tag, from the
+ * end of the element name to the end of the tag. */
+static gboolean
+db_scanner_attributes (gchar *cp,
+                       gchar *end,
+                       const gchar **attribute_name,
+                       const gchar **attribute_value,
+                       GError **error)
+{
+        guint n_attributes = 0;
+
+        while (TRUE)
+        {
+                gchar *name, *value;
+                const gchar *canonical;
+
+                while (cp < end && db_scanner_is_space (*cp))
+                        cp++;
+
+                if (cp >= end || *cp == '/' || *cp == '>')
+                        break;
+
+                name = cp;
+                while (cp < end && *cp != '=' && !db_scanner_is_space (*cp))
+                        cp++;
+                if (cp >= end)
+                        goto fail;
+                *cp++ = '\0';
+
+                while (cp < end && *cp != '"')
+                        cp++;
+                if (cp >= end)
+                        goto fail;
+
+                value = ++cp;
+                cp = memchr (cp, '"', end - cp);
+                if (cp == NULL)
+                        goto fail;
+                db_scanner_unescape (value, cp++);
+
+                if (n_attributes == MAX_ATTRIBUTES)
+                        continue;
+
+                /* Unknown names are kept as is, since
+                 * they must not terminate the array. */
+                canonical = db_lookup_name (name);
+                attribute_name[n_attributes] =
+                        (canonical != NULL) ? canonical : name;
+                attribute_value[n_attributes] = value;
+                n_attributes++;
+        }
+
+        attribute_name[n_attributes] = NULL;
+        attribute_value[n_attributes] = NULL;
+
+        return TRUE;
+
+fail:
+        db_scanner_set_error (error, _("malformed attribute"));
+
+        return FALSE;
+}
+
+/* Handles a tag from '<' through '>', inclusive. */
+static gboolean
+db_scanner_tag (ParserData *data,
+                gchar *tag,
+                gsize length,
+                GError **error)
+{
+        const gchar *attribute_name[MAX_ATTRIBUTES + 1];
+        const gchar *attribute_value[MAX_ATTRIBUTES + 1];
+        const gchar *element_name;
+        gboolean closing;
+        gboolean self_closing;
+        gchar *name, *cp;
+        gchar *end = tag + length - 1;
+
+        closing = (tag[1] == '/');
+        self_closing = (!closing && end[-1] == '/');
+
+        /* Inside a subtree we don't store, only nesting matters. */
+        if (data->skip_depth > 0)
+        {
+                if (closing)
+                        data->skip_depth--;
+                else if (!self_closing)
+                        data->skip_depth++;
+
+                data->hash = db_hash_bytes (data->hash, tag, length);
+
+                return TRUE;
+        }
+
+        name = cp = tag + (closing ? 2 : 1);
+        while (cp < end && *cp != '/' && !db_scanner_is_space (*cp))
+                cp++;
+
+        element_name = NULL;
+        if (cp - name <= DB_NAME_MAX_LENGTH)
+        {
+                gchar buffer[DB_NAME_MAX_LENGTH + 1];
+
+                memcpy (buffer, name, cp - name);
+                buffer[cp - name] = '\0';
+                element_name = db_lookup_name (buffer);
+        }
+
+        /* Each game's digest covers its raw XML, including elements
+         * we don't store, so that changes to things like ROM checksums
+         * mark the game as changed. */
+        if (!closing && (element_name == intern.game ||
+                         element_name == intern.machine))
+                data->hash = DB_HASH_INIT;
+        data->hash = db_hash_bytes (data->hash, tag, length);
+
+        if (!db_scanner_is_stored (data, element_name))
+        {
+                if (closing)
+                {
+                        db_scanner_set_error (error, _("unexpected end tag"));
+                        return FALSE;
+                }
+
+                if (!self_closing)
+                        data->skip_depth = 1;
+
+                return TRUE;
+        }
+
+        if (closing)
+        {
+                if (data->element_stack_depth == 0 ||
+                    data->element_stack[data->element_stack_depth - 1]
+                    != element_name)
+                {
+                        db_scanner_set_error (error, _("unexpected end tag"));
+                        return FALSE;
+                }
+
+                db_parser_end_element (data, error);
+
+                return (*error == NULL);
+        }
+
+        if (data->element_stack_depth == MAX_ELEMENT_DEPTH)
+        {
+                db_scanner_set_error (error, _("elements nested too deep"));
+                return FALSE;
+        }
+
+        if (!db_scanner_attributes (
+                cp, end, attribute_name, attribute_value, error))
+                return FALSE;
+
+        /* MAME lists the devices a game uses along with the game. */
+        if (data->details != NULL && (element_name == intern.game ||
+                                      element_name == intern.machine))
+        {
+                const gchar *game = NULL;
+                guint ii;
+
+                for (ii = 0; attribute_name[ii] != NULL; ii++)
+                        if (attribute_name[ii] == intern.name)
+                                game = attribute_value[ii];
+
+                if (game == NULL || strcmp (game, data->details) != 0)
+                {
+                        if (!self_closing)
+                                data->skip_depth = 1;
+                        return TRUE;
+                }
+        }
+
+        db_parser_start_element (
+                data, element_name, attribute_name, attribute_value, error);
+
+        if (*error == NULL && self_closing)
+                db_parser_end_element (data, error);
+
+        return (*error == NULL);
+}
+
+/* Returns the '>' that ends the tag starting at @tag, or NULL if the
+ * tag is incomplete.  A '>' inside an attribute value doesn't count. */
+static gchar *
+db_scanner_find_tag_end (gchar *tag,
+                         gchar *end)
+{
+        gchar *cp = tag;
+
+        while ((cp = memchr (cp, '>', end - cp)) != NULL)
+        {
+                gchar *quote = tag;
+                guint n_quotes = 0;
+
+                while ((quote = memchr (quote, '"', cp - quote)) != NULL)
+                {
+                        n_quotes++;
+                        quote++;
+                }
+
+                if (n_quotes % 2 == 0)
+                        return cp;
+
+                cp++;
+        }
+
+        return NULL;
+}
+
+/* Returns the end of a markup declaration, processing instruction or
+ * comment starting at @tag, or NULL if it is incomplete. */
+static gchar *
+db_scanner_find_declaration_end (gchar *tag,
+                                 gchar *end)
+{
+        const gchar *terminator;
+        gchar *cp;
+
+        if (end - tag >= 4 && strncmp (tag, "<!--", 4) == 0)
+                terminator = "-->";
+        else if (tag[1] == '?')
+                terminator = "?>";
+        else
+        {
+                gchar *bracket;
+
+                /* <!DOCTYPE> may have an internal subset. */
+                cp = memchr (tag, '>', end - tag);
+                bracket = memchr (tag, '[', end - tag);
+                if (cp == NULL || bracket == NULL || bracket > cp)
+                        return cp;
+                terminator = "]>";
+                tag = bracket;
+        }
+
+        for (cp = tag; cp + strlen (terminator) <= end; cp++)
+        {
+                cp = memchr (cp, terminator[0], end - cp);
+                if (cp == NULL)
+                        break;
+                if (cp + strlen (terminator) > end)
+                        break;
+                if (strncmp (cp, terminator, strlen (terminator)) == 0)
+                        return cp + strlen (terminator) - 1;
+        }
+
+        return NULL;
+}
+
+/* Processes complete tags and text in @buffer, which it may modify.
+ * Returns the number of bytes processed, or -1 on error. */
+static gssize
+db_scanner_scan (ParserData *data,
+                 gchar *buffer,
+                 gsize length,
+                 GError **error)
+{
+        gchar *cp = buffer;
+        gchar *end = buffer + length;
+
+        while (cp < end)
+        {
+                gchar *next;
+
+                if (*cp != '<')
+                {
+                        next = memchr (cp, '<', end - cp);
+                        if (next == NULL)
+                                break;
+
+                        if (data->skip_depth == 0 &&
+                            data->element_stack_depth > 1)
+                                data->hash = db_hash_bytes (
+                                        data->hash, cp, next - cp);
+
+                        if (db_scanner_wants_text (data))
+                        {
+                                GString *text = data->scan_text;
+
+                                g_string_assign (text, "");
+                                g_string_append_len (text, cp, next - cp);
+                                db_scanner_unescape (
+                                        text->str, text->str + text->len);
+                                db_parser_text (data, text->str, error);
+                                if (*error != NULL)
+                                        return -1;
+                        }
+
+                        cp = next;
+                        continue;
+                }
+
+                if (end - cp < 2)
+                        break;
+
+                if (cp[1] == '!' || cp[1] == '?')
+                {
+                        next = db_scanner_find_declaration_end (cp, end);
+                        if (next == NULL)
+                                break;
+                        cp = next + 1;
+                        continue;
+                }
+
+                next = db_scanner_find_tag_end (cp, end);
+                if (next == NULL)
+                        break;
+
+                if (!db_scanner_tag (data, cp, next - cp + 1, error))
+                        return -1;
+
+                cp = next + 1;
+        }
+
+        return cp - buffer;
+}
+
+/* Feeds a chunk of output to the scanner, which may modify it.  A tag
+ * split across chunks is completed in a separate buffer, a piece at a
+ * time, and the rest of the chunk is scanned in place. */
+static gboolean
+db_scanner_parse (ParserData *data,
+                  gchar *buffer,
+                  gsize length,
+                  GError **error)
+{
+        GString *carry = data->scan_carry;
+        gssize processed;
+
+        while (carry->len > 0 && length > 0)
+        {
+                gchar *cp;
+                gsize piece;
+
+                cp = memchr (buffer, '>', length);
+                piece = (cp != NULL) ? cp - buffer + 1 : length;
+
+                g_string_append_len (carry, buffer, piece);
+                buffer += piece;
+                length -= piece;
+
+                processed = db_scanner_scan (
+                        data, carry->str, carry->len, error);
+                if (processed < 0)
+                        return FALSE;
+                g_string_erase (carry, 0, processed);
+        }
+
+        processed = db_scanner_scan (data, buffer, length, error);
+        if (processed < 0)
+                return FALSE;
+        g_string_append_len (carry, buffer + processed, length - processed);
+
+        return TRUE;
+}
+
+static gboolean
+db_scanner_end_parse (ParserData *data,
+                      GError **error)
+{
+        GString *carry = data->scan_carry;
+        gsize ii;
+
+        for (ii = 0; ii < carry->len; ii++)
+                if (!db_scanner_is_space (carry->str[ii]))
+                        break;
+
+        if (ii < carry->len || data->element_stack_depth > 0 ||
+            data->skip_depth > 0)
+        {
+                db_scanner_set_error (
+                        error, _("document ended unexpectedly"));
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static gchar *
+db_cache_get_filename (const gchar *basename)
+{
+        return g_build_filename (
+                g_get_user_cache_dir (), PACKAGE, basename, NULL);
+}
+
+static void
+db_cache_invalidate (void)
+{
+        gchar *filename;
+
+        filename = db_cache_get_filename (LISTXML_CACHE_KEY_FILE);
+        g_unlink (filename);
+        g_free (filename);
+
+        filename = db_cache_get_filename (LISTXML_CACHE_FILE);
+        g_unlink (filename);
+        g_free (filename);
+}
+
+static gchar *
+db_cache_get_key (void)
+{
+        struct stat st;
+        gchar *version;
+        gchar *key;
+        GError *error = NULL;
+
+        if (g_stat (MAME_PROGRAM, &st) < 0)
+                return NULL;
+
+        version = gva_mame_get_version (&error);
+        gva_error_handle (&error);
+
+        if (version == NULL)
+                return NULL;
+
+        key = g_strdup_printf (
+                "%s\n%" G_GINT64_FORMAT "\n%ld\n%s\n", MAME_PROGRAM,
+                (gint64) st.st_size, (glong) st.st_mtime, version);
+
+        g_free (version);
+
+        return key;
+}
+
+/* Returns a stream that reads back the cached output,
+ * or NULL if the cache does not match @key. */
+static GInputStream *
+db_cache_replay (const gchar *key)
+{
+        GInputStream *stream = NULL;
+        gchar *filename;
+        gchar *contents = NULL;
+        GError *error = NULL;
+
+        filename = db_cache_get_filename (LISTXML_CACHE_KEY_FILE);
+        g_file_get_contents (filename, &contents, NULL, NULL);
+        g_free (filename);
+
+        if (contents == NULL)
+                return NULL;
+
+        if (strcmp (contents, key) == 0)
+        {
+                GConverter *decompressor;
+                GFileInputStream *file_stream;
+                GFile *file;
+
+                filename = db_cache_get_filename (LISTXML_CACHE_FILE);
+                file = g_file_new_for_path (filename);
+                file_stream = g_file_read (file, NULL, &error);
+                gva_error_handle (&error);
+                g_object_unref (file);
+                g_free (filename);
+
+                if (file_stream != NULL)
+                {
+                        decompressor = G_CONVERTER (g_zlib_decompressor_new (
+                                G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+                        stream = g_converter_input_stream_new (
+                                G_INPUT_STREAM (file_stream), decompressor);
+                        g_object_unref (decompressor);
+                        g_object_unref (file_stream);
+                }
+        }
+        else
+                db_cache_invalidate ();
+
+        g_free (contents);
+
+        return stream;
+}
+
+static void
+db_cache_begin (ParserData *data,
+                const gchar *key)
+{
+        GConverter *compressor;
+        GFile *file;
+        gchar *filename;
+        GError *error = NULL;
+
+        filename = db_cache_get_filename (NULL);
+        g_mkdir_with_parents (filename, 0700);
+        g_free (filename);
+
+        filename = db_cache_get_filename (LISTXML_CACHE_FILE ".tmp");
+        file = g_file_new_for_path (filename);
+        g_free (filename);
+
+        data->cache_file_stream = g_file_replace (
+                file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+        g_object_unref (file);
+
+        if (data->cache_file_stream == NULL)
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        compressor = G_CONVERTER (g_zlib_compressor_new (
+                G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+        data->cache_stream = g_converter_output_stream_new (
+                G_OUTPUT_STREAM (data->cache_file_stream), compressor);
+        g_object_unref (compressor);
+
+        data->cache_key = g_strdup (key);
+}
+
+static void
+db_cache_abandon (ParserData *data)
+{
+        gchar *filename;
+
+        if (data->cache_stream == NULL)
+                return;
+
+        g_output_stream_close (data->cache_stream, NULL, NULL);
+        g_object_unref (data->cache_stream);
+        g_object_unref (data->cache_file_stream);
+        data->cache_stream = NULL;
+        data->cache_file_stream = NULL;
+
+        filename = db_cache_get_filename (LISTXML_CACHE_FILE ".tmp");
+        g_unlink (filename);
+        g_free (filename);
+}
+
+static void
+db_cache_write (ParserData *data,
+                const gchar *buffer,
+                gsize length)
+{
+        GSeekable *seekable;
+        GError *error = NULL;
+
+        if (data->cache_stream == NULL)
+                return;
+
+        g_output_stream_write_all (
+                data->cache_stream, buffer, length, NULL, NULL, &error);
+
+        seekable = G_SEEKABLE (data->cache_file_stream);
+
+        if (error != NULL)
+        {
+                gva_error_handle (&error);
+                db_cache_abandon (data);
+        }
+        else if (g_seekable_tell (seekable) > LISTXML_CACHE_MAX_SIZE)
+        {
+                g_message ("MAME output is too large to cache.");
+                db_cache_abandon (data);
+        }
+}
+
+static void
+db_cache_finish (ParserData *data)
+{
+        gchar *filename;
+        gchar *tmp_filename;
+        GError *error = NULL;
+
+        if (data->cache_stream == NULL)
+                return;
+
+        if (!g_output_stream_close (data->cache_stream, NULL, &error))
+        {
+                gva_error_handle (&error);
+                db_cache_abandon (data);
+                return;
+        }
+
+        g_object_unref (data->cache_stream);
+        g_object_unref (data->cache_file_stream);
+        data->cache_stream = NULL;
+        data->cache_file_stream = NULL;
+
+        /* Remove the old key first, so a crash
+         * can't leave it paired with new output. */
+        filename = db_cache_get_filename (LISTXML_CACHE_KEY_FILE);
+        g_unlink (filename);
+        g_free (filename);
+
+        filename = db_cache_get_filename (LISTXML_CACHE_FILE);
+        tmp_filename = db_cache_get_filename (LISTXML_CACHE_FILE ".tmp");
+
+        if (g_rename (tmp_filename, filename) == 0)
+        {
+                g_free (filename);
+                filename = db_cache_get_filename (LISTXML_CACHE_KEY_FILE);
+                g_file_set_contents (filename, data->cache_key, -1, &error);
+                gva_error_handle (&error);
+        }
+        else
+                g_unlink (tmp_filename);
+
+        g_free (filename);
+        g_free (tmp_filename);
+}
+
+/* Builds are written to this file and then renamed over the live
+ * database, so the old game list stays usable until the very end. */
+static const gchar *
+db_get_shadow_filename (void)
+{
+        static gchar *filename = NULL;
+
+        if (G_UNLIKELY (filename == NULL))
+                filename = g_strconcat (
+                        gva_db_get_filename (), ".new", NULL);
+
+        return filename;
+}
+
+static void
+db_trace_cb (gpointer unused, const gchar *message)
+{
+        g_log (G_LOG_DOMAIN, GVA_DEBUG_SQL, "%s", message);
+}
+
+/* Creates the search table with a trigram index if SQLite supports it,
+ * or as a plain table otherwise. */
+static gboolean
+db_create_search_table (sqlite3 *connection,
+                        GError **error)
+{
+        gint errcode;
+
+#if SQLITE_VERSION_NUMBER >= 3034000
+        errcode = sqlite3_exec (
+                connection, SQL_CREATE_TABLE_SEARCH_FTS5, NULL, NULL, NULL);
+        if (errcode == SQLITE_OK)
+                return TRUE;
+#endif
+
+        errcode = sqlite3_exec (
+                connection, SQL_CREATE_TABLE_SEARCH, NULL, NULL, NULL);
+        if (errcode == SQLITE_OK)
+                return TRUE;
+
+        gva_db_set_error (
+                error, sqlite3_errcode (connection),
+                sqlite3_errmsg (connection));
+
+        return FALSE;
+}
+
+/* Joins the collation keys of its non-NULL arguments with newlines,
+ * which never appear in a collation key, so a search cannot match
+ * across fields. */
+static void
+db_function_searchkey (sqlite3_context *context,
+                       gint n_values,
+                       sqlite3_value **values)
+{
+        GString *key;
+        gint ii;
+
+        key = g_string_sized_new (256);
+
+        for (ii = 0; ii < n_values; ii++)
+        {
+                const gchar *text;
+                gsize offset;
+                gsize length;
+
+                text = (const gchar *) sqlite3_value_text (values[ii]);
+                if (text == NULL)
+                        continue;
+
+                if (key->len > 0)
+                        g_string_append_c (key, '\n');
+
+                /* Write the key in place.  It is rarely longer
+                 * than the text, but make room if it is. */
+                offset = key->len;
+                g_string_set_size (key, offset + strlen (text));
+                length = gva_search_collate_key_to_buffer (
+                        text, key->str + offset, key->len - offset + 1);
+                if (offset + length > key->len)
+                {
+                        g_string_set_size (key, offset + length);
+                        gva_search_collate_key_to_buffer (
+                                text, key->str + offset, length + 1);
+                }
+                g_string_truncate (key, offset + length);
+        }
+
+        sqlite3_result_text (
+                context, key->str, key->len, (GDestroyNotify) g_free);
+        g_string_free (key, FALSE);
+}
+
+static void
+db_writer_set_error (ParserData *data,
+                     GError **error)
+{
+        gva_db_set_error (
+                error, sqlite3_errcode (data->connection),
+                sqlite3_errmsg (data->connection));
+}
+
+static gboolean
+db_writer_execute (ParserData *data,
+                   const gchar *sql,
+                   GError **error)
+{
+        if (sqlite3_exec (data->connection, sql, NULL, NULL, NULL) != SQLITE_OK)
+        {
+                db_writer_set_error (data, error);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+db_writer_prepare_update (ParserData *data,
+                          GError **error)
+{
+        sqlite3_stmt *stmt;
+        gint errcode;
+        gint ii;
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+        {
+                gchar *sql;
+
+                if (db_tables[ii].game_column == NULL)
+                        continue;
+
+                sql = g_strdup_printf (
+                        "DELETE FROM %s WHERE %s = @name",
+                        db_tables[ii].name, db_tables[ii].game_column);
+                errcode = sqlite3_prepare_v2 (
+                        data->connection, sql, -1,
+                        &data->delete_stmt[ii], NULL);
+                g_free (sql);
+
+                if (errcode != SQLITE_OK)
+                        goto fail;
+        }
+
+        /* Load the digests from the previous build. */
+        data->old_hashes = g_hash_table_new_full (
+                g_str_hash, g_str_equal,
+                (GDestroyNotify) g_free,
+                (GDestroyNotify) g_free);
+
+        errcode = sqlite3_prepare_v2 (
+                data->connection, SQL_SELECT_GAMEHASH, -1, &stmt, NULL);
+        if (errcode != SQLITE_OK)
+                goto fail;
+
+        while ((errcode = sqlite3_step (stmt)) == SQLITE_ROW)
+                g_hash_table_insert (
+                        data->old_hashes,
+                        g_strdup ((gchar *) sqlite3_column_text (stmt, 0)),
+                        g_strdup ((gchar *) sqlite3_column_text (stmt, 1)));
+
+        sqlite3_finalize (stmt);
+
+        if (errcode != SQLITE_DONE)
+                goto fail;
+
+        /* The build ID gets replaced. */
+        return db_writer_execute (data, "DELETE FROM mame", error);
+
+fail:
+        db_writer_set_error (data, error);
+
+        return FALSE;
+}
+
+static gboolean
+db_writer_exec_stmt (ParserData *data,
+                     sqlite3_stmt *stmt,
+                     GError **error)
+{
+        gboolean success;
+
+        success = (sqlite3_step (stmt) == SQLITE_DONE);
+
+        if (!success)
+                db_writer_set_error (data, error);
+
+        sqlite3_reset (stmt);
+        sqlite3_clear_bindings (stmt);
+
+        return success;
+}
+
+static gboolean
+db_writer_delete_game (ParserData *data,
+                       const gchar *name,
+                       GError **error)
+{
+        gint ii;
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+        {
+                sqlite3_stmt *stmt = data->delete_stmt[ii];
+
+                if (stmt == NULL)
+                        continue;
+
+                sqlite3_bind_text (stmt, 1, name, -1, SQLITE_STATIC);
+                if (!db_writer_exec_stmt (data, stmt, error))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+static gboolean
+db_writer_mark_unaudited (ParserData *data,
+                          const gchar *name,
+                          GError **error)
+{
+        sqlite3_stmt *stmt = data->unaudited_stmt;
+
+        sqlite3_bind_text (stmt, 1, name, -1, SQLITE_STATIC);
+
+        return db_writer_exec_stmt (data, stmt, error);
+}
+
+/* Compares a game's digest with the previous build, deleting the old
+ * rows if the game changed.  Sets data->skip_game if the game is
+ * unchanged, in which case its rows are left alone, along with the
+ * results of previous audits. */
+static gboolean
+db_writer_update_game (ParserData *data,
+                       const DbValue *values,
+                       guint n_values,
+                       GError **error)
+{
+        const gchar *name = NULL;
+        const gchar *hash = NULL;
+        const gchar *old_hash;
+        guint ii;
+
+        for (ii = 0; ii < n_values; ii++)
+        {
+                if (strcmp (values[ii].param, "@name") == 0)
+                        name = values[ii].text;
+                else if (strcmp (values[ii].param, "@hash") == 0)
+                        hash = values[ii].text;
+        }
+
+        g_return_val_if_fail (name != NULL && hash != NULL, TRUE);
+
+        old_hash = g_hash_table_lookup (data->old_hashes, name);
+
+        data->skip_game =
+                (old_hash != NULL && strcmp (old_hash, hash) == 0);
+
+        if (old_hash != NULL)
+        {
+                g_hash_table_remove (data->old_hashes, name);
+
+                if (data->skip_game)
+                        return TRUE;
+
+                if (!db_writer_delete_game (data, name, error))
+                        return FALSE;
+
+                data->games_changed++;
+        }
+        else
+                data->games_added++;
+
+        return db_writer_mark_unaudited (data, name, error);
+}
+
+/* Deletes games that were not in the new build. */
+static gboolean
+db_writer_finish_update (ParserData *data,
+                         GError **error)
+{
+        GHashTableIter iter;
+        gpointer name;
+
+        g_hash_table_iter_init (&iter, data->old_hashes);
+
+        while (g_hash_table_iter_next (&iter, &name, NULL))
+        {
+                if (!db_writer_delete_game (data, name, error))
+                        return FALSE;
+
+                data->games_removed++;
+        }
+
+        return db_writer_execute (
+                data, "DELETE FROM unaudited WHERE name "
+                "NOT IN (SELECT name FROM game); "
+                "DELETE FROM audit_detail WHERE name "
+                "NOT IN (SELECT name FROM game)", error);
+}
+
+/* Starts an incremental build from a copy of the live database. */
+static gboolean
+db_writer_copy_live (ParserData *data,
+                     GError **error)
+{
+        sqlite3 *live;
+        sqlite3_backup *backup;
+        gint errcode;
+
+        errcode = sqlite3_open_v2 (
+                gva_db_get_filename (), &live,
+                SQLITE_OPEN_READONLY, NULL);
+
+        if (errcode != SQLITE_OK)
+        {
+                gva_db_set_error (
+                        error, sqlite3_errcode (live),
+                        sqlite3_errmsg (live));
+                sqlite3_close (live);
+                return FALSE;
+        }
+
+        sqlite3_busy_timeout (live, 10000);
+
+        backup = sqlite3_backup_init (data->connection, "main", live, "main");
+
+        if (backup != NULL)
+        {
+                sqlite3_backup_step (backup, -1);
+                sqlite3_backup_finish (backup);
+        }
+
+        sqlite3_close (live);
+
+        if (sqlite3_errcode (data->connection) != SQLITE_OK)
+        {
+                db_writer_set_error (data, error);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/* Starts a full build with empty tables.  The tables that survive
+ * builds are filled in from the live database by db_install_shadow(),
+ * since the user may still be adding to them. */
+static gboolean
+db_writer_create_tables (ParserData *data,
+                         GError **error)
+{
+        if (!db_writer_execute (data, SQL_CREATE_TABLES, error))
+                return FALSE;
+
+        return db_create_search_table (data->connection, error);
+}
+
+static gboolean
+db_writer_open (ParserData *data,
+                GError **error)
+{
+        const gchar *filename;
+        gint errcode;
+        gint ii;
+
+        filename = db_get_shadow_filename ();
+
+        if (sqlite3_open (filename, &data->connection) != SQLITE_OK)
+                goto fail;
+
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                sqlite3_trace (data->connection, db_trace_cb, NULL);
+
+        errcode = sqlite3_create_function (
+                data->connection, "searchkey", -1, SQLITE_ANY, NULL,
+                db_function_searchkey, NULL, NULL);
+        if (errcode != SQLITE_OK)
+                goto fail;
+
+        /* The main connection may briefly hold a lock on the live
+         * database while we copy from it. */
+        sqlite3_busy_timeout (data->connection, 10000);
+
+        if (!db_writer_execute (data, SQL_SHADOW_PRAGMAS, error))
+                return FALSE;
+
+        if (data->incremental)
+        {
+                if (!db_writer_copy_live (data, error))
+                        return FALSE;
+
+                /* Deleting changed games needs the indexes. */
+                if (!db_writer_execute (data, SQL_CREATE_INDEXES, error))
+                        return FALSE;
+        }
+        else
+        {
+                if (!db_writer_create_tables (data, error))
+                        return FALSE;
+        }
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+        {
+                errcode = sqlite3_prepare_v2 (
+                        data->connection, db_insert_sql[ii], -1,
+                        &data->insert_stmt[ii], NULL);
+                if (errcode != SQLITE_OK)
+                        goto fail;
+        }
+
+        errcode = sqlite3_prepare_v2 (
+                data->connection, SQL_INSERT_UNAUDITED, -1,
+                &data->unaudited_stmt, NULL);
+        if (errcode != SQLITE_OK)
+                goto fail;
+
+        if (!db_writer_execute (data, "BEGIN TRANSACTION", error))
+                return FALSE;
+
+        if (data->incremental)
+                return db_writer_prepare_update (data, error);
+
+        return TRUE;
+
+fail:
+        db_writer_set_error (data, error);
+
+        return FALSE;
+}
+
+static void
+db_writer_close (ParserData *data)
+{
+        gint ii;
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+        {
+                sqlite3_finalize (data->insert_stmt[ii]);
+                data->insert_stmt[ii] = NULL;
+
+                sqlite3_finalize (data->delete_stmt[ii]);
+                data->delete_stmt[ii] = NULL;
+        }
+
+        sqlite3_finalize (data->unaudited_stmt);
+        data->unaudited_stmt = NULL;
+
+        if (data->old_hashes != NULL)
+        {
+                g_hash_table_destroy (data->old_hashes);
+                data->old_hashes = NULL;
+        }
+
+        sqlite3_close (data->connection);
+        data->connection = NULL;
+}
+
+static void
+db_writer_bind (ParserData *data,
+                sqlite3_stmt *stmt,
+                const DbValue *value)
+{
+        gint errcode;
+        gchar *utf8;
+        GError *error = NULL;
+
+        if (value->text == NULL)
+                errcode = sqlite3_bind_int (stmt, value->slot, value->number);
+
+        /* Text normally arrives as UTF-8 already.  It lives in the batch,
+         * which outlives the binding since bindings are cleared after
+         * each row, so SQLite can use it without making a copy. */
+        else if (g_utf8_validate (value->text, -1, NULL))
+                errcode = sqlite3_bind_text (
+                        stmt, value->slot, value->text, -1, SQLITE_STATIC);
+
+        else
+        {
+                utf8 = g_locale_to_utf8 (value->text, -1, NULL, NULL, &error);
+                gva_error_handle (&error);
+
+                g_return_if_fail (utf8 != NULL);
+                errcode = sqlite3_bind_text (
+                        stmt, value->slot, utf8, -1, g_free);
+        }
+
+        if (errcode != SQLITE_OK)
+        {
+                db_writer_set_error (data, &error);
+                gva_error_handle (&error);
+        }
+}
+
+static gboolean
+db_writer_write_batch (ParserData *data,
+                       DbBatch *batch,
+                       GError **error)
+{
+        guint ii, jj;
+
+        for (ii = 0; ii < batch->rows->len; ii++)
+        {
+                DbRow *row;
+                DbValue *values;
+                sqlite3_stmt *stmt;
+
+                row = &g_array_index (batch->rows, DbRow, ii);
+                values = &g_array_index (batch->values, DbValue, row->first);
+                stmt = data->insert_stmt[row->table];
+
+                /* A game's gamehash row precedes the rest of its rows. */
+                if (data->incremental && row->table == DB_TABLE_GAMEHASH)
+                        if (!db_writer_update_game (
+                                data, values, row->length, error))
+                                return FALSE;
+
+                /* Tables without a statement are not written. */
+                if (data->skip_game || stmt == NULL)
+                        continue;
+
+                for (jj = 0; jj < row->length; jj++)
+                        db_writer_bind (data, stmt, &values[jj]);
+
+                if (!db_writer_exec_stmt (data, stmt, error))
+                        return FALSE;
+        }
+
+        return TRUE;
+}
+
+static ParserData *
+db_parser_data_new (GvaProcess *process)
+{
+        ParserData *data;
+        gint ii;
+
+        data = g_slice_new0 (ParserData);
+        data->ref_count = 1;
+
+        /* Replaying cached output needs no process. */
+        if (process != NULL)
+                data->process = g_object_ref (process);
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+                data->slots[ii] = db_parser_slots_new (db_insert_sql[ii]);
+
+        data->scan_carry = g_string_sized_new (1024);
+        data->scan_text = g_string_sized_new (256);
+        data->game_row.values =
+                g_array_new (FALSE, FALSE, sizeof (DbValue));
+        data->element_row.values =
+                g_array_new (FALSE, FALSE, sizeof (DbValue));
+        data->batch = db_batch_new ();
+
+        data->chunk_queue = db_queue_new (0);
+        data->batch_queue = db_queue_new (MAX_QUEUED_BATCHES);
+
+        return data;
+}
+
+static ParserData *
+db_parser_data_ref (ParserData *data)
+{
+        g_atomic_int_inc (&data->ref_count);
+
+        return data;
+}
+
+static void
+db_parser_data_unref (ParserData *data)
+{
+        gint ii;
+
+        if (!g_atomic_int_dec_and_test (&data->ref_count))
+                return;
+
+        if (data->process != NULL)
+                g_object_unref (data->process);
+
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+                g_hash_table_destroy (data->slots[ii]);
+
+        g_string_free (data->scan_carry, TRUE);
+        g_string_free (data->scan_text, TRUE);
+        g_array_free (data->game_row.values, TRUE);
+        g_array_free (data->element_row.values, TRUE);
+        db_batch_free (data->batch);
+
+        g_free (data->configuration);
+        g_free (data->dipswitch);
+        g_free (data->game);
+        g_free (data->mask);
+        g_free (data->tag);
+
+        db_queue_free (data->chunk_queue);
+        db_queue_free (data->batch_queue);
+
+        g_clear_error (&data->parser_error);
+        g_clear_error (&data->writer_error);
+        g_clear_error (&data->error);
+
+        if (data->replay_stream != NULL)
+                g_object_unref (data->replay_stream);
+
+        if (data->cancellable != NULL)
+                g_object_unref (data->cancellable);
+
+        if (data->timer != NULL)
+                g_timer_destroy (data->timer);
+
+        db_cache_abandon (data);
+        g_free (data->cache_key);
+        g_free (data->details);
+
+        if (data->simple != NULL)
+                g_object_unref (data->simple);
+
+        g_slice_free (ParserData, data);
+}
+
+static void
+db_parser_push_chunk (ParserData *data,
+                      const gchar *buffer,
+                      gsize length)
+{
+        GByteArray *chunk;
+
+        chunk = g_byte_array_sized_new (length);
+        g_byte_array_append (chunk, (const guint8 *) buffer, length);
+        db_queue_push (data->chunk_queue, chunk);
+
+        data->bytes_parsed += length;
+}
+
+static void
+db_parser_read (GvaProcess *process,
+                ParserData *data)
+{
+        const gchar *buffer;
+        gsize length;
+
+        if (process->error != NULL)
+                g_atomic_int_set (&data->failed, TRUE);
+
+        /* Hand copies of the output to the parser thread.  If the
+         * parser thread falls behind, leave the output in the process'
+         * ring buffer.  Once that fills up the process stops reading
+         * from the pipe, which throttles MAME until the parser thread
+         * catches up and calls us again. */
+        while ((length = gva_process_stdout_peek (process, &buffer)) > 0)
+        {
+                /* Discard output after an error so the pipe drains
+                 * and the process can exit. */
+                if (g_atomic_int_get (&data->failed))
+                {
+                        gva_process_stdout_consume (process, length);
+                        continue;
+                }
+
+                if (db_queue_length (data->chunk_queue) >= MAX_QUEUED_CHUNKS)
+                {
+                        g_atomic_int_set (&data->stalled, TRUE);
+
+                        /* Check again in case the parser thread
+                         * drained the queue before seeing the flag. */
+                        if (db_queue_length (data->chunk_queue) >=
+                            MAX_QUEUED_CHUNKS)
+                                break;
+                }
+
+                db_parser_push_chunk (data, buffer, length);
+                gva_process_stdout_consume (process, length);
+        }
+
+        if (g_atomic_int_get (&data->failed))
+                gva_process_kill (process);
+}
+
+static gboolean
+db_parser_resume_idle_cb (ParserData *data)
+{
+        if (!data->finished)
+                db_parser_read (data->process, data);
+
+        return FALSE;
+}
+
+static gboolean
+db_parser_progress_cb (ParserData *data)
+{
+        if (data->progress_callback != NULL)
+                data->progress_callback (
+                        g_atomic_int_get (&data->games_written),
+                        data->progress_data);
+
+        return TRUE;
+}
+
+static void
+db_parser_cancelled_cb (GCancellable *cancellable,
+                        ParserData *data)
+{
+        /* A replay stops at its next read.  MAME has to be killed. */
+        g_atomic_int_set (&data->failed, TRUE);
+
+        if (data->process != NULL &&
+            !gva_process_has_exited (data->process, NULL))
+                gva_process_kill (data->process);
+}
+
+/* Reads the next chunk of cached output, or returns NULL at the end
+ * of the cache or if an error occurs. */
+static GByteArray *
+db_parser_read_replay (ParserData *data,
+                       GError **error)
+{
+        GByteArray *chunk;
+        gssize length;
+
+        chunk = g_byte_array_sized_new (LISTXML_BUFFER_SIZE);
+        g_byte_array_set_size (chunk, LISTXML_BUFFER_SIZE);
+
+        length = g_input_stream_read (
+                data->replay_stream, chunk->data, chunk->len,
+                data->cancellable, error);
+
+        if (length <= 0)
+        {
+                /* A corrupt cache shows up as a decompression error. */
+                if (length < 0 && !g_error_matches (
+                        *error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                        g_prefix_error (
+                                error, "%s: ",
+                                _("Failed to read cached MAME output"));
+
+                g_byte_array_free (chunk, TRUE);
+                return NULL;
+        }
+
+        g_byte_array_set_size (chunk, length);
+        data->bytes_parsed += length;
+
+        return chunk;
+}
+
+static gpointer
+db_parser_thread (ParserData *data)
+{
+        GByteArray *chunk;
+        GError *error = NULL;
+
+        for (;;)
+        {
+                /* Read cached output ourselves until something goes
+                 * wrong.  MAME's output comes from the main thread, so
+                 * keep draining the queue after an error so the main
+                 * thread always has somewhere to put output. */
+                if (data->replay_stream == NULL)
+                        chunk = db_queue_pop (data->chunk_queue);
+                else if (error == NULL && !g_atomic_int_get (&data->failed))
+                        chunk = db_parser_read_replay (data, &error);
+                else
+                        chunk = NULL;
+
+                if (chunk == NULL)
+                        break;
+
+                /* Cache the chunk before the scanner modifies it. */
+                if (error == NULL)
+                        db_cache_write (
+                                data, (gchar *) chunk->data, chunk->len);
+
+                if (error == NULL)
+                        db_scanner_parse (
+                                data, (gchar *) chunk->data,
+                                chunk->len, &error);
+
+                if (error != NULL)
+                        g_atomic_int_set (&data->failed, TRUE);
+
+                g_byte_array_free (chunk, TRUE);
+
+                /* Wake the main thread if it stopped feeding us. */
+                if (g_atomic_int_compare_and_exchange (
+                        &data->stalled, TRUE, FALSE))
+                        g_idle_add_full (
+                                G_PRIORITY_DEFAULT_IDLE,
+                                (GSourceFunc) db_parser_resume_idle_cb,
+                                db_parser_data_ref (data),
+                                (GDestroyNotify) db_parser_data_unref);
+        }
+
+        if (error == NULL && !g_atomic_int_get (&data->failed))
+                db_scanner_end_parse (data, &error);
+
+        if (error == NULL)
+                db_parser_flush_batch (data);
+
+        /* Only cache complete output. */
+        if (error == NULL && data->exit_status == 0 &&
+            !g_atomic_int_get (&data->failed))
+                db_cache_finish (data);
+        else
+                db_cache_abandon (data);
+
+        /* Tell the writer thread we're done. */
+        db_queue_push (data->batch_queue, NULL);
+
+        if (error != NULL)
+        {
+                g_atomic_int_set (&data->failed, TRUE);
+                data->parser_error = error;
+        }
+
+        return NULL;
+}
 
-        if (!gva_db_prepare (SQL_INSERT_BIOSSET, &data->insert_biosset_stmt, &error))
-                g_error ("%s", error->message);
+/* Copies the tables that survive builds from the live database into the
+ * new one, replacing what the writer thread started with.  Games played
+ * and sets audited while we were building would be lost otherwise. */
+static gboolean
+db_copy_surviving_tables (const gchar *shadow_filename,
+                          GError **error)
+{
+        gchar *sql;
+        gboolean success;
+
+        sql = sqlite3_mprintf (
+                "ATTACH DATABASE %Q AS shadow", shadow_filename);
+        success = gva_db_execute (sql, error);
+        sqlite3_free (sql);
+
+        if (!success)
+                return FALSE;
 
-        if (!gva_db_prepare (SQL_INSERT_ROM, &data->insert_rom_stmt, &error))
-                g_error ("%s", error->message);
+        success = gva_db_execute (SQL_COPY_SURVIVING_TABLES, error);
 
-        if (!gva_db_prepare (SQL_INSERT_DISK, &data->insert_disk_stmt, &error))
-                g_error ("%s", error->message);
+        if (!success)
+                sqlite3_exec (
+                        db, "ROLLBACK TRANSACTION", NULL, NULL, NULL);
 
-        if (!gva_db_prepare (SQL_INSERT_SAMPLE, &data->insert_sample_stmt, &error))
-                g_error ("%s", error->message);
+        sqlite3_exec (db, "DETACH DATABASE shadow", NULL, NULL, NULL);
 
-        if (!gva_db_prepare (SQL_INSERT_CHIP, &data->insert_chip_stmt, &error))
-                g_error ("%s", error->message);
+        return success;
+}
 
-        if (!gva_db_prepare (SQL_INSERT_DISPLAY, &data->insert_display_stmt, &error))
-                g_error ("%s", error->message);
+/* Replaces the live database with the one we just built.  If the live
+ * database can't be closed yet, it returns %FALSE without setting @error
+ * and keeps the new database to try again later. */
+static gboolean
+db_install_shadow (GError **error)
+{
+        const gchar *filename;
+        const gchar *shadow_filename;
 
-        if (!gva_db_prepare (SQL_INSERT_CONTROL, &data->insert_control_stmt, &error))
-                g_error ("%s", error->message);
+        filename = gva_db_get_filename ();
+        shadow_filename = db_get_shadow_filename ();
 
-        if (!gva_db_prepare (SQL_INSERT_DIPVALUE, &data->insert_dipvalue_stmt, &error))
-                g_error ("%s", error->message);
+        /* Closing the connection discards temporary tables along with
+         * it, and audits keep statements open across main loop
+         * iterations, so leave the database alone until they finish. */
+        if (gva_audit_is_running ())
+                return FALSE;
 
-        if (!gva_db_prepare (SQL_INSERT_CONFSETTING, &data->insert_confsetting_stmt, &error))
-                g_error ("%s", error->message);
+        /* The game store also steps through query results from inside
+         * main loop iterations, so we may have been called while it's
+         * in the middle of one.  Wait for it to finish. */
+        if (sqlite3_next_stmt (db, NULL) != NULL)
+                return FALSE;
 
-        if (!gva_db_prepare (SQL_INSERT_ADJUSTER, &data->insert_adjuster_stmt, &error))
-                g_error ("%s", error->message);
+        if (!db_copy_surviving_tables (shadow_filename, error))
+        {
+                g_unlink (shadow_filename);
+                return FALSE;
+        }
 
-        return data;
+        if (sqlite3_close (db) != SQLITE_OK)
+                return FALSE;
+
+        db = NULL;
+
+        if (g_rename (shadow_filename, filename) < 0)
+        {
+                g_set_error (
+                        error, G_FILE_ERROR,
+                        g_file_error_from_errno (errno),
+                        "%s: %s", filename, g_strerror (errno));
+                g_unlink (shadow_filename);
+
+                /* Reopen the old database. */
+                gva_db_init (NULL);
+
+                return FALSE;
+        }
+
+        return gva_db_init (error);
 }
 
-static void
-db_parser_data_free (ParserData *data)
-{
-        g_markup_parse_context_free (data->context);
-        g_object_unref (data->process);
-
-        sqlite3_finalize (data->insert_game_stmt);
-        sqlite3_finalize (data->insert_biosset_stmt);
-        sqlite3_finalize (data->insert_rom_stmt);
-        sqlite3_finalize (data->insert_disk_stmt);
-        sqlite3_finalize (data->insert_sample_stmt);
-        sqlite3_finalize (data->insert_chip_stmt);
-        sqlite3_finalize (data->insert_display_stmt);
-        sqlite3_finalize (data->insert_control_stmt);
-        sqlite3_finalize (data->insert_dipvalue_stmt);
-        sqlite3_finalize (data->insert_confsetting_stmt);
-        sqlite3_finalize (data->insert_adjuster_stmt);
+static gboolean
+db_parser_install_cb (ParserData *data)
+{
+        /* Try again later if the live database is still in use. */
+        if (data->error == NULL &&
+            !db_install_shadow (&data->error) && data->error == NULL)
+                return TRUE;
 
-        g_free (data->configuration);
-        g_free (data->dipswitch);
-        g_free (data->game);
-        g_free (data->mask);
-        g_free (data->tag);
+        if (data->error == NULL)
+        {
+                gdouble seconds;
+                guint games;
 
-        g_slice_free (ParserData, data);
+                games = g_atomic_int_get (&data->games_written);
+                if (data->progress_callback != NULL)
+                        data->progress_callback (games, data->progress_data);
+
+                seconds = g_timer_elapsed (data->timer, NULL);
+                seconds = MAX (seconds, 0.001);
+
+                g_message (
+                        "Database built in %.1f seconds "
+                        "(%.1f MB/s, %.0f games/s).", seconds,
+                        data->bytes_parsed / seconds / 1.0e6,
+                        games / seconds);
+
+                if (data->incremental)
+                        g_message (
+                                "Database updated incrementally "
+                                "(%u games added, %u changed, %u removed).",
+                                data->games_added, data->games_changed,
+                                data->games_removed);
+        }
+
+        if (data->error != NULL)
+                g_simple_async_result_set_from_error (
+                        data->simple, data->error);
+        else
+                g_simple_async_result_set_op_res_gboolean (
+                        data->simple, TRUE);
+
+        g_simple_async_result_complete (data->simple);
+
+        return FALSE;
 }
 
-static void
-db_parser_read (GvaProcess *process,
-                ParserData *data)
+static gboolean
+db_parser_finish_idle_cb (ParserData *data)
 {
-        gchar *line;
+        g_thread_join (data->parser_thread);
+        g_thread_join (data->writer_thread);
 
-        if (process->error != NULL)
+        g_source_remove (data->progress_source_id);
+
+        if (data->cancelled_id > 0)
+                g_cancellable_disconnect (
+                        data->cancellable, data->cancelled_id);
+
+        /* Nothing else uses the reference gva_db_build_async() took
+         * for the threads, the progress timeout and the cancellable.
+         * This callback holds its own until it returns. */
+        db_parser_data_unref (data);
+
+        /* A cancelled build fails in other ways on the way out,
+         * but the cancellation is what to report. */
+        if (g_cancellable_is_cancelled (data->cancellable))
         {
-                gva_process_kill (process);
-                return;
+                g_clear_error (&data->error);
+                g_cancellable_set_error_if_cancelled (
+                        data->cancellable, &data->error);
+        }
+
+        /* Report the first error, if the process didn't already. */
+        if (data->error == NULL && data->parser_error != NULL)
+        {
+                g_propagate_error (&data->error, data->parser_error);
+                data->parser_error = NULL;
+        }
+
+        if (data->error == NULL && data->writer_error != NULL)
+        {
+                g_propagate_error (&data->error, data->writer_error);
+                data->writer_error = NULL;
         }
 
-        line = gva_process_stdout_read_line (process);
+        /* Don't replay bad output again. */
+        if (data->replay && data->error != NULL && !g_error_matches (
+                data->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                db_cache_invalidate ();
 
-        g_markup_parse_context_parse (
-                data->context, line, -1, &process->error);
+        /* Keep trying until the live database can be replaced. */
+        if (db_parser_install_cb (data))
+                g_timeout_add_full (
+                        G_PRIORITY_DEFAULT, INSTALL_RETRY_INTERVAL,
+                        (GSourceFunc) db_parser_install_cb,
+                        db_parser_data_ref (data),
+                        (GDestroyNotify) db_parser_data_unref);
 
-        g_free (line);
+        return FALSE;
 }
 
-static void
-db_parser_exit (GvaProcess *process,
-                gint status,
-                ParserData *data)
+static gpointer
+db_writer_thread (ParserData *data)
 {
+        DbBatch *batch;
         GError *error = NULL;
 
-        if (process->error == NULL)
+        db_writer_open (data, &error);
+
+        /* Keep draining the queue after an error so the
+         * parser thread never blocks on a full queue. */
+        while ((batch = db_queue_pop (data->batch_queue)) != NULL)
         {
-                GTimeVal time_elapsed;
+                if (error == NULL && !g_atomic_int_get (&data->failed))
+                {
+                        if (db_writer_write_batch (data, batch, &error))
+                                g_atomic_int_add (
+                                        &data->games_written,
+                                        batch->n_games);
+                }
 
-                g_markup_parse_context_end_parse (
-                        data->context, &process->error);
+                db_batch_free (batch);
+        }
 
-                gva_db_transaction_commit (&error);
-                gva_error_handle (&error);
+        if (error == NULL && !g_atomic_int_get (&data->failed))
+        {
+                if (data->incremental)
+                        db_writer_finish_update (data, &error);
+
+                /* Every game needs auditing after a full build. */
+                else if (db_writer_execute (
+                                data, SQL_CREATE_INDEXES, &error))
+                        db_writer_execute (
+                                data, "INSERT INTO unaudited "
+                                "SELECT name FROM game", &error);
+        }
 
-                gva_process_get_time_elapsed (process, &time_elapsed);
+        /* Note that the rom and disk tables are complete, so native
+         * audits can tell whether they need another build. */
+        if (error == NULL && !g_atomic_int_get (&data->failed) &&
+            data->store_sets)
+                db_writer_execute (
+                        data, "UPDATE mame SET sets = 'yes'", &error);
 
-                g_message (
-                        "Database built in %ld.%ld seconds.",
-                        time_elapsed.tv_sec, time_elapsed.tv_usec / 100000);
-        }
-        else
+        if (error == NULL && !g_atomic_int_get (&data->failed))
+                db_writer_execute (data, SQL_INSERT_SEARCH, &error);
+
+        if (error == NULL && !g_atomic_int_get (&data->failed))
+                db_writer_execute (data, "COMMIT TRANSACTION", &error);
+        else if (data->connection != NULL)
+                sqlite3_exec (
+                        data->connection, "ROLLBACK TRANSACTION",
+                        NULL, NULL, NULL);
+
+        db_writer_close (data);
+
+        if (error != NULL)
         {
-                gva_db_transaction_rollback (&error);
-                gva_error_handle (&error);
+                g_atomic_int_set (&data->failed, TRUE);
+                data->writer_error = error;
         }
 
-        db_parser_data_free (data);
+        /* Leave the live database as it was. */
+        if (g_atomic_int_get (&data->failed))
+                g_unlink (db_get_shadow_filename ());
+
+        /* Let the main thread install the new database. */
+        g_idle_add_full (
+                G_PRIORITY_DEFAULT_IDLE,
+                (GSourceFunc) db_parser_finish_idle_cb,
+                db_parser_data_ref (data),
+                (GDestroyNotify) db_parser_data_unref);
+
+        return NULL;
 }
 
 static gboolean
-db_create_tables (GError **error)
+db_parser_start (ParserData *data,
+                 GError **error)
 {
-        return gva_db_execute (SQL_CREATE_TABLE_MAME, error)
-                && gva_db_execute (SQL_CREATE_TABLE_GAME, error)
-                && gva_db_execute (SQL_CREATE_TABLE_ADJUSTER, error)
-                && gva_db_execute (SQL_CREATE_TABLE_BIOSSET, error)
-                && gva_db_execute (SQL_CREATE_TABLE_ROM, error)
-                && gva_db_execute (SQL_CREATE_TABLE_DISK, error)
-                && gva_db_execute (SQL_CREATE_TABLE_SAMPLE, error)
-                && gva_db_execute (SQL_CREATE_TABLE_CHIP, error)
-                && gva_db_execute (SQL_CREATE_TABLE_CONFSETTING, error)
-                && gva_db_execute (SQL_CREATE_TABLE_DISPLAY, error)
-                && gva_db_execute (SQL_CREATE_TABLE_CONTROL, error)
-                && gva_db_execute (SQL_CREATE_TABLE_DIPVALUE, error)
-                && gva_db_execute (SQL_CREATE_TABLE_LASTPLAYED, error)
-                && gva_db_execute (SQL_CREATE_TABLE_PLAYBACK, error)
-                && gva_db_execute (SQL_CREATE_TABLE_WINDOW, error)
-                && gva_db_execute (SQL_CREATE_VIEW_AVAILABLE, error);
+        data->parser_thread = g_thread_create (
+                (GThreadFunc) db_parser_thread, data, TRUE, error);
+        if (data->parser_thread == NULL)
+                return FALSE;
+
+        /* The writer thread finishes the build once it's running,
+         * so start it last. */
+        data->writer_thread = g_thread_create (
+                (GThreadFunc) db_writer_thread, data, TRUE, error);
+        if (data->writer_thread == NULL)
+        {
+                DbBatch *batch;
+
+                /* Make the parser thread abandon the cache and exit,
+                 * and take the writer thread's place until it does. */
+                g_atomic_int_set (&data->failed, TRUE);
+                if (data->replay_stream == NULL)
+                        db_queue_push (data->chunk_queue, NULL);
+                while ((batch = db_queue_pop (data->batch_queue)) != NULL)
+                        db_batch_free (batch);
+                g_thread_join (data->parser_thread);
+                return FALSE;
+        }
+
+        data->progress_source_id = g_timeout_add (
+                PROGRESS_INTERVAL,
+                (GSourceFunc) db_parser_progress_cb, data);
+
+        return TRUE;
 }
 
 static void
-db_function_isfavorite (sqlite3_context *context,
-                        gint n_values,
-                        sqlite3_value **values)
+db_parser_exit (GvaProcess *process,
+                gint status,
+                ParserData *data)
 {
-        const gchar *name;
+        const gchar *buffer;
+        gsize length;
 
-        g_assert (n_values == 1);
+        /* Report the process' error as the build's. */
+        if (process->error != NULL)
+        {
+                g_atomic_int_set (&data->failed, TRUE);
+                g_propagate_error (&data->error, process->error);
+                process->error = NULL;
+        }
 
-        name = (const gchar *) sqlite3_value_text (values[0]);
-        if (gva_favorites_contains (name))
-                sqlite3_result_text (context, "yes", -1, SQLITE_STATIC);
-        else
-                sqlite3_result_text (context, "no", -1, SQLITE_STATIC);
+        /* The main thread sees the exit status before the parser thread
+         * sees the end of the stream, through the queue's lock. */
+        data->exit_status = status;
+
+        /* Hand off whatever is left in the ring buffer,
+         * regardless of how far behind the parser thread is. */
+        while ((length = gva_process_stdout_peek (process, &buffer)) > 0)
+        {
+                if (!g_atomic_int_get (&data->failed))
+                        db_parser_push_chunk (data, buffer, length);
+                gva_process_stdout_consume (process, length);
+        }
+
+        /* Signal the end of the stream.  The writer thread still has
+         * to index the new database and commit it, which takes a while,
+         * so let it tell us when it's done instead of waiting here. */
+        db_queue_push (data->chunk_queue, NULL);
+        data->finished = TRUE;
 }
 
-static void
-db_function_match (sqlite3_context *context,
-                   gint n_values,
-                   sqlite3_value **values)
+/* Columns added to the game table since the database was built
+ * are missing until a full build recreates it. */
+static gboolean
+db_game_table_is_current (void)
 {
-        const gchar *text1;
-        const gchar *text2;
-        gboolean match = FALSE;
+        sqlite3_stmt *stmt;
+        gint errcode;
 
-        g_assert (n_values == 2);
+        errcode = sqlite3_prepare_v2 (
+                db, "SELECT description_key, manufacturer_key FROM game",
+                -1, &stmt, NULL);
+        sqlite3_finalize (stmt);
 
-        /* XXX Note the operands are not in the order one might think.
-         *     Still trying to find some documentation to confirm this. */
+        return (errcode == SQLITE_OK);
+}
 
-        text1 = (const gchar *) sqlite3_value_text (values[1]);
-        text2 = (const gchar *) sqlite3_value_text (values[0]);
+/* Native audits check ROM sets against the rom and disk tables,
+ * which builds otherwise leave empty. */
+static gboolean
+db_wants_sets (void)
+{
+        GSettings *settings;
 
-        if (text1 != NULL && text2 != NULL)
-        {
-                gchar *s1, *s2;
+        settings = gva_get_settings ();
 
-                s1 = gva_search_collate_key (text1);
-                s2 = gva_search_collate_key (text2);
+        return g_settings_get_boolean (settings, GVA_SETTING_AUDIT_NATIVE);
+}
+
+/* Whether the last build filled in the rom and disk tables.  Databases
+ * built before the "sets" column was added don't say, so they didn't. */
+static gboolean
+db_has_sets (void)
+{
+        sqlite3_stmt *stmt;
+        gboolean has_sets = FALSE;
+        gint errcode;
 
-                match = (strstr (s1, s2) != NULL);
+        errcode = sqlite3_prepare_v2 (
+                db, "SELECT build FROM mame WHERE sets = 'yes'",
+                -1, &stmt, NULL);
+        if (errcode == SQLITE_OK)
+                has_sets = (sqlite3_step (stmt) == SQLITE_ROW);
+        sqlite3_finalize (stmt);
 
-                g_free (s1);
-                g_free (s2);
-        }
+        return has_sets;
+}
 
-        sqlite3_result_int (context, match);
+/* The table layout may differ between versions. */
+static gboolean
+db_layout_is_current (void)
+{
+        const gchar *last_version;
+
+        last_version = gva_get_last_version ();
+        if (last_version == NULL || strcmp (last_version, PACKAGE_VERSION) != 0)
+                return FALSE;
+
+        return db_game_table_is_current ();
+}
+
+static gboolean
+db_can_update (void)
+{
+        gint rows = 0;
+        GError *error = NULL;
+
+        if (opt_build_database)
+                return FALSE;
+
+        if (!db_layout_is_current ())
+                return FALSE;
+
+        /* Unchanged games would be left without ROM sets. */
+        if (db_wants_sets () && !db_has_sets ())
+                return FALSE;
+
+        /* We need digests from a previous build to compare with. */
+        gva_db_get_table (
+                "SELECT name FROM gamehash LIMIT 1",
+                NULL, &rows, NULL, &error);
+        gva_error_handle (&error);
+
+        return (rows > 0);
+}
+
+static gboolean
+db_create_tables (GError **error)
+{
+        return gva_db_execute (SQL_CREATE_TABLES, error) &&
+                db_create_search_table (db, error);
 }
 
 static void
-db_trace_cb (gpointer unused, const gchar *message)
+db_function_isfavorite (sqlite3_context *context,
+                        gint n_values,
+                        sqlite3_value **values)
 {
-        g_log (G_LOG_DOMAIN, GVA_DEBUG_SQL, "%s", message);
+        const gchar *name;
+
+        g_assert (n_values == 1);
+
+        name = (const gchar *) sqlite3_value_text (values[0]);
+        if (gva_favorites_contains (name))
+                sqlite3_result_text (context, "yes", -1, SQLITE_STATIC);
+        else
+                sqlite3_result_text (context, "no", -1, SQLITE_STATIC);
 }
 
-/**
- * gva_db_init:
- * @error: return location for a #GError, or %NULL
- *
- * Opens the games database and creates the tables if they do not already
- * exist.  If an error occurs, it returns %FALSE and sets @error.
- *
- * This function should be called once when the application starts.
- *
- * Returns: %TRUE on success, %FALSE if an error occurred
- **/
-gboolean
-gva_db_init (GError **error)
+#define EXPLAIN_PREFIX "EXPLAIN QUERY PLAN "
+
+/* Tables other than "game" are only ever queried one game at a time,
+ * so a full scan of one means a statement can't use our indexes.  The
+ * "game" table gets listed in full all the time, but a statement that
+ * picks out games by name, clone or parent should use an index too.
+ * Returns the SQL following the statement, or NULL to stop checking. */
+static const gchar *
+db_check_statement_plan (const gchar *sql)
 {
-        const gchar *filename;
+        static GRegex *regex;
+        sqlite3_stmt *stmt;
+        const gchar *tail;
+        gchar *statement;
+        gchar *explain;
+        gboolean filters_games;
+        gsize length;
         gint errcode;
 
-        g_return_val_if_fail (db == NULL, FALSE);
+        if (G_UNLIKELY (regex == NULL))
+                regex = g_regex_new (
+                        "\\bWHERE\\b.*\\b(name|cloneof|romof)\\b",
+                        G_REGEX_CASELESS | G_REGEX_DOTALL, 0, NULL);
 
-        filename = gva_db_get_filename ();
+        explain = g_strconcat (EXPLAIN_PREFIX, sql, NULL);
+        errcode = sqlite3_prepare_v2 (db, explain, -1, &stmt, &tail);
 
-        if (sqlite3_open (filename, &db) != SQLITE_OK)
-                goto fail;
+        /* Stop at the end of the SQL, or at a statement we can't
+         * prepare yet because it uses a table created before it. */
+        if (errcode != SQLITE_OK || stmt == NULL)
+        {
+                g_free (explain);
+                return NULL;
+        }
 
-        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
-                sqlite3_trace (db, db_trace_cb, NULL);
+        length = tail - explain - strlen (EXPLAIN_PREFIX);
+        statement = g_strstrip (g_strndup (sql, length));
+        g_free (explain);
 
-        errcode = sqlite3_create_function (
-                db, "isfavorite", 1, SQLITE_ANY, NULL,
-                db_function_isfavorite, NULL, NULL);
-        if (errcode != SQLITE_OK)
-                goto fail;
+        filters_games = g_regex_match (regex, statement, 0, NULL);
 
-        errcode = sqlite3_create_function (
-                db, "match", 2, SQLITE_ANY, NULL,
-                db_function_match, NULL, NULL);
-        if (errcode != SQLITE_OK)
-                goto fail;
+        while (sqlite3_step (stmt) == SQLITE_ROW)
+        {
+                const gchar *detail;
+                gint ii;
+
+                /* The last column describes the step.  Older versions
+                 * of SQLite say "SCAN TABLE x", newer ones "SCAN x". */
+                detail = (const gchar *) sqlite3_column_text (
+                        stmt, sqlite3_column_count (stmt) - 1);
+                if (detail == NULL || !g_str_has_prefix (detail, "SCAN "))
+                        continue;
+                detail += strlen ("SCAN ");
+                if (g_str_has_prefix (detail, "TABLE "))
+                        detail += strlen ("TABLE ");
 
-        return db_create_tables (error);
+                for (ii = DB_TABLE_GAME; ii < DB_NUM_TABLES; ii++)
+                {
+                        gsize name_length;
+
+                        if (ii == DB_TABLE_GAME && !filters_games)
+                                continue;
+                        name_length = strlen (db_tables[ii].name);
+                        if (strncmp (detail, db_tables[ii].name,
+                                name_length) != 0)
+                                continue;
+                        if (detail[name_length] != '\0' &&
+                                detail[name_length] != ' ')
+                                continue;
+                        g_warning (
+                                "SQL statement scans the %s table: %s",
+                                db_tables[ii].name, statement);
+                }
+        }
 
-fail:
-        gva_db_set_error (error, 0, NULL);
-        sqlite3_close (db);
-        db = NULL;
+        sqlite3_finalize (stmt);
+        g_free (statement);
 
-        return FALSE;
+        return sql + length;
 }
 
-/**
- * gva_db_build:
- * @error: return location for a #GError, or %NULL
- *
- * Begins the lengthy process of populating the games database and returns a
- * #GvaProcess to track it.  The database is populated by parsing detailed
- * game information generated by MAME.  If an error occurs while starting the
- * parsing process, it returns %NULL and sets @error.
- *
- * Returns: a new #GvaProcess, or %NULL
- **/
-GvaProcess *
-gva_db_build (GError **error)
+static void
+db_check_query_plan (const gchar *sql)
 {
-        GvaProcess *process;
-        ParserData *data;
-        gchar *filename;
-
-        g_return_val_if_fail (db != NULL, NULL);
+        /* Check each statement in turn. */
+        while (sql != NULL && *sql != '\0')
+                sql = db_check_statement_plan (sql);
+}
 
-        /* Initialize the list of canonical names. */
+/* Initializes the list of canonical names. */
+static void
+db_init_intern (void)
+{
         intern.adjuster      = g_intern_static_string ("adjuster");
         intern.aspectx       = g_intern_static_string ("aspectx");
         intern.aspecty       = g_intern_static_string ("aspecty");
@@ -1830,9 +4427,112 @@ gva_db_build (GError **error)
         intern.vtotal        = g_intern_static_string ("vtotal");
         intern.width         = g_intern_static_string ("width");
         intern.year          = g_intern_static_string ("year");
+}
+
+/**
+ * gva_db_init:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Opens the games database and creates the tables if they do not already
+ * exist.  If an error occurs, it returns %FALSE and sets @error.
+ *
+ * This function should be called once when the application starts.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_init (GError **error)
+{
+        const gchar *filename;
+        gint errcode;
+
+        g_return_val_if_fail (db == NULL, FALSE);
+
+        db_init_intern ();
+
+        filename = gva_db_get_filename ();
+
+        if (sqlite3_open (filename, &db) != SQLITE_OK)
+                goto fail;
+
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                sqlite3_trace (db, db_trace_cb, NULL);
+
+        errcode = sqlite3_create_function (
+                db, "isfavorite", 1, SQLITE_ANY, NULL,
+                db_function_isfavorite, NULL, NULL);
+        if (errcode != SQLITE_OK)
+                goto fail;
 
-        if (!gva_db_reset (error))
-                return NULL;
+        return db_create_tables (error);
+
+fail:
+        gva_db_set_error (error, 0, NULL);
+        sqlite3_close (db);
+        db = NULL;
+
+        return FALSE;
+}
+
+/**
+ * gva_db_build_async:
+ * @progress_callback: a #GvaDbProgressFunc, or %NULL
+ * @progress_data: data to pass to @progress_callback
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the build is finished
+ * @user_data: data to pass to @callback
+ *
+ * Begins the lengthy process of populating the games database.  The
+ * database is populated by parsing detailed game information generated by
+ * MAME.  MAME's output is cached, and the cache is read back instead of
+ * running MAME again if the MAME executable has not changed.  The number
+ * of games written so far is passed to @progress_callback from time to
+ * time.  Cancelling @cancellable stops the build and leaves the games
+ * database as it was.
+ *
+ * The build finishes once the new database is indexed and installed.
+ * When the build is finished, @callback will be called.  You can then
+ * call gva_db_build_finish() to get the result of the build.
+ *
+ * If the database already holds a build from this version of
+ * <emphasis>GNOME Video Arcade</emphasis>, only games that were added,
+ * changed or removed since then are written, and audit results for the
+ * other games are kept.  Games that need auditing afterward are listed by
+ * gva_db_get_unaudited().
+ *
+ * The new build is written to a separate file that replaces the games
+ * database only once the build succeeds, so the database remains usable
+ * while the build is in progress.  Replacing the database discards its
+ * temporary tables, so the build waits for audits in progress to finish
+ * before replacing it.
+ **/
+void
+gva_db_build_async (GvaDbProgressFunc progress_callback,
+                    gpointer progress_data,
+                    GCancellable *cancellable,
+                    GAsyncReadyCallback callback,
+                    gpointer user_data)
+{
+        GvaProcess *process = NULL;
+        GInputStream *replay_stream = NULL;
+        GSimpleAsyncResult *simple;
+        ParserData *data;
+        gchar *filename;
+        gchar *cache_key;
+        gboolean incremental;
+        GError *error = NULL;
+
+        g_return_if_fail (db != NULL);
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data, gva_db_build_async);
+
+        /* If the database holds a previous build, apply only the
+         * differences so audit results for unchanged games survive. */
+        incremental = db_can_update ();
+
+        /* Remove a shadow database left behind by a crashed build. */
+        g_unlink (db_get_shadow_filename ());
 
         /* LEGACY: In version 0.7.0, the database file was moved from
          * $(XDG_DATA_HOME)/applications/gnome-video-arcade/games.db to
@@ -1850,27 +4550,111 @@ gva_db_build (GError **error)
         }
         g_free (filename);
 
-        process = gva_mame_list_xml (error);
-        if (process == NULL)
-                return NULL;
+        /* Replay the cached MAME output if the MAME executable is the
+         * same one that produced it.  Otherwise run MAME and cache its
+         * output as we go. */
+        cache_key = db_cache_get_key ();
+        if (cache_key != NULL)
+                replay_stream = db_cache_replay (cache_key);
 
-        if (!gva_db_transaction_begin (error))
+        if (replay_stream == NULL)
         {
-                g_object_unref (process);
-                return NULL;
+                process = gva_mame_list_xml (&error);
+                if (process == NULL)
+                        goto fail;
+
+                gva_process_set_stream_mode (process, LISTXML_BUFFER_SIZE);
         }
 
+        /* The writer thread opens its own connection and transaction,
+         * so the main thread stays free to service the user interface
+         * and the process' pipes. */
         data = db_parser_data_new (process);
+        data->incremental = incremental;
+        data->store_sets = db_wants_sets ();
+        data->replay = (replay_stream != NULL);
+        data->replay_stream = replay_stream;
+        data->progress_callback = progress_callback;
+        data->progress_data = progress_data;
+        data->simple = g_object_ref (simple);
+        data->timer = g_timer_new ();
+
+        if (cancellable != NULL)
+                data->cancellable = g_object_ref (cancellable);
+
+        if (process != NULL && cache_key != NULL)
+                db_cache_begin (data, cache_key);
+
+        if (!db_parser_start (data, &error))
+        {
+                db_parser_data_unref (data);
+                goto fail;
+        }
 
-        g_signal_connect (
-                process, "stdout-ready",
-                G_CALLBACK (db_parser_read), data);
+        if (process != NULL)
+        {
+                g_signal_connect (
+                        process, "data-ready",
+                        G_CALLBACK (db_parser_read), data);
 
-        g_signal_connect (
-                process, "exited",
-                G_CALLBACK (db_parser_exit), data);
+                g_signal_connect (
+                        process, "exited",
+                        G_CALLBACK (db_parser_exit), data);
 
-        return process;
+                g_object_unref (process);
+        }
+
+        if (cancellable != NULL)
+                data->cancelled_id = g_cancellable_connect (
+                        cancellable, G_CALLBACK (db_parser_cancelled_cb),
+                        data, (GDestroyNotify) NULL);
+
+        g_object_unref (simple);
+        g_free (cache_key);
+
+        return;
+
+fail:
+        /* Don't leave MAME blocked on a pipe nobody reads. */
+        if (process != NULL)
+        {
+                gva_process_kill (process);
+                g_object_unref (process);
+        }
+
+        g_simple_async_result_take_error (simple, error);
+        g_simple_async_result_complete_in_idle (simple);
+        g_object_unref (simple);
+        g_free (cache_key);
+}
+
+/**
+ * gva_db_build_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes a build started with gva_db_build_async().  If the build failed or
+ * was aborted, it returns %FALSE and sets @error, and the games database
+ * is left as it was.
+ *
+ * Returns: %TRUE if the new database was installed, %FALSE otherwise
+ **/
+gboolean
+gva_db_build_finish (GAsyncResult *result,
+                     GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_db_build_async), FALSE);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return FALSE;
+
+        return g_simple_async_result_get_op_res_gboolean (simple);
 }
 
 /**
@@ -1916,6 +4700,9 @@ gva_db_execute (const gchar *sql,
         g_return_val_if_fail (db != NULL, FALSE);
         g_return_val_if_fail (sql != NULL, FALSE);
 
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                db_check_query_plan (sql);
+
         errcode = sqlite3_exec (db, sql, NULL, NULL, &errmsg);
 
         if (errcode != SQLITE_OK)
@@ -1960,6 +4747,9 @@ gva_db_get_table (const gchar *sql,
         g_return_val_if_fail (db != NULL, FALSE);
         g_return_val_if_fail (sql != NULL, FALSE);
 
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                db_check_query_plan (sql);
+
         errcode = sqlite3_get_table (
                 db, sql, &table, &local_rows, &local_columns, &errmsg);
 
@@ -1979,91 +4769,422 @@ gva_db_get_table (const gchar *sql,
         }
         else
         {
-                gva_db_set_error (error, errcode, errmsg);
-                sqlite3_free (errmsg);
+                gva_db_set_error (error, errcode, errmsg);
+                sqlite3_free (errmsg);
+        }
+
+        if (rows != NULL)
+                *rows = local_rows;
+        if (columns != NULL)
+                *columns = local_columns;
+
+        return (errcode == SQLITE_OK);
+}
+
+/**
+ * gva_db_transaction_begin:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Convenience function begins a database transaction.  If an error occurs,
+ * it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_transaction_begin (GError **error)
+{
+        return gva_db_execute ("BEGIN TRANSACTION", error);
+}
+
+/**
+ * gva_db_transaction_commit:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Convenience function commits a database transaction.  If an error occurs,
+ * it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_transaction_commit (GError **error)
+{
+        return gva_db_execute ("COMMIT TRANSACTION", error);
+}
+
+/**
+ * gva_db_transaction_rollback:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Convenience function rolls back a database transaction.  If an error
+ * occurs, it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_transaction_rollback (GError **error)
+{
+        return gva_db_execute ("ROLLBACK TRANSACTION", error);
+}
+
+/**
+ * gva_db_prepare:
+ * @sql: an SQL statement
+ * @stmt: return location for a compiled statement handle
+ * @error: return location for a #GError, or %NULL
+ *
+ * Compiles the given SQL statement and assigns the resulting statement
+ * handle to *@stmt.  If an error occurs, it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_prepare (const gchar *sql,
+                sqlite3_stmt **stmt,
+                GError **error)
+{
+        gint errcode;
+
+        g_return_val_if_fail (db != NULL, FALSE);
+        g_return_val_if_fail (sql != NULL, FALSE);
+        g_return_val_if_fail (stmt != NULL, FALSE);
+
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                db_check_query_plan (sql);
+
+        errcode = sqlite3_prepare_v2 (db, sql, -1, stmt, NULL);
+
+        if (errcode != SQLITE_OK)
+                gva_db_set_error (error, 0, NULL);
+
+        return (errcode == SQLITE_OK);
+}
+
+static DbSelect *
+db_select_ref (DbSelect *query)
+{
+        g_atomic_int_inc (&query->ref_count);
+
+        return query;
+}
+
+static void
+db_select_unref (DbSelect *query)
+{
+        gchar **names;
+
+        if (!g_atomic_int_dec_and_test (&query->ref_count))
+                return;
+
+        while ((names = g_queue_pop_head (&query->batches)) != NULL)
+                g_strfreev (names);
+
+        if (query->cancellable != NULL)
+                g_object_unref (query->cancellable);
+
+        if (query->error != NULL)
+                g_error_free (query->error);
+
+        g_object_unref (query->simple);
+        g_hash_table_destroy (query->favorites);
+        g_mutex_free (query->mutex);
+        g_free (query->sql);
+
+        g_slice_free (DbSelect, query);
+}
+
+static void
+db_select_function_isfavorite (sqlite3_context *context,
+                               gint n_values,
+                               sqlite3_value **values)
+{
+        GHashTable *favorites;
+        const gchar *name;
+
+        g_assert (n_values == 1);
+
+        favorites = sqlite3_user_data (context);
+        name = (const gchar *) sqlite3_value_text (values[0]);
+
+        if (name != NULL && g_hash_table_lookup (favorites, name) != NULL)
+                sqlite3_result_text (context, "yes", -1, SQLITE_STATIC);
+        else
+                sqlite3_result_text (context, "no", -1, SQLITE_STATIC);
+}
+
+static gboolean
+db_select_idle_cb (DbSelect *query)
+{
+        GSimpleAsyncResult *simple;
+        gboolean finished = FALSE;
+
+        /* Keep idle_pending set until the queue is empty, so the
+         * query thread does not schedule another idle callback
+         * while the names callback runs the main loop. */
+        while (TRUE)
+        {
+                gchar **names;
+
+                g_mutex_lock (query->mutex);
+                names = g_queue_pop_head (&query->batches);
+                if (names == NULL)
+                {
+                        query->idle_pending = FALSE;
+                        finished = query->finished;
+                }
+                g_mutex_unlock (query->mutex);
+
+                if (names == NULL)
+                        break;
+
+                /* Drop batches that arrive after a cancellation. */
+                if (!g_cancellable_is_cancelled (query->cancellable))
+                        query->names_callback (names, query->names_data);
+
+                g_strfreev (names);
+        }
+
+        if (!finished)
+                return FALSE;
+
+        simple = query->simple;
+
+        if (query->error != NULL)
+                g_simple_async_result_set_from_error (simple, query->error);
+        else
+        {
+                GError *error = NULL;
+
+                if (g_cancellable_set_error_if_cancelled (
+                        query->cancellable, &error))
+                        g_simple_async_result_take_error (simple, error);
+        }
+
+        g_simple_async_result_complete (simple);
+
+        return FALSE;
+}
+
+/* Hands a batch of names, or the end of the query if @names is %NULL,
+ * over to the main thread. */
+static void
+db_select_push (DbSelect *query,
+                gchar **names)
+{
+        g_mutex_lock (query->mutex);
+
+        if (names != NULL)
+                g_queue_push_tail (&query->batches, names);
+        else
+                query->finished = TRUE;
+
+        if (!query->idle_pending)
+        {
+                query->idle_pending = TRUE;
+                g_idle_add_full (
+                        G_PRIORITY_DEFAULT_IDLE,
+                        (GSourceFunc) db_select_idle_cb,
+                        db_select_ref (query),
+                        (GDestroyNotify) db_select_unref);
+        }
+
+        g_mutex_unlock (query->mutex);
+}
+
+static void
+db_select_cancelled_cb (GCancellable *cancellable,
+                        DbSelect *query)
+{
+        /* Makes the statement in progress fail with SQLITE_INTERRUPT. */
+        sqlite3_interrupt (query->connection);
+}
+
+static gpointer
+db_select_thread (DbSelect *query)
+{
+        sqlite3_stmt *stmt = NULL;
+        GPtrArray *batch;
+        gulong cancelled_id = 0;
+        gboolean first = TRUE;
+        gint errcode;
+
+        batch = g_ptr_array_new ();
+
+        errcode = sqlite3_open_v2 (
+                gva_db_get_filename (), &query->connection,
+                SQLITE_OPEN_READONLY, NULL);
+        if (errcode != SQLITE_OK)
+                goto exit;
+
+        if (gva_get_debug_flags () & GVA_DEBUG_SQL)
+                sqlite3_trace (query->connection, db_trace_cb, NULL);
+
+        errcode = sqlite3_create_function (
+                query->connection, "isfavorite", 1, SQLITE_ANY,
+                query->favorites, db_select_function_isfavorite,
+                NULL, NULL);
+        if (errcode != SQLITE_OK)
+                goto exit;
+
+        /* The main connection may be writing audit results. */
+        sqlite3_busy_timeout (query->connection, 10000);
+
+        errcode = sqlite3_prepare_v2 (
+                query->connection, query->sql, -1, &stmt, NULL);
+        if (errcode != SQLITE_OK)
+                goto exit;
+
+        /* This runs the callback right away if already cancelled. */
+        if (query->cancellable != NULL)
+                cancelled_id = g_cancellable_connect (
+                        query->cancellable,
+                        G_CALLBACK (db_select_cancelled_cb),
+                        query, NULL);
+
+        while (!g_cancellable_is_cancelled (query->cancellable) &&
+               (errcode = sqlite3_step (stmt)) == SQLITE_ROW)
+        {
+                const gchar *name;
+
+                name = (const gchar *) sqlite3_column_text (stmt, 0);
+                if (name == NULL)
+                        continue;
+
+                g_ptr_array_add (batch, g_strdup (name));
+
+                if (first || batch->len >= SELECT_BATCH_SIZE)
+                {
+                        g_ptr_array_add (batch, NULL);
+                        db_select_push (
+                                query, (gchar **)
+                                g_ptr_array_free (batch, FALSE));
+                        batch = g_ptr_array_new ();
+                        first = FALSE;
+                }
+        }
+
+        /* Wait for a running cancellation handler before
+         * the connection it interrupts goes away. */
+        if (cancelled_id > 0)
+                g_cancellable_disconnect (query->cancellable, cancelled_id);
+
+exit:
+        if (errcode != SQLITE_DONE &&
+                !g_cancellable_is_cancelled (query->cancellable))
+                gva_db_set_error (
+                        &query->error,
+                        sqlite3_errcode (query->connection),
+                        sqlite3_errmsg (query->connection));
+
+        if (batch->len > 0)
+        {
+                g_ptr_array_add (batch, NULL);
+                db_select_push (
+                        query, (gchar **) g_ptr_array_free (batch, FALSE));
         }
+        else
+                g_ptr_array_free (batch, TRUE);
 
-        if (rows != NULL)
-                *rows = local_rows;
-        if (columns != NULL)
-                *columns = local_columns;
+        sqlite3_finalize (stmt);
+        sqlite3_close (query->connection);
+        query->connection = NULL;
 
-        return (errcode == SQLITE_OK);
-}
+        db_select_push (query, NULL);
+        db_select_unref (query);
 
-/**
- * gva_db_transaction_begin:
- * @error: return location for a #GError, or %NULL
- *
- * Convenience function begins a database transaction.  If an error occurs,
- * it returns %FALSE and sets @error.
- *
- * Returns: %TRUE on success, %FALSE if an error occurred
- **/
-gboolean
-gva_db_transaction_begin (GError **error)
-{
-        return gva_db_execute ("BEGIN TRANSACTION", error);
+        return NULL;
 }
 
 /**
- * gva_db_transaction_commit:
- * @error: return location for a #GError, or %NULL
+ * gva_db_select_names_async:
+ * @sql: an SQL query whose first column is a game name
+ * @names_callback: function to receive the names as they are found
+ * @names_data: data to pass to @names_callback
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the query is finished
+ * @user_data: data to pass to @callback
  *
- * Convenience function commits a database transaction.  If an error occurs,
- * it returns %FALSE and sets @error.
+ * Runs @sql on a separate connection to the games database in a
+ * background thread, so the user interface stays responsive however
+ * long the query takes.  The names in the first column of the result
+ * are passed to @names_callback in the main thread, in batches, as
+ * they are found.  Cancelling @cancellable interrupts the query, and
+ * no more batches are passed along after that.
  *
- * Returns: %TRUE on success, %FALSE if an error occurred
+ * When the query is finished, @callback will be called.  You can then
+ * call gva_db_select_names_finish() to get the result of the operation.
  **/
-gboolean
-gva_db_transaction_commit (GError **error)
+void
+gva_db_select_names_async (const gchar *sql,
+                           GvaDbNamesFunc names_callback,
+                           gpointer names_data,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
 {
-        return gva_db_execute ("COMMIT TRANSACTION", error);
-}
+        DbSelect *query;
+        GList *list;
+        GError *error = NULL;
 
-/**
- * gva_db_transaction_rollback:
- * @error: return location for a #GError, or %NULL
- *
- * Convenience function rolls back a database transaction.  If an error
- * occurs, it returns %FALSE and sets @error.
- *
- * Returns: %TRUE on success, %FALSE if an error occurred
- **/
-gboolean
-gva_db_transaction_rollback (GError **error)
-{
-        return gva_db_execute ("ROLLBACK TRANSACTION", error);
+        g_return_if_fail (sql != NULL);
+        g_return_if_fail (names_callback != NULL);
+
+        query = g_slice_new0 (DbSelect);
+        query->ref_count = 1;
+        query->sql = g_strdup (sql);
+        query->names_callback = names_callback;
+        query->names_data = names_data;
+        query->mutex = g_mutex_new ();
+        g_queue_init (&query->batches);
+
+        query->simple = g_simple_async_result_new (
+                NULL, callback, user_data, gva_db_select_names_async);
+
+        if (cancellable != NULL)
+                query->cancellable = g_object_ref (cancellable);
+
+        /* The favorites are interned strings. */
+        query->favorites = g_hash_table_new (g_str_hash, g_str_equal);
+        list = gva_favorites_copy ();
+        while (list != NULL)
+        {
+                g_hash_table_insert (
+                        query->favorites, list->data, list->data);
+                list = g_list_delete_link (list, list);
+        }
+
+        if (g_thread_create (
+                (GThreadFunc) db_select_thread,
+                query, FALSE, &error) == NULL)
+        {
+                g_simple_async_result_take_error (query->simple, error);
+                g_simple_async_result_complete_in_idle (query->simple);
+                db_select_unref (query);
+        }
 }
 
 /**
- * gva_db_prepare:
- * @sql: an SQL statement
- * @stmt: return location for a compiled statement handle
+ * gva_db_select_names_finish:
+ * @result: a #GAsyncResult
  * @error: return location for a #GError, or %NULL
  *
- * Compiles the given SQL statement and assigns the resulting statement
- * handle to *@stmt.  If an error occurs, it returns %FALSE and sets @error.
+ * Finishes an operation started with gva_db_select_names_async().  If
+ * the query failed or was cancelled, it returns %FALSE and sets @error.
  *
- * Returns: %TRUE on success, %FALSE if an error occurred
+ * Returns: %TRUE if the query ran to completion, %FALSE otherwise
  **/
 gboolean
-gva_db_prepare (const gchar *sql,
-                sqlite3_stmt **stmt,
-                GError **error)
+gva_db_select_names_finish (GAsyncResult *result,
+                            GError **error)
 {
-        gint errcode;
-
-        g_return_val_if_fail (db != NULL, FALSE);
-        g_return_val_if_fail (sql != NULL, FALSE);
-        g_return_val_if_fail (stmt != NULL, FALSE);
+        GSimpleAsyncResult *simple;
 
-        errcode = sqlite3_prepare_v2 (db, sql, -1, stmt, NULL);
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_db_select_names_async), FALSE);
 
-        if (errcode != SQLITE_OK)
-                gva_db_set_error (error, 0, NULL);
+        simple = G_SIMPLE_ASYNC_RESULT (result);
 
-        return (errcode == SQLITE_OK);
+        return !g_simple_async_result_propagate_error (simple, error);
 }
 
 static gint
@@ -2189,6 +5310,352 @@ gva_db_mark_complete (GError **error)
         return gva_db_execute ("UPDATE mame SET complete='yes'", error);
 }
 
+/**
+ * gva_db_get_unaudited:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns the names of games whose ROM and sample sets have not been
+ * audited since gva_db_build_async() added or changed them, or since
+ * gva_audit_detect_changes_async() found changes to their files, as a
+ * %NULL-terminated string array.  If an error occurs, it returns %NULL
+ * and sets @error.
+ *
+ * Use g_strfreev() to free the return value.
+ *
+ * Returns: a %NULL-terminated array of game names, or %NULL
+ **/
+gchar **
+gva_db_get_unaudited (GError **error)
+{
+        GPtrArray *names;
+        sqlite3_stmt *stmt;
+        gint errcode;
+
+        if (!gva_db_prepare ("SELECT name FROM unaudited", &stmt, error))
+                return NULL;
+
+        names = g_ptr_array_new ();
+
+        while ((errcode = sqlite3_step (stmt)) == SQLITE_ROW)
+                g_ptr_array_add (
+                        names, g_strdup ((gchar *)
+                        sqlite3_column_text (stmt, 0)));
+
+        if (errcode != SQLITE_DONE)
+        {
+                gva_db_set_error (error, 0, NULL);
+                g_ptr_array_foreach (names, (GFunc) g_free, NULL);
+                g_ptr_array_free (names, TRUE);
+                sqlite3_finalize (stmt);
+                return NULL;
+        }
+
+        sqlite3_finalize (stmt);
+
+        g_ptr_array_add (names, NULL);
+
+        return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
+/**
+ * gva_db_clear_unaudited:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Empties the list of games returned by gva_db_get_unaudited().  Call
+ * this after auditing those games.
+ *
+ * Returns: %TRUE if the database was successfully updated
+ **/
+gboolean
+gva_db_clear_unaudited (GError **error)
+{
+        return gva_db_execute ("DELETE FROM unaudited", error);
+}
+
+/**
+ * gva_db_get_emulator:
+ * @path: filename of the MAME executable
+ * @fingerprint: return location for the fingerprint
+ * @version: return location for the MAME version, or %NULL
+ * @showconfig: return location for the "-showconfig" output
+ *
+ * Looks up what was last recorded about the MAME executable at @path
+ * by gva_db_set_emulator().  The version may be %NULL if MAME did not
+ * report one.  Returns %FALSE if nothing is recorded or the database
+ * is not open yet.
+ *
+ * Returns: %TRUE if a record for @path was found
+ **/
+gboolean
+gva_db_get_emulator (const gchar *path,
+                     gchar **fingerprint,
+                     gchar **version,
+                     gchar **showconfig)
+{
+        const gchar *sql =
+                "SELECT fingerprint, version, showconfig "
+                "FROM emulator WHERE path = ?";
+        sqlite3_stmt *stmt;
+        gboolean found = FALSE;
+        GError *error = NULL;
+
+        g_return_val_if_fail (path != NULL, FALSE);
+        g_return_val_if_fail (fingerprint != NULL, FALSE);
+        g_return_val_if_fail (version != NULL, FALSE);
+        g_return_val_if_fail (showconfig != NULL, FALSE);
+
+        if (db == NULL)
+                return FALSE;
+
+        if (!gva_db_prepare (sql, &stmt, &error))
+        {
+                gva_error_handle (&error);
+                return FALSE;
+        }
+
+        sqlite3_bind_text (stmt, 1, path, -1, SQLITE_STATIC);
+
+        if (sqlite3_step (stmt) == SQLITE_ROW)
+        {
+                *fingerprint = g_strdup (
+                        (const gchar *) sqlite3_column_text (stmt, 0));
+                *version = g_strdup (
+                        (const gchar *) sqlite3_column_text (stmt, 1));
+                *showconfig = g_strdup (
+                        (const gchar *) sqlite3_column_text (stmt, 2));
+                found = (*fingerprint != NULL && *showconfig != NULL);
+        }
+
+        sqlite3_finalize (stmt);
+
+        return found;
+}
+
+/**
+ * gva_db_set_emulator:
+ * @path: filename of the MAME executable
+ * @fingerprint: identifies the state of the executable and its
+ *               configuration files
+ * @version: the MAME version, or %NULL
+ * @showconfig: the "-showconfig" output
+ * @error: return location for a #GError, or %NULL
+ *
+ * Records what the MAME executable at @path reported about itself,
+ * replacing any earlier record.  Does nothing if the database is not
+ * open yet.  If an error occurs, it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_db_set_emulator (const gchar *path,
+                     const gchar *fingerprint,
+                     const gchar *version,
+                     const gchar *showconfig,
+                     GError **error)
+{
+        gchar *sql;
+        gboolean success;
+
+        g_return_val_if_fail (path != NULL, FALSE);
+        g_return_val_if_fail (fingerprint != NULL, FALSE);
+        g_return_val_if_fail (showconfig != NULL, FALSE);
+
+        if (db == NULL)
+                return TRUE;
+
+        sql = sqlite3_mprintf (
+                "INSERT INTO emulator VALUES (%Q, %Q, %Q, %Q)",
+                path, fingerprint, version, showconfig);
+        success = gva_db_execute (sql, error);
+        sqlite3_free (sql);
+
+        return success;
+}
+
+/**
+ * gva_db_has_details:
+ * @name: the name of a game
+ *
+ * Returns %TRUE if the sample, dipvalue and related tables hold
+ * up-to-date information about @name.  Builds leave these tables empty;
+ * gva_db_load_details() fills them in for one game at a time.
+ *
+ * Returns: %TRUE if details for @name are loaded
+ **/
+gboolean
+gva_db_has_details (const gchar *name)
+{
+        gchar *sql;
+        gint rows = 0;
+        GError *error = NULL;
+
+        g_return_val_if_fail (name != NULL, FALSE);
+
+        sql = sqlite3_mprintf (
+                "SELECT name FROM detail JOIN gamehash "
+                "USING (name, hash) WHERE name = %Q", name);
+        gva_db_get_table (sql, NULL, &rows, NULL, &error);
+        gva_error_handle (&error);
+        sqlite3_free (sql);
+
+        return (rows > 0);
+}
+
+static void
+db_details_read (GvaProcess *process,
+                 ParserData *data)
+{
+        const gchar *buffer;
+        gsize length;
+
+        while ((length = gva_process_stdout_peek (process, &buffer)) > 0)
+        {
+                /* The scanner modifies its input. */
+                if (data->parser_error == NULL)
+                {
+                        gchar *copy;
+
+                        copy = g_memdup (buffer, length);
+                        db_scanner_parse (
+                                data, copy, length, &data->parser_error);
+                        g_free (copy);
+                }
+
+                gva_process_stdout_consume (process, length);
+        }
+}
+
+static gboolean
+db_details_write (ParserData *data,
+                  GError **error)
+{
+        gchar *sql;
+        gboolean success = FALSE;
+        guint ii;
+
+        /* The main connection writes, so the statements
+         * only exist for the duration of this function. */
+        data->connection = db;
+
+        if (!gva_db_transaction_begin (error))
+                goto exit;
+
+        for (ii = 0; ii < G_N_ELEMENTS (db_detail_tables); ii++)
+        {
+                DbTable table = db_detail_tables[ii];
+
+                sql = sqlite3_mprintf (
+                        "DELETE FROM %s WHERE game = %Q",
+                        db_tables[table].name, data->details);
+                success = gva_db_execute (sql, error);
+                sqlite3_free (sql);
+
+                if (success)
+                        success = gva_db_prepare (
+                                db_insert_sql[table],
+                                &data->insert_stmt[table], error);
+
+                if (!success)
+                        goto rollback;
+        }
+
+        if (!db_writer_write_batch (data, data->batch, error))
+                goto rollback;
+
+        sql = sqlite3_mprintf (
+                "INSERT INTO detail SELECT name, hash "
+                "FROM gamehash WHERE name = %Q", data->details);
+        success = gva_db_execute (sql, error);
+        sqlite3_free (sql);
+
+        if (success)
+        {
+                success = gva_db_transaction_commit (error);
+                goto exit;
+        }
+
+rollback:
+        success = FALSE;
+        gva_db_transaction_rollback (NULL);
+
+exit:
+        for (ii = 0; ii < DB_NUM_TABLES; ii++)
+        {
+                sqlite3_finalize (data->insert_stmt[ii]);
+                data->insert_stmt[ii] = NULL;
+        }
+
+        data->connection = NULL;
+
+        return success;
+}
+
+static void
+db_details_exit (GvaProcess *process,
+                 gint status,
+                 ParserData *data)
+{
+        /* Scan whatever is left in the ring buffer. */
+        db_details_read (process, data);
+
+        if (process->error == NULL && data->parser_error == NULL)
+                db_scanner_end_parse (data, &data->parser_error);
+
+        if (process->error == NULL && data->parser_error != NULL)
+        {
+                g_propagate_error (&process->error, data->parser_error);
+                data->parser_error = NULL;
+        }
+
+        if (process->error == NULL)
+                db_details_write (data, &process->error);
+
+        db_parser_data_unref (data);
+}
+
+/**
+ * gva_db_load_details:
+ * @name: the name of a game
+ * @error: return location for a #GError, or %NULL
+ *
+ * Begins filling in the sample, dipvalue and related tables for @name
+ * from MAME's detailed information about that game alone, and returns
+ * a #GvaProcess to track it.  The tables are updated when the process
+ * exits.  If an error occurs while starting MAME, it returns %NULL and
+ * sets @error.
+ *
+ * Returns: a new #GvaProcess, or %NULL
+ **/
+GvaProcess *
+gva_db_load_details (const gchar *name,
+                     GError **error)
+{
+        GvaProcess *process;
+        ParserData *data;
+
+        g_return_val_if_fail (db != NULL, NULL);
+        g_return_val_if_fail (name != NULL, NULL);
+
+        process = gva_mame_list_xml_game (name, error);
+        if (process == NULL)
+                return NULL;
+
+        gva_process_set_stream_mode (process, LISTXML_BUFFER_SIZE);
+
+        data = db_parser_data_new (process);
+        data->details = g_strdup (name);
+
+        g_signal_connect (
+                process, "data-ready",
+                G_CALLBACK (db_details_read), data);
+
+        g_signal_connect (
+                process, "exited",
+                G_CALLBACK (db_details_exit), data);
+
+        return process;
+}
+
 /**
  * gva_db_get_filename:
  *
@@ -2264,6 +5731,7 @@ gva_db_needs_rebuilt (void)
         const gchar *reason;
         gboolean complete = FALSE;
         gboolean rebuild;
+        gint rows = 0;
         GError *error = NULL;
 
 #define TEST_CASE(expr) \
@@ -2289,6 +5757,19 @@ gva_db_needs_rebuilt (void)
         gva_error_handle (&error);
         TEST_CASE (db_build_id == NULL);
 
+        reason = "its game table is out of date";
+        TEST_CASE (!db_game_table_is_current ());
+
+        reason = "native audits need its ROM sets";
+        TEST_CASE (db_wants_sets () && !db_has_sets ());
+
+        reason = "it has no search index";
+        gva_db_get_table (
+                "SELECT name FROM search LIMIT 1",
+                NULL, &rows, NULL, &error);
+        gva_error_handle (&error);
+        TEST_CASE (rows == 0);
+
         reason = "the MAME version could not be determined";
         mame_version = gva_mame_get_version (&error);
         gva_error_handle (&error);
@@ -2318,6 +5799,34 @@ exit:
         return rebuild;
 }
 
+/**
+ * gva_db_has_games:
+ *
+ * Returns %TRUE if the game database holds a game list from a previous
+ * build that this version of <emphasis>GNOME Video Arcade</emphasis> can
+ * read.  The list can be shown while gva_db_build_async() replaces it.
+ *
+ * Returns: %TRUE if the database holds a readable game list
+ **/
+gboolean
+gva_db_has_games (void)
+{
+        gint rows = 0;
+        GError *error = NULL;
+
+        g_return_val_if_fail (db != NULL, FALSE);
+
+        if (!db_layout_is_current ())
+                return FALSE;
+
+        gva_db_get_table (
+                "SELECT name FROM game LIMIT 1",
+                NULL, &rows, NULL, &error);
+        gva_error_handle (&error);
+
+        return (rows > 0);
+}
+
 /**
  * gva_db_set_error:
  * @error: return location for a #GError, or %NULL
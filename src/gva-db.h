@@ -31,8 +31,34 @@
 
 G_BEGIN_DECLS
 
+/**
+ * GvaDbNamesFunc:
+ * @names: a %NULL-terminated array of game names
+ * @user_data: data passed along with the function
+ *
+ * Receives a batch of game names found by gva_db_select_names_async().
+ **/
+typedef void (*GvaDbNamesFunc) (gchar **names,
+                                gpointer user_data);
+
+/**
+ * GvaDbProgressFunc:
+ * @n_games: the number of games written so far
+ * @user_data: data passed along with the function
+ *
+ * Tracks the progress of gva_db_build_async().
+ **/
+typedef void (*GvaDbProgressFunc) (guint n_games,
+                                   gpointer user_data);
+
 gboolean        gva_db_init                     (GError **error);
-GvaProcess *    gva_db_build                    (GError **error);
+void            gva_db_build_async              (GvaDbProgressFunc progress_callback,
+                                                 gpointer progress_data,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gboolean        gva_db_build_finish             (GAsyncResult *result,
+                                                 GError **error);
 gboolean        gva_db_reset                    (GError **error);
 gboolean        gva_db_execute                  (const gchar *sql,
                                                  GError **error);
@@ -47,14 +73,37 @@ gboolean        gva_db_transaction_rollback     (GError **error);
 gboolean        gva_db_prepare                  (const gchar *sql,
                                                  sqlite3_stmt **stmt,
                                                  GError **error);
+void            gva_db_select_names_async       (const gchar *sql,
+                                                 GvaDbNamesFunc names_callback,
+                                                 gpointer names_data,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gboolean        gva_db_select_names_finish      (GAsyncResult *result,
+                                                 GError **error);
 gboolean        gva_db_get_build                (gchar **build,
                                                  GError **error);
 gboolean        gva_db_get_complete             (gboolean *complete,
                                                  GError **error);
 gboolean        gva_db_mark_complete            (GError **error);
+gchar **        gva_db_get_unaudited            (GError **error);
+gboolean        gva_db_clear_unaudited          (GError **error);
+gboolean        gva_db_get_emulator             (const gchar *path,
+                                                 gchar **fingerprint,
+                                                 gchar **version,
+                                                 gchar **showconfig);
+gboolean        gva_db_set_emulator             (const gchar *path,
+                                                 const gchar *fingerprint,
+                                                 const gchar *version,
+                                                 const gchar *showconfig,
+                                                 GError **error);
+gboolean        gva_db_has_details              (const gchar *name);
+GvaProcess *    gva_db_load_details             (const gchar *name,
+                                                 GError **error);
 const gchar *   gva_db_get_filename             (void);
 gboolean        gva_db_is_older_than            (const gchar *filename);
 gboolean        gva_db_needs_rebuilt            (void);
+gboolean        gva_db_has_games                (void);
 void            gva_db_set_error                (GError **error,
                                                  gint code,
                                                  const gchar *message);
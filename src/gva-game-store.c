@@ -161,8 +161,10 @@ game_store_constructor (GType type,
         types[column++] = G_TYPE_STRING;     /* COLUMN_SAMPLEOF */
         types[column++] = G_TYPE_STRING;     /* COLUMN_SAMPLESET */
         types[column++] = G_TYPE_STRING;     /* COLUMN_DESCRIPTION */
+        types[column++] = G_TYPE_STRING;     /* COLUMN_DESCRIPTION_KEY */
         types[column++] = G_TYPE_STRING;     /* COLUMN_YEAR */
         types[column++] = G_TYPE_STRING;     /* COLUMN_MANUFACTURER */
+        types[column++] = G_TYPE_STRING;     /* COLUMN_MANUFACTURER_KEY */
         types[column++] = G_TYPE_INT;        /* COLUMN_SOUND_CHANNELS */
         types[column++] = G_TYPE_BOOLEAN;    /* COLUMN_INPUT_SERVICE */
         types[column++] = G_TYPE_BOOLEAN;    /* COLUMN_INPUT_TILT */
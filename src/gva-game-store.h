@@ -85,10 +85,14 @@ typedef struct _GvaGameStoreClass GvaGameStoreClass;
  *      Corresponds to the "available.sampleset" database field.
  * @GVA_GAME_STORE_COLUMN_DESCRIPTION:
  *      Corresponds to the "available.description" database field.
+ * @GVA_GAME_STORE_COLUMN_DESCRIPTION_KEY:
+ *      Corresponds to the "available.description_key" database field.
  * @GVA_GAME_STORE_COLUMN_YEAR:
  *      Corresponds to the "available.year" database field.
  * @GVA_GAME_STORE_COLUMN_MANUFACTURER:
  *      Corresponds to the "available.manufacturer" database field.
+ * @GVA_GAME_STORE_COLUMN_MANUFACTURER_KEY:
+ *      Corresponds to the "available.manufacturer_key" database field.
  * @GVA_GAME_STORE_COLUMN_SOUND_CHANNELS:
  *      Corresponds to the "available.sound_channels" database field.
  * @GVA_GAME_STORE_COLUMN_INPUT_SERVICE:
@@ -155,8 +159,10 @@ typedef enum
         GVA_GAME_STORE_COLUMN_SAMPLEOF,           /* G_TYPE_STRING */
         GVA_GAME_STORE_COLUMN_SAMPLESET,          /* G_TYPE_STRING */
         GVA_GAME_STORE_COLUMN_DESCRIPTION,        /* G_TYPE_STRING */
+        GVA_GAME_STORE_COLUMN_DESCRIPTION_KEY,    /* G_TYPE_STRING */
         GVA_GAME_STORE_COLUMN_YEAR,               /* G_TYPE_STRING */
         GVA_GAME_STORE_COLUMN_MANUFACTURER,       /* G_TYPE_STRING */
+        GVA_GAME_STORE_COLUMN_MANUFACTURER_KEY,   /* G_TYPE_STRING */
         GVA_GAME_STORE_COLUMN_SOUND_CHANNELS,     /* G_TYPE_INT */
         GVA_GAME_STORE_COLUMN_INPUT_SERVICE,      /* G_TYPE_BOOLEAN */
         GVA_GAME_STORE_COLUMN_INPUT_TILT,         /* G_TYPE_BOOLEAN */
@@ -30,17 +30,28 @@
 #include "gva-ui.h"
 #include "gva-util.h"
 
-/* The string literals are column names defined in gva-columns.c. */
+/* The string literals are column names defined in gva-columns.c.
+ * Builds store the search keys of titles and manufacturers, which
+ * make up most of the list.  The rest are computed as needed. */
 #define SQL_COMPLETION_LIST \
-        "SELECT DISTINCT name, 'name' FROM available UNION " \
-        "SELECT DISTINCT bios, 'bios' FROM available UNION " \
-        "SELECT DISTINCT category, 'category' FROM available UNION " \
-        "SELECT DISTINCT sourcefile, 'sourcefile' FROM available UNION " \
-        "SELECT DISTINCT description, 'description' FROM available UNION " \
-        "SELECT DISTINCT manufacturer, 'manufacturer' FROM available UNION " \
-        "SELECT DISTINCT year, 'year' FROM available;"
+        "SELECT DISTINCT name, 'name', NULL FROM available UNION " \
+        "SELECT DISTINCT bios, 'bios', NULL FROM available UNION " \
+        "SELECT DISTINCT category, 'category', NULL FROM available UNION " \
+        "SELECT DISTINCT sourcefile, 'sourcefile', NULL " \
+                "FROM available UNION " \
+        "SELECT DISTINCT description, 'description', description_key " \
+                "FROM available UNION " \
+        "SELECT DISTINCT manufacturer, 'manufacturer', manufacturer_key " \
+                "FROM available UNION " \
+        "SELECT DISTINCT year, 'year', NULL FROM available;"
 
-#define PROGRESS_BAR_PULSE_INTERVAL_MS 100
+
+/* Beyond this many games, auditing everything is
+ * faster than passing MAME a long list of names. */
+#define MAX_AUDIT_NAMES 500
+
+/* Searching as you type waits this long after the last keystroke. */
+#define SEARCH_DELAY 250  /* milliseconds */
 
 /* Entry completion columns */
 enum
@@ -48,51 +59,308 @@ enum
         COLUMN_NAME,
         COLUMN_TEXT,
         COLUMN_TYPE,
-        COLUMN_CKEY
+        COLUMN_ROW
+};
+
+typedef struct _MainCompletionIndex MainCompletionIndex;
+typedef struct _MainCompletionSuffix MainCompletionSuffix;
+
+/* A sorted suffix array over the search collation keys of the entry
+ * completion rows.  Every substring of a key is a prefix of one of
+ * its suffixes, so the rows whose keys contain a search key occupy a
+ * contiguous range of the array.  A search key that extends the last
+ * one only narrows that range, so each keystroke is a pair of binary
+ * searches within the previous range. */
+struct _MainCompletionIndex
+{
+        /* Collation keys of all rows, each nul-terminated. */
+        GString *keys;
+
+        /* Array of MainCompletionSuffix */
+        GArray *suffixes;
+
+        /* Rows matching the last search key, one bit per row. */
+        guint8 *matches;
+        guint n_rows;
+
+        /* Last key from the completion, its search
+         * key, and the search key's range in suffixes. */
+        gchar *last_text;
+        gchar *last_key;
+        guint first;
+        guint last;
+};
+
+struct _MainCompletionSuffix
+{
+        /* Offset into keys where the suffix starts. */
+        guint offset;
+
+        /* Completion row whose key contains the suffix. */
+        guint row;
 };
 
 static guint menu_tooltip_cid;
 
+/* Search as you type */
+static guint search_timeout_id;
+static GCancellable *search_cancellable;
+static GTimer *search_timer;  /* since the last keystroke */
+static gboolean search_timer_pending;
+
+/* The results of the last search were cut short. */
+static gboolean search_incomplete;
+
 static void
-main_build_database_progress_cb (GvaProcess *process,
-                                 GParamSpec *pspec,
-                                 gpointer user_data)
+main_build_database_progress_cb (guint n_games,
+                                 guint *p_total_supported)
 {
-        guint total_supported = GPOINTER_TO_UINT (user_data);
+        guint total_supported = *p_total_supported;
         gdouble fraction = 0.0;
 
         if (total_supported != 0)
         {
-                guint progress;
-
-                progress = gva_process_get_progress (process);
-                fraction = (gdouble) progress / (gdouble) total_supported;
+                fraction = (gdouble) n_games / (gdouble) total_supported;
                 fraction = CLAMP (fraction, 0.0, 1.0);
         }
 
         gva_main_progress_bar_set_fraction (fraction);
 }
 
+static void
+main_build_database_total_cb (GObject *source_object,
+                              GAsyncResult *result,
+                              guint *total_supported)
+{
+        guint total;
+        GError *error = NULL;
+
+        total = gva_mame_get_total_supported_finish (result, &error);
+
+        /* If the build finished first, it cancelled us and the
+         * counter is gone. */
+        if (error == NULL)
+                *total_supported = total;
+        else
+                g_error_free (error);
+}
+
+static void
+main_build_database_done_cb (GObject *source_object,
+                             GAsyncResult *result,
+                             GAsyncResult **p_result)
+{
+        *p_result = g_object_ref (result);
+}
+
+static MainCompletionIndex *
+main_completion_index_new (void)
+{
+        MainCompletionIndex *completion_index;
+
+        completion_index = g_slice_new0 (MainCompletionIndex);
+        completion_index->keys = g_string_sized_new (4096);
+        completion_index->suffixes = g_array_new (
+                FALSE, FALSE, sizeof (MainCompletionSuffix));
+
+        return completion_index;
+}
+
+static void
+main_completion_index_free (MainCompletionIndex *completion_index)
+{
+        g_string_free (completion_index->keys, TRUE);
+        g_array_free (completion_index->suffixes, TRUE);
+        g_free (completion_index->matches);
+        g_free (completion_index->last_text);
+        g_free (completion_index->last_key);
+
+        g_slice_free (MainCompletionIndex, completion_index);
+}
+
+/* Appends the collation key of the next completion row,
+ * computing it from @search_text if @search_key is %NULL. */
+static void
+main_completion_index_add (MainCompletionIndex *completion_index,
+                           const gchar *search_text,
+                           const gchar *search_key)
+{
+        GString *keys = completion_index->keys;
+        gsize offset = keys->len;
+        gsize length;
+        guint row;
+
+        row = completion_index->n_rows++;
+
+        if (search_key != NULL)
+        {
+                /* Keep the nul byte. */
+                g_string_append_len (
+                        keys, search_key, strlen (search_key) + 1);
+        }
+        else
+        {
+                /* Reserve room for the key and its nul byte, and
+                 * retry with the full length if it did not fit. */
+                g_string_set_size (keys, offset + 256);
+                length = gva_search_collate_key_to_buffer (
+                        search_text, keys->str + offset, 256);
+                if (length >= 256)
+                {
+                        g_string_set_size (keys, offset + length + 1);
+                        gva_search_collate_key_to_buffer (
+                                search_text, keys->str + offset,
+                                length + 1);
+                }
+                g_string_truncate (keys, offset + length + 1);
+        }
+
+        /* A suffix starts at every character, skipping
+         * the continuation bytes of UTF-8 sequences. */
+        while (offset < keys->len - 1)
+        {
+                MainCompletionSuffix suffix;
+
+                suffix.offset = offset;
+                suffix.row = row;
+
+                if ((keys->str[offset] & 0xC0) != 0x80)
+                        g_array_append_val (
+                                completion_index->suffixes, suffix);
+                offset++;
+        }
+}
+
+static gint
+main_completion_index_compare (const MainCompletionSuffix *suffix_a,
+                               const MainCompletionSuffix *suffix_b,
+                               const gchar *keys)
+{
+        return strcmp (keys + suffix_a->offset, keys + suffix_b->offset);
+}
+
+/* Sorts the suffixes once all rows have been added. */
+static void
+main_completion_index_sort (MainCompletionIndex *completion_index)
+{
+        GArray *suffixes = completion_index->suffixes;
+
+        g_qsort_with_data (
+                suffixes->data, suffixes->len,
+                sizeof (MainCompletionSuffix), (GCompareDataFunc)
+                main_completion_index_compare,
+                completion_index->keys->str);
+
+        completion_index->matches =
+                g_new0 (guint8, (completion_index->n_rows + 7) / 8);
+}
+
+/* Returns the first suffix in [first, last) whose leading characters
+ * compare greater than or equal to @key, or greater than @key if
+ * @after is %TRUE. */
+static guint
+main_completion_index_bound (MainCompletionIndex *completion_index,
+                             const gchar *key,
+                             gsize length,
+                             guint first,
+                             guint last,
+                             gboolean after)
+{
+        GArray *suffixes = completion_index->suffixes;
+        const gchar *keys = completion_index->keys->str;
+
+        while (first < last)
+        {
+                MainCompletionSuffix *suffix;
+                guint middle = first + (last - first) / 2;
+                gint result;
+
+                suffix = &g_array_index (
+                        suffixes, MainCompletionSuffix, middle);
+                result = strncmp (keys + suffix->offset, key, length);
+
+                if (result < 0 || (after && result == 0))
+                        first = middle + 1;
+                else
+                        last = middle;
+        }
+
+        return first;
+}
+
+/* Marks the rows whose keys contain @key. */
+static void
+main_completion_index_search (MainCompletionIndex *completion_index,
+                              const gchar *key)
+{
+        GArray *suffixes = completion_index->suffixes;
+        gsize length = strlen (key);
+        guint first = 0;
+        guint last = suffixes->len;
+        guint ii;
+
+        /* Narrow the last range if the key extends the last key. */
+        if (completion_index->last_key != NULL &&
+                g_str_has_prefix (key, completion_index->last_key))
+        {
+                first = completion_index->first;
+                last = completion_index->last;
+        }
+
+        first = main_completion_index_bound (
+                completion_index, key, length, first, last, FALSE);
+        last = main_completion_index_bound (
+                completion_index, key, length, first, last, TRUE);
+
+        memset (
+                completion_index->matches, 0,
+                (completion_index->n_rows + 7) / 8);
+
+        for (ii = first; ii < last; ii++)
+        {
+                guint row;
+
+                row = g_array_index (
+                        suffixes, MainCompletionSuffix, ii).row;
+                completion_index->matches[row / 8] |= 1 << (row % 8);
+        }
+
+        g_free (completion_index->last_key);
+        completion_index->last_key = g_strdup (key);
+        completion_index->first = first;
+        completion_index->last = last;
+}
+
 static gboolean
 main_entry_completion_match (GtkEntryCompletion *completion,
                              const gchar *key,
-                             GtkTreeIter *iter)
+                             GtkTreeIter *iter,
+                             MainCompletionIndex *completion_index)
 {
         GtkTreeModel *model;
-        gchar *s1, *s2;
-        gboolean match;
+        guint row;
 
-        model = gtk_entry_completion_get_model (completion);
-        gtk_tree_model_get (model, iter, COLUMN_CKEY, &s1, -1);
-        g_return_val_if_fail (s1 != NULL, FALSE);
+        /* The completion calls us once per row with the same key,
+         * so search the index on the first call and just look up
+         * the rest. */
+        if (g_strcmp0 (key, completion_index->last_text) != 0)
+        {
+                gchar search_key[256];
+
+                /* A truncated key would only match more rows. */
+                gva_search_collate_key_to_buffer (
+                        key, search_key, sizeof (search_key));
+                main_completion_index_search (completion_index, search_key);
 
-        s2 = gva_search_collate_key (key);
-        match = (strstr (s1, s2) != NULL);
+                g_free (completion_index->last_text);
+                completion_index->last_text = g_strdup (key);
+        }
 
-        g_free (s1);
-        g_free (s2);
+        model = gtk_entry_completion_get_model (completion);
+        gtk_tree_model_get (model, iter, COLUMN_ROW, &row, -1);
+        g_return_val_if_fail (row < completion_index->n_rows, FALSE);
 
-        return match;
+        return (completion_index->matches[row / 8] & (1 << (row % 8))) != 0;
 }
 
 static gboolean
@@ -136,14 +404,130 @@ main_menu_item_deselect_cb (GtkMenuItem *item)
         gva_main_statusbar_pop (menu_tooltip_cid);
 }
 
+/* Puts the cursor on the first row if no row is selected, without
+ * taking the input focus from the search entry. */
+static void
+main_select_first_game (void)
+{
+        GtkTreeSelection *selection;
+        GtkTreeModel *model;
+        GtkTreeView *view;
+        GtkTreeIter iter;
+
+        view = GTK_TREE_VIEW (GVA_WIDGET_MAIN_TREE_VIEW);
+        selection = gtk_tree_view_get_selection (view);
+
+        /* Parts of this are copied from
+         * gva_tree_view_set_selected_game(). */
+        if (!gtk_tree_selection_get_selected (selection, &model, &iter))
+        {
+                if (gtk_tree_model_get_iter_first (model, &iter))
+                {
+                        GtkTreePath *path;
+
+                        path = gtk_tree_model_get_path (model, &iter);
+                        gtk_tree_view_set_cursor (view, path, NULL, FALSE);
+                        gtk_tree_view_scroll_to_cell (
+                                view, path, NULL, TRUE, 0.5, 0.0);
+                        gtk_tree_path_free (path);
+                }
+        }
+}
+
+/* Stops a search started by typing in the search entry. */
+static void
+main_search_cancel (void)
+{
+        if (search_timeout_id > 0)
+        {
+                g_source_remove (search_timeout_id);
+                search_timeout_id = 0;
+        }
+
+        if (search_cancellable != NULL)
+        {
+                g_cancellable_cancel (search_cancellable);
+                g_object_unref (search_cancellable);
+                search_cancellable = NULL;
+                search_incomplete = TRUE;
+        }
+
+        search_timer_pending = FALSE;
+}
+
+static void
+main_search_done_cb (GObject *source_object,
+                     GAsyncResult *result,
+                     gpointer unused)
+{
+        GError *error = NULL;
+
+        /* A newer search cancelled this one. */
+        if (!gva_tree_view_update_finish (result, &error) &&
+            g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+                g_error_free (error);
+                return;
+        }
+
+        g_object_unref (search_cancellable);
+        search_cancellable = NULL;
+
+        if (error != NULL)
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        main_select_first_game ();
+
+        g_log (
+                G_LOG_DOMAIN, GVA_DEBUG_SEARCH,
+                "Search finished %.1f ms after the last keystroke",
+                g_timer_elapsed (search_timer, NULL) * 1000.0);
+}
+
 static gboolean
-main_progress_bar_pulse_cb (gpointer user_data)
+main_search_timeout_cb (gpointer unused)
 {
-        GtkProgressBar *progress_bar = GTK_PROGRESS_BAR (user_data);
+        GtkEntry *entry;
+        gchar *text;
 
-        gtk_progress_bar_pulse (progress_bar);
+        search_timeout_id = 0;
 
-        return TRUE;
+        entry = GTK_ENTRY (GVA_WIDGET_MAIN_SEARCH_ENTRY);
+
+        /* Save the search entry text, but leave the entry alone
+         * since the user may still be typing. */
+        text = g_strstrip (g_strdup (gtk_entry_get_text (entry)));
+        gva_main_set_last_search_text (text);
+        gva_main_set_last_selected_match (NULL, NULL);
+        g_free (text);
+
+        search_cancellable = g_cancellable_new ();
+        search_timer_pending = TRUE;
+        search_incomplete = FALSE;
+
+        gva_tree_view_update_async (
+                search_cancellable, main_search_done_cb, NULL);
+
+        return FALSE;
+}
+
+static void
+main_tree_view_notify_model_cb (GtkTreeView *view,
+                                GParamSpec *pspec)
+{
+        /* The first results of a search as you type are in. */
+        if (search_timer_pending)
+        {
+                g_log (
+                        G_LOG_DOMAIN, GVA_DEBUG_SEARCH,
+                        "First search results %.1f ms "
+                        "after the last keystroke",
+                        g_timer_elapsed (search_timer, NULL) * 1000.0);
+                search_timer_pending = FALSE;
+        }
 }
 
 /**
@@ -163,6 +547,12 @@ gva_main_init (void)
 
         gva_tree_view_init ();
 
+        search_timer = g_timer_new ();
+
+        g_signal_connect (
+                GVA_WIDGET_MAIN_TREE_VIEW, "notify::model",
+                G_CALLBACK (main_tree_view_notify_model_cb), NULL);
+
         gtk_box_pack_start (
                 GTK_BOX (GVA_WIDGET_MAIN_VBOX),
                 gva_ui_get_managed_widget ("/main-menu"),
@@ -222,34 +612,47 @@ gva_main_init (void)
 gboolean
 gva_main_build_database (GError **error)
 {
-        GvaProcess *process;
+        GCancellable *cancellable;
+        GAsyncResult *result = NULL;
         guint context_id;
-        guint total_supported;
+        guint total_supported = 0;
         gboolean main_loop_quit = FALSE;
         gboolean success = FALSE;
 
         /* XXX Comment this code! */
 
         context_id = gva_main_statusbar_get_context_id (G_STRFUNC);
-        total_supported = gva_mame_get_total_supported (NULL);
 
-        process = gva_db_build (error);
-        if (process == NULL)
-                goto exit;
+        /* Count the games alongside the build.  Progress reads as
+         * zero until the count is known. */
+        cancellable = g_cancellable_new ();
+        gva_mame_get_total_supported_async (
+                cancellable, (GAsyncReadyCallback)
+                main_build_database_total_cb, &total_supported);
 
         gva_main_progress_bar_show ();
         gva_main_progress_bar_set_fraction (0.0);
         gva_main_statusbar_push (context_id, _("Building game database..."));
 
-        g_signal_connect (
-                process, "notify::progress",
-                G_CALLBACK (main_build_database_progress_cb),
-                GUINT_TO_POINTER (total_supported));
+        gva_db_build_async (
+                (GvaDbProgressFunc) main_build_database_progress_cb,
+                &total_supported, cancellable,
+                (GAsyncReadyCallback) main_build_database_done_cb, &result);
 
-        while (!gva_process_has_exited (process, NULL))
+        while (!main_loop_quit && result == NULL)
                 main_loop_quit = gtk_main_iteration ();
 
         if (main_loop_quit)
+        {
+                /* Stop the build and wait for it to let go
+                 * of the result pointer. */
+                g_cancellable_cancel (cancellable);
+                while (result == NULL)
+                        g_main_context_iteration (NULL, TRUE);
+                goto exit;
+        }
+
+        if (!gva_db_build_finish (result, error))
                 goto exit;
 
         success = TRUE;
@@ -258,80 +661,141 @@ gva_main_build_database (GError **error)
         gva_main_progress_bar_hide ();
 
 exit:
-        if (process != NULL)
-                g_object_unref (process);
+        if (result != NULL)
+                g_object_unref (result);
+
+        g_cancellable_cancel (cancellable);
+        g_object_unref (cancellable);
 
         return success;
 }
 
-/**
- * gva_main_analyze_roms:
- * @error: return location for a #GError, or %NULL
- *
- * Executes the lengthy process of analyzing all available ROM and sample
- * sets for correctness and then updating the games database with the new
- * status information.  The function updates the main window's progress bar
- * to help track the analysis.  The function is synchronous; it blocks until
- * the analysis is complete or aborted.
- *
- * Returns: %TRUE if the analysis completed successfully,
- *          %FALSE if the analysis failed or was aborted
- **/
-gboolean
-gva_main_analyze_roms (GError **error)
+static void
+main_analyze_roms_progress_cb (guint n_audited,
+                               guint n_total,
+                               gpointer user_data)
 {
-        GvaProcess *process;
-        GvaProcess *process2 = NULL;
+        gdouble fraction = 0.0;
+
+        if (n_total > 0)
+        {
+                fraction = (gdouble) n_audited / (gdouble) n_total;
+                fraction = CLAMP (fraction, 0.0, 1.0);
+        }
+
+        gva_main_progress_bar_set_fraction (fraction);
+}
+
+static void
+main_analyze_roms_done_cb (GObject *source_object,
+                           GAsyncResult *result,
+                           GAsyncResult **p_result)
+{
+        *p_result = g_object_ref (result);
+}
+
+static gboolean
+main_analyze_roms (gchar **names,
+                   GError **error)
+{
+        GCancellable *cancellable;
+        GAsyncResult *result = NULL;
+        GAsyncResult *result2 = NULL;
         guint context_id;
         gboolean main_loop_quit = FALSE;
         gboolean success = FALSE;
-        guint timeout_id = 0;
 
         context_id = gva_main_statusbar_get_context_id (G_STRFUNC);
-
-        process = gva_audit_roms (error);
-        if (process == NULL)
-                goto exit;
-
-        process2 = gva_audit_samples (error);
-        if (process2 == NULL)
-                goto exit;
+        cancellable = g_cancellable_new ();
 
         gva_main_progress_bar_show ();
         gva_main_progress_bar_set_fraction (0.0);
         gva_main_statusbar_push (context_id, _("Analyzing ROM files..."));
 
-        timeout_id = g_timeout_add (
-                PROGRESS_BAR_PULSE_INTERVAL_MS,
-                main_progress_bar_pulse_cb,
-                GVA_WIDGET_MAIN_PROGRESS_BAR);
+        /* Only the ROM audit reports progress.  There are far fewer
+         * sample sets, and they verify quickly by comparison. */
+        gva_audit_roms_async (
+                names, main_analyze_roms_progress_cb, NULL, cancellable,
+                (GAsyncReadyCallback) main_analyze_roms_done_cb, &result);
+
+        gva_audit_samples_async (
+                names, NULL, NULL, cancellable,
+                (GAsyncReadyCallback) main_analyze_roms_done_cb, &result2);
 
-        while (!gva_process_has_exited (process, NULL))
+        while (!main_loop_quit && (result == NULL || result2 == NULL))
                 main_loop_quit = gtk_main_iteration ();
 
         if (main_loop_quit)
+        {
+                /* Stop the audits and wait for them to let go
+                 * of the result pointers. */
+                g_cancellable_cancel (cancellable);
+                while (result == NULL || result2 == NULL)
+                        g_main_context_iteration (NULL, TRUE);
                 goto exit;
+        }
 
-        while (!gva_process_has_exited (process2, NULL))
-                main_loop_quit = gtk_main_iteration ();
+        if (!gva_audit_roms_finish (result, error))
+                goto exit;
 
-        if (main_loop_quit)
+        if (!gva_audit_samples_finish (result2, error))
                 goto exit;
 
-        success = TRUE;
+        /* Games added or changed by the last database build
+         * have been audited now, one way or the other. */
+        success = gva_db_clear_unaudited (error);
 
         gva_main_statusbar_pop (context_id);
         gva_main_progress_bar_hide ();
 
+        gva_audit_show_results ();
+
 exit:
-        if (timeout_id > 0)
-                g_source_remove (timeout_id);
+        if (result != NULL)
+                g_object_unref (result);
+
+        if (result2 != NULL)
+                g_object_unref (result2);
+
+        g_object_unref (cancellable);
+
+        return success;
+}
 
-        if (process != NULL)
-                g_object_unref (process);
+/**
+ * gva_main_analyze_unaudited_roms:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Analyzes the ROM and sample sets of games that were added or changed
+ * by the last database build, or that were affected by file changes found
+ * by gva_audit_detect_changes_async() (see gva_db_get_unaudited()), and
+ * then updates the games database with the new status information.  Does
+ * nothing if there are no such games.  The function updates the main
+ * window's progress bar to help track the analysis, and shows the audit
+ * results window afterward if any ROM sets are bad.  The function is
+ * synchronous; it blocks until the analysis is complete or aborted.
+ *
+ * Returns: %TRUE if the analysis completed successfully,
+ *          %FALSE if the analysis failed or was aborted
+ **/
+gboolean
+gva_main_analyze_unaudited_roms (GError **error)
+{
+        gchar **names;
+        gboolean success;
+
+        names = gva_db_get_unaudited (error);
+        if (names == NULL)
+                return FALSE;
+
+        if (names[0] == NULL)
+                success = TRUE;
+        else if (g_strv_length (names) > MAX_AUDIT_NAMES)
+                success = main_analyze_roms (NULL, error);
+        else
+                success = main_analyze_roms (names, error);
 
-        if (process2 != NULL)
-                g_object_unref (process2);
+        g_strfreev (names);
 
         return success;
 }
@@ -352,6 +816,7 @@ gboolean
 gva_main_init_search_completion (GError **error)
 {
         GtkEntryCompletion *completion;
+        MainCompletionIndex *completion_index;
         GtkCellRenderer *renderer;
         GtkListStore *store;
         GtkTreeIter iter;
@@ -365,7 +830,8 @@ gva_main_init_search_completion (GError **error)
                 return FALSE;
 
         store = gtk_list_store_new (
-                4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+                4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT);
+        completion_index = main_completion_index_new ();
 
         while ((errcode = sqlite3_step (stmt)) == SQLITE_ROW)
         {
@@ -373,10 +839,11 @@ gva_main_init_search_completion (GError **error)
                 const gchar *column_name;
                 const gchar *column_title;
                 const gchar *search_text;
-                gchar *collation_key;
+                const gchar *search_key;
 
                 search_text = (const gchar *) sqlite3_column_text (stmt, 0);
                 column_name = (const gchar *) sqlite3_column_text (stmt, 1);
+                search_key = (const gchar *) sqlite3_column_text (stmt, 2);
                 gva_columns_lookup_id (column_name, &column_id);
                 column_title = gva_columns_lookup_title (column_id);
 
@@ -384,14 +851,14 @@ gva_main_init_search_completion (GError **error)
                         continue;
 
                 gtk_list_store_append (store, &iter);
-                collation_key = gva_search_collate_key (search_text);
                 gtk_list_store_set (
                         store, &iter,
                         COLUMN_NAME, column_name,
                         COLUMN_TEXT, search_text,
                         COLUMN_TYPE, column_title,
-                        COLUMN_CKEY, collation_key, -1);
-                g_free (collation_key);
+                        COLUMN_ROW, completion_index->n_rows, -1);
+                main_completion_index_add (
+                        completion_index, search_text, search_key);
         }
 
         sqlite3_finalize (stmt);
@@ -399,14 +866,18 @@ gva_main_init_search_completion (GError **error)
         if (errcode != SQLITE_DONE)
         {
                 gva_db_set_error (error, 0, NULL);
+                main_completion_index_free (completion_index);
                 g_object_unref (store);
                 return FALSE;
         }
 
+        main_completion_index_sort (completion_index);
+
         completion = gtk_entry_completion_new ();
         gtk_entry_completion_set_match_func (
                 completion, (GtkEntryCompletionMatchFunc)
-                main_entry_completion_match, NULL, NULL);
+                main_entry_completion_match, completion_index,
+                (GDestroyNotify) main_completion_index_free);
         gtk_entry_completion_set_minimum_key_length (completion, 3);
         gtk_entry_completion_set_model (completion, GTK_TREE_MODEL (store));
         gtk_entry_completion_set_text_column (completion, COLUMN_TEXT);
@@ -710,16 +1181,14 @@ gva_main_clear_search (void)
 void
 gva_main_execute_search (void)
 {
-        GtkTreeSelection *selection;
-        GtkTreeModel *model;
-        GtkTreeView *view;
-        GtkTreeIter iter;
         GtkEntry *entry;
         gchar *text;
 
         entry = GTK_ENTRY (GVA_WIDGET_MAIN_SEARCH_ENTRY);
-        view = GTK_TREE_VIEW (GVA_WIDGET_MAIN_TREE_VIEW);
-        selection = gtk_tree_view_get_selection (view);
+
+        /* This supersedes any search as you type. */
+        main_search_cancel ();
+        search_incomplete = FALSE;
 
         /* Save the search entry text. */
         text = g_strdup (gtk_entry_get_text (entry));
@@ -738,21 +1207,8 @@ gva_main_execute_search (void)
                 gva_error_handle (&error);
         }
 
-        /* Select something in the tree view.  Parts of this are
-         * copied from gva_tree_view_set_selected_game(). */
-        if (!gtk_tree_selection_get_selected (selection, &model, &iter))
-        {
-                if (gtk_tree_model_get_iter_first (model, &iter))
-                {
-                        GtkTreePath *path;
-
-                        path = gtk_tree_model_get_path (model, &iter);
-                        gtk_tree_view_set_cursor (view, path, NULL, FALSE);
-                        gtk_tree_view_scroll_to_cell (
-                                view, path, NULL, TRUE, 0.5, 0.0);
-                        gtk_tree_path_free (path);
-                }
-        }
+        /* Select something in the tree view. */
+        main_select_first_game ();
 }
 
 /**
@@ -899,7 +1355,10 @@ gva_main_search_entry_activate_cb (GtkEntry *entry)
  *
  * Handler for #GtkEditable::changed signals to the search entry.
  *
- * Updates the sensitivity of the clear search icon.
+ * Updates the sensitivity of the clear search icon.  If the "Search
+ * Results" view is showing and the user is typing in the search entry,
+ * also updates the search results shortly after the last keystroke,
+ * unless disabled in GSettings.
  **/
 void
 gva_main_search_entry_changed_cb (GtkEntry *entry)
@@ -907,12 +1366,50 @@ gva_main_search_entry_changed_cb (GtkEntry *entry)
         GtkEntryIconPosition position;
         gboolean sensitive;
         const gchar *text;
+        gchar *search_text;
+        gchar *last_text;
+        gboolean unchanged;
 
         text = gtk_entry_get_text (entry);
         position = GTK_ENTRY_ICON_SECONDARY;
         sensitive = (text != NULL) && (*text != '\0');
 
         gtk_entry_set_icon_sensitive (entry, position, sensitive);
+
+        /* Switching views steals the input focus from the search
+         * entry, so only search as you type in the Search Results
+         * view.  Text set by the program leaves the focus alone. */
+        if (!gtk_widget_has_focus (GTK_WIDGET (entry)))
+                return;
+
+        if (gva_tree_view_get_selected_view () != 2)
+                return;
+
+        if (!g_settings_get_boolean (
+                gva_get_settings (), GVA_SETTING_SEARCH_AS_YOU_TYPE))
+                return;
+
+        if (search_timeout_id > 0)
+        {
+                g_source_remove (search_timeout_id);
+                search_timeout_id = 0;
+        }
+
+        /* Let a search for the same text finish. */
+        search_text = g_strstrip (g_strdup (text));
+        last_text = gva_main_get_last_search_text ();
+        unchanged = (strcmp (search_text, last_text) == 0);
+        g_free (search_text);
+        g_free (last_text);
+
+        if (unchanged && !search_incomplete)
+                return;
+
+        main_search_cancel ();
+        g_timer_start (search_timer);
+
+        search_timeout_id = g_timeout_add (
+                SEARCH_DELAY, main_search_timeout_cb, NULL);
 }
 
 /**
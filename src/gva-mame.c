@@ -21,18 +21,58 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #ifdef HAVE_WORDEXP_H
 #include <wordexp.h>
 #endif
 
+#include "gva-db.h"
 #include "gva-error.h"
 #include "gva-input-file.h"
 #include "gva-mame-process.h"
 #include "gva-mute-button.h"
 #include "gva-preferences.h"
 #include "gva-ui.h"
+#include "gva-util.h"
+
+/* Parsed "MAME -showconfig" output, mapping configuration keys to raw
+ * values, and the version from "MAME -help".  These are reloaded when
+ * the MAME executable or one of the files it reads its configuration
+ * from changes, and are saved to the game database so later sessions
+ * need not run MAME to get them. */
+static GHashTable *mame_config;
+static gchar **mame_config_files;
+static gchar *mame_config_fingerprint;
+static gchar *mame_config_version;
+static guint mame_config_hits;
+static guint mame_config_misses;
+
+/* Lookups waiting for "MAME -showconfig" and "MAME -help" to finish,
+ * and the results of those commands as they come in. */
+static GSList *mame_config_waiters;
+static GAsyncResult *mame_config_showconfig_result;
+static GAsyncResult *mame_config_help_result;
+
+typedef struct _MameCommand MameCommand;
+typedef struct _MameConfigWaiter MameConfigWaiter;
+
+/* Operation result of gva_mame_command_async(). */
+struct _MameCommand {
+        GvaProcess *process;
+        GCancellable *cancellable;
+        gulong cancelled_id;
+        gint status;
+        gchar **stdout_lines;
+        gchar **stderr_lines;
+};
+
+struct _MameConfigWaiter {
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+        gchar *config_key;  /* NULL for the version */
+};
 
 static void
 mame_add_sound_option (GString *arguments)
@@ -96,6 +136,202 @@ mame_expand_string (gchar **p_string)
 #endif
 }
 
+static void
+mame_command_free (MameCommand *command)
+{
+        if (command->cancelled_id > 0)
+                g_cancellable_disconnect (
+                        command->cancellable, command->cancelled_id);
+
+        if (command->cancellable != NULL)
+                g_object_unref (command->cancellable);
+
+        g_object_unref (command->process);
+        g_strfreev (command->stdout_lines);
+        g_strfreev (command->stderr_lines);
+
+        g_slice_free (MameCommand, command);
+}
+
+static void
+mame_command_cancelled_cb (GCancellable *cancellable,
+                           GvaProcess *process)
+{
+        /* The ::exited handler reports the cancellation. */
+        gva_process_kill (process);
+}
+
+static void
+mame_command_exited_cb (GvaProcess *process,
+                        gint status,
+                        GSimpleAsyncResult *simple)
+{
+        MameCommand *command;
+        GError *error = NULL;
+
+        command = g_simple_async_result_get_op_res_gpointer (simple);
+
+        /* The process ID may be reused now, so don't kill it. */
+        if (command->cancelled_id > 0)
+        {
+                g_cancellable_disconnect (
+                        command->cancellable, command->cancelled_id);
+                command->cancelled_id = 0;
+        }
+
+        command->stdout_lines = gva_process_stdout_read_lines (process);
+        command->stderr_lines = gva_process_stderr_read_lines (process);
+
+        if (g_cancellable_set_error_if_cancelled (
+                command->cancellable, &error))
+        {
+                g_simple_async_result_take_error (simple, error);
+        }
+        else if (process->error != NULL)
+        {
+                g_simple_async_result_set_from_error (
+                        simple, process->error);
+        }
+        else
+        {
+                g_assert (WIFEXITED (status));
+                command->status = WEXITSTATUS (status);
+        }
+
+        g_simple_async_result_complete (simple);
+        g_object_unref (simple);
+}
+
+/* The blocking functions below are wrappers around their asynchronous
+ * counterparts.  They pass this as the callback with a pointer to a
+ * NULL #GAsyncResult, then call mame_sync_wait(). */
+static void
+mame_sync_cb (GObject *source_object,
+              GAsyncResult *result,
+              GAsyncResult **p_result)
+{
+        *p_result = g_object_ref (result);
+}
+
+static void
+mame_sync_wait (GAsyncResult **p_result)
+{
+        while (*p_result == NULL)
+                g_main_context_iteration (NULL, TRUE);
+}
+
+/**
+ * gva_mame_command_async:
+ * @arguments: command line arguments
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the command finishes
+ * @user_data: data to pass to @callback
+ *
+ * Spawns MAME with @arguments and returns immediately.  When the child
+ * process exits, @callback is called from the main loop and should call
+ * gva_mame_command_finish() to get the output.  Cancelling @cancellable
+ * kills the child process.
+ **/
+void
+gva_mame_command_async (const gchar *arguments,
+                        GCancellable *cancellable,
+                        GAsyncReadyCallback callback,
+                        gpointer user_data)
+{
+        GSimpleAsyncResult *simple;
+        MameCommand *command;
+        GvaProcess *process;
+        GError *error = NULL;
+
+        g_return_if_fail (arguments != NULL);
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data, gva_mame_command_async);
+
+        process = gva_mame_process_spawn (
+                arguments, G_PRIORITY_DEFAULT_IDLE, &error);
+
+        if (process == NULL)
+        {
+                g_simple_async_result_take_error (simple, error);
+                g_simple_async_result_complete_in_idle (simple);
+                g_object_unref (simple);
+                return;
+        }
+
+        command = g_slice_new0 (MameCommand);
+        command->process = process;
+        command->status = -1;
+
+        g_simple_async_result_set_op_res_gpointer (
+                simple, command, (GDestroyNotify) mame_command_free);
+
+        if (cancellable != NULL)
+        {
+                command->cancellable = g_object_ref (cancellable);
+                command->cancelled_id = g_cancellable_connect (
+                        cancellable,
+                        G_CALLBACK (mame_command_cancelled_cb),
+                        process, NULL);
+        }
+
+        /* The handler releases our reference to the result. */
+        g_signal_connect (
+                process, "exited",
+                G_CALLBACK (mame_command_exited_cb), simple);
+}
+
+/**
+ * gva_mame_command_finish:
+ * @result: a #GAsyncResult
+ * @stdout_lines: return location for stdout lines, or %NULL
+ * @stderr_lines: return location for stderr lines, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_command_async().  The
+ * line-based output from the stdout and stderr pipes are written to
+ * @stdout_lines and @stderr_lines, respectively, as %NULL-terminated
+ * string arrays.  The function returns the exit status of the child
+ * process, or -1 if an error occurred while spawning the process or
+ * the operation was cancelled.
+ *
+ * Returns: exit status of the child process or -1 if an error occurred
+ **/
+gint
+gva_mame_command_finish (GAsyncResult *result,
+                         gchar ***stdout_lines,
+                         gchar ***stderr_lines,
+                         GError **error)
+{
+        GSimpleAsyncResult *simple;
+        MameCommand *command;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_mame_command_async), -1);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return -1;
+
+        command = g_simple_async_result_get_op_res_gpointer (simple);
+
+        if (stdout_lines != NULL)
+        {
+                *stdout_lines = command->stdout_lines;
+                command->stdout_lines = NULL;
+        }
+
+        if (stderr_lines != NULL)
+        {
+                *stderr_lines = command->stderr_lines;
+                command->stderr_lines = NULL;
+        }
+
+        return command->status;
+}
+
 /**
  * gva_mame_command:
  * @arguments: command line arguments
@@ -109,6 +345,9 @@ mame_expand_string (gchar **p_string)
  * string arrays.  The function returns the exit status of the child
  * process, or -1 if an error occurred while spawning the process.
  *
+ * The main loop runs while the function blocks.  Prefer
+ * gva_mame_command_async() where the caller can wait for a callback.
+ *
  * Returns: exit status of the child process or -1 if an error occurred
  **/
 gint
@@ -117,71 +356,145 @@ gva_mame_command (const gchar *arguments,
                   gchar ***stderr_lines,
                   GError **error)
 {
-        gchar **local_stdout_lines = NULL;
-        gchar **local_stderr_lines = NULL;
-        GvaProcess *process;
+        GAsyncResult *result = NULL;
         gint status;
 
-        process = gva_mame_process_spawn (
-                arguments, G_PRIORITY_DEFAULT_IDLE, error);
-        if (process == NULL)
-                return -1;
+        gva_mame_command_async (
+                arguments, NULL, (GAsyncReadyCallback) mame_sync_cb, &result);
+        mame_sync_wait (&result);
 
-        /* Wait for the process to exit. */
-        while (!gva_process_has_exited (process, &status))
-                g_main_context_iteration (NULL, TRUE);
+        status = gva_mame_command_finish (
+                result, stdout_lines, stderr_lines, error);
+        g_object_unref (result);
+
+        return status;
+}
+
+static void
+mame_config_append_stat (GString *fingerprint,
+                         const gchar *filename)
+{
+        struct stat st;
+
+        if (g_stat (filename, &st) == 0)
+                g_string_append_printf (
+                        fingerprint, "%s %" G_GINT64_FORMAT " %ld\n",
+                        filename, (gint64) st.st_size, (glong) st.st_mtime);
+        else
+                g_string_append_printf (fingerprint, "%s -\n", filename);
+}
+
+static gchar *
+mame_config_get_fingerprint (void)
+{
+        GString *fingerprint;
+        guint ii;
+
+        fingerprint = g_string_new (NULL);
 
-        local_stdout_lines = gva_process_stdout_read_lines (process);
-        local_stderr_lines = gva_process_stderr_read_lines (process);
+        mame_config_append_stat (fingerprint, MAME_PROGRAM);
 
-        if (process->error != NULL)
+        for (ii = 0; mame_config_files[ii] != NULL; ii++)
+                mame_config_append_stat (fingerprint, mame_config_files[ii]);
+
+        return g_string_free (fingerprint, FALSE);
+}
+
+static void
+mame_config_invalidate (void)
+{
+        if (mame_config != NULL)
+                g_hash_table_destroy (mame_config);
+        mame_config = NULL;
+
+        g_strfreev (mame_config_files);
+        mame_config_files = NULL;
+
+        g_free (mame_config_fingerprint);
+        mame_config_fingerprint = NULL;
+
+        g_free (mame_config_version);
+        mame_config_version = NULL;
+}
+
+/* Lists the mame.ini files MAME would read, per its "inipath". */
+static gchar **
+mame_config_list_files (void)
+{
+        GPtrArray *files;
+        const gchar *inipath;
+
+        files = g_ptr_array_new ();
+
+        inipath = g_hash_table_lookup (mame_config, "inipath");
+
+        if (inipath != NULL)
         {
-                g_propagate_error (error, process->error);
-                process->error = NULL;
-                status = -1;
-                goto fail;
+                gchar *expanded;
+                gchar **paths;
+                guint ii;
+
+                expanded = g_strdup (inipath);
+                mame_expand_string (&expanded);
+                paths = g_strsplit (expanded, ";", -1);
+
+                for (ii = 0; paths[ii] != NULL; ii++)
+                        g_ptr_array_add (
+                                files, g_build_filename (
+                                paths[ii], "mame.ini", NULL));
+
+                g_strfreev (paths);
+                g_free (expanded);
         }
 
-        if (stdout_lines != NULL)
-                *stdout_lines = local_stdout_lines;
-        else
-                g_strfreev (local_stdout_lines);
+        g_ptr_array_add (files, NULL);
 
-        if (stderr_lines != NULL)
-                *stderr_lines = local_stderr_lines;
-        else
-                g_strfreev (local_stderr_lines);
+        return (gchar **) g_ptr_array_free (files, FALSE);
+}
 
-        g_assert (WIFEXITED (status));
-        status = WEXITSTATUS (status);
+static void
+mame_config_parse (gchar **lines)
+{
+        guint ii;
+
+        /* Output is as follows:
+         *
+         * # Lines that start with '#' are comments.
+         * config_key           config_value
+         * config_key           config_value
+         * ...
+         */
 
-fail:
-        g_object_unref (process);
+        mame_config = g_hash_table_new_full (
+                g_str_hash, g_str_equal, g_free, g_free);
 
-        return status;
+        for (ii = 0; lines != NULL && lines[ii] != NULL; ii++)
+        {
+                gchar *line = g_strstrip (lines[ii]);
+                gchar *cp;
+
+                if (*line == '\0' || *line == '#')
+                        continue;
+
+                cp = line + strcspn (line, " \t");
+
+                if (*cp != '\0')
+                        *cp++ = '\0';
+
+                g_hash_table_insert (
+                        mame_config, g_strdup (line),
+                        g_strdup (g_strstrip (cp)));
+        }
+
+        mame_config_files = mame_config_list_files ();
+        mame_config_fingerprint = mame_config_get_fingerprint ();
 }
 
-/**
- * gva_mame_get_version:
- * @error: return location for a #GError, or %NULL
- *
- * Returns the version of the MAME executable that
- * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  If an
- * error occurs, it returns %NULL and sets @error.
- *
- * Returns: the MAME version, or %NULL
- **/
-gchar *
-gva_mame_get_version (GError **error)
+static gchar *
+mame_config_parse_version (gchar **lines)
 {
-        gchar *version = NULL;
-        gchar **lines;
         gchar *cp;
 
-        /* Execute the command "${mame} -help". */
-        if (gva_mame_command ("-help", &lines, NULL, error) != 0)
-                return NULL;
-
         /* Output is as follows:
          *
          * M.A.M.E. v0.xxx (Mmm dd yyyy) - Multiple Arcade Machine Emulator
@@ -190,24 +503,412 @@ gva_mame_get_version (GError **error)
          */
 
         if (lines == NULL || lines[0] == NULL)
-                goto exit;
+                return NULL;
 
         cp = strstr (lines[0], " - Multiple Arcade Machine Emulator");
-        if (cp != NULL)
+        if (cp == NULL)
+                return NULL;
+
+        return g_strndup (lines[0], cp - lines[0]);
+}
+
+/* Loads what the game database recorded about the MAME executable, if
+ * neither it nor its configuration files have changed since. */
+static gboolean
+mame_config_restore (void)
+{
+        gchar *fingerprint;
+        gchar *version;
+        gchar *showconfig;
+        gchar **lines;
+        gboolean valid;
+
+        if (!gva_db_get_emulator (
+                MAME_PROGRAM, &fingerprint, &version, &showconfig))
+                return FALSE;
+
+        lines = g_strsplit (showconfig, "\n", -1);
+        mame_config_parse (lines);
+        g_strfreev (lines);
+
+        valid = (strcmp (fingerprint, mame_config_fingerprint) == 0);
+
+        if (valid)
         {
-                *cp = '\0';
-                version = g_strdup (lines[0]);
+                mame_config_version = version;
+        }
+        else
+        {
+                mame_config_invalidate ();
+                g_free (version);
         }
 
-exit:
-        if (version == NULL)
+        g_free (fingerprint);
+        g_free (showconfig);
+
+        return valid;
+}
+
+/* Returns how the cache was found valid, or NULL if it must be reloaded. */
+static const gchar *
+mame_config_check (void)
+{
+        if (mame_config != NULL)
+        {
+                gchar *fingerprint;
+                gboolean unchanged;
+
+                fingerprint = mame_config_get_fingerprint ();
+                unchanged = (strcmp (fingerprint, mame_config_fingerprint) == 0);
+                g_free (fingerprint);
+
+                if (unchanged)
+                        return "hit";
+
+                mame_config_invalidate ();
+        }
+
+        if (mame_config_restore ())
+                return "hit (restored from database)";
+
+        return NULL;
+}
+
+/* Looks up the MAME version if @config_key is NULL, or else the value
+ * of @config_key, in the loaded cache. */
+static gchar *
+mame_config_get_cached (const gchar *config_key,
+                        GError **error)
+{
+        gchar *value;
+
+        if (config_key == NULL)
+        {
+                value = g_strdup (mame_config_version);
+
+                if (value == NULL)
+                        g_set_error (
+                                error, GVA_ERROR, GVA_ERROR_MAME,
+                                _("Could not determine emulator version"));
+        }
+        else
+        {
+                value = g_strdup (
+                        g_hash_table_lookup (mame_config, config_key));
+
+                if (value != NULL)
+                        mame_expand_string (&value);
+                else
+                        g_set_error (
+                                error, GVA_ERROR, GVA_ERROR_MAME,
+                                _("%s: No such configuration key"),
+                                config_key);
+        }
+
+        return value;
+}
+
+static void
+mame_config_resolve (GSimpleAsyncResult *simple,
+                     const gchar *config_key)
+{
+        gchar *value;
+        GError *error = NULL;
+
+        value = mame_config_get_cached (config_key, &error);
+
+        if (value != NULL)
+                g_simple_async_result_set_op_res_gpointer (
+                        simple, value, (GDestroyNotify) g_free);
+        else
+                g_simple_async_result_take_error (simple, error);
+}
+
+static void
+mame_config_load_done (void)
+{
+        GSList *waiters;
+        gchar **lines = NULL;
+        gint status;
+        GError *error = NULL;
+        GError *local_error = NULL;
+
+        status = gva_mame_command_finish (
+                mame_config_showconfig_result, &lines, NULL, &error);
+
+        if (status == 0)
+        {
+                gchar *showconfig;
+
+                /* Parsing modifies the lines, so save them first. */
+                showconfig = (lines != NULL) ?
+                        g_strjoinv ("\n", lines) : g_strdup ("");
+                mame_config_parse (lines);
+                g_strfreev (lines);
+                lines = NULL;
+
+                status = gva_mame_command_finish (
+                        mame_config_help_result, &lines, NULL, &local_error);
+                gva_error_handle (&local_error);
+
+                if (status == 0)
+                        mame_config_version = mame_config_parse_version (lines);
+
+                gva_db_set_emulator (
+                        MAME_PROGRAM, mame_config_fingerprint,
+                        mame_config_version, showconfig, &local_error);
+                gva_error_handle (&local_error);
+
+                g_free (showconfig);
+        }
+        else if (error == NULL)
+        {
                 g_set_error (
-                        error, GVA_ERROR, GVA_ERROR_MAME,
-                        _("Could not determine emulator version"));
+                        &error, GVA_ERROR, GVA_ERROR_MAME,
+                        "MAME -showconfig exited with status %d", status);
+        }
 
         g_strfreev (lines);
 
-        return version;
+        g_object_unref (mame_config_showconfig_result);
+        mame_config_showconfig_result = NULL;
+
+        g_object_unref (mame_config_help_result);
+        mame_config_help_result = NULL;
+
+        /* Detach the list first in case a callback starts a new load. */
+        waiters = mame_config_waiters;
+        mame_config_waiters = NULL;
+
+        while (waiters != NULL)
+        {
+                MameConfigWaiter *waiter = waiters->data;
+
+                if (g_cancellable_set_error_if_cancelled (
+                        waiter->cancellable, &local_error))
+                        g_simple_async_result_take_error (
+                                waiter->simple, local_error);
+                else if (error != NULL)
+                        g_simple_async_result_set_from_error (
+                                waiter->simple, error);
+                else
+                        mame_config_resolve (
+                                waiter->simple, waiter->config_key);
+
+                local_error = NULL;
+
+                g_simple_async_result_complete (waiter->simple);
+
+                g_object_unref (waiter->simple);
+                if (waiter->cancellable != NULL)
+                        g_object_unref (waiter->cancellable);
+                g_free (waiter->config_key);
+                g_slice_free (MameConfigWaiter, waiter);
+
+                waiters = g_slist_delete_link (waiters, waiters);
+        }
+
+        if (error != NULL)
+                g_error_free (error);
+}
+
+static void
+mame_config_command_cb (GObject *source_object,
+                        GAsyncResult *result,
+                        GAsyncResult **p_result)
+{
+        *p_result = g_object_ref (result);
+
+        if (mame_config_showconfig_result != NULL &&
+            mame_config_help_result != NULL)
+                mame_config_load_done ();
+}
+
+/* Returns %TRUE if a lookup of @config_key can be answered from the
+ * cache, or %FALSE if the cache must be reloaded first. */
+static gboolean
+mame_config_lookup_cached (const gchar *config_key)
+{
+        const gchar *outcome;
+
+        /* Don't revalidate the cache while it's being reloaded. */
+        outcome = (mame_config_waiters == NULL) ?
+                mame_config_check () : NULL;
+
+        if (outcome != NULL)
+                mame_config_hits++;
+        else
+                mame_config_misses++;
+
+        g_log (
+                G_LOG_DOMAIN, GVA_DEBUG_MAME,
+                "Configuration cache %s for %s (%u hits, %u misses)",
+                (outcome != NULL) ? outcome : "miss",
+                (config_key != NULL) ? config_key : "the version",
+                mame_config_hits, mame_config_misses);
+
+        return (outcome != NULL);
+}
+
+/* Reloads the cache and then looks up @config_key.  "MAME -showconfig"
+ * and "MAME -help" run concurrently, and lookups made meanwhile wait
+ * for the same commands. */
+static void
+mame_config_reload_async (const gchar *config_key,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data,
+                          gpointer source_tag)
+{
+        MameConfigWaiter *waiter;
+
+        waiter = g_slice_new0 (MameConfigWaiter);
+        waiter->simple = g_simple_async_result_new (
+                NULL, callback, user_data, source_tag);
+        waiter->config_key = g_strdup (config_key);
+        if (cancellable != NULL)
+                waiter->cancellable = g_object_ref (cancellable);
+
+        mame_config_waiters = g_slist_append (mame_config_waiters, waiter);
+
+        /* Start a reload unless one is already in progress. */
+        if (mame_config_waiters->next != NULL)
+                return;
+
+        /* Execute the commands "${mame} -showconfig" and
+         * "${mame} -help". */
+        gva_mame_command_async (
+                "-showconfig", NULL, (GAsyncReadyCallback)
+                mame_config_command_cb, &mame_config_showconfig_result);
+        gva_mame_command_async (
+                "-help", NULL, (GAsyncReadyCallback)
+                mame_config_command_cb, &mame_config_help_result);
+}
+
+/* Looks up the MAME version if @config_key is NULL, or else the value
+ * of @config_key. */
+static void
+mame_config_lookup_async (const gchar *config_key,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data,
+                          gpointer source_tag)
+{
+        GSimpleAsyncResult *simple;
+
+        if (!mame_config_lookup_cached (config_key))
+        {
+                mame_config_reload_async (
+                        config_key, cancellable,
+                        callback, user_data, source_tag);
+                return;
+        }
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data, source_tag);
+        mame_config_resolve (simple, config_key);
+        g_simple_async_result_complete_in_idle (simple);
+        g_object_unref (simple);
+}
+
+static gchar *
+mame_config_lookup_finish (GAsyncResult *result,
+                           gpointer source_tag,
+                           GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, source_tag), NULL);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return NULL;
+
+        return g_strdup (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
+/* Blocking counterpart of mame_config_lookup_async().  Cache hits
+ * return right away; only a reload runs the main loop. */
+static gchar *
+mame_config_lookup (const gchar *config_key,
+                    gpointer source_tag,
+                    GError **error)
+{
+        GAsyncResult *result = NULL;
+        gchar *value;
+
+        if (mame_config_lookup_cached (config_key))
+                return mame_config_get_cached (config_key, error);
+
+        mame_config_reload_async (
+                config_key, NULL, (GAsyncReadyCallback)
+                mame_sync_cb, &result, source_tag);
+        mame_sync_wait (&result);
+
+        value = mame_config_lookup_finish (result, source_tag, error);
+        g_object_unref (result);
+
+        return value;
+}
+
+/**
+ * gva_mame_get_version_async:
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the version is known
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously determines the version of the MAME executable that
+ * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  Call
+ * gva_mame_get_version_finish() from @callback to get the result.
+ **/
+void
+gva_mame_get_version_async (GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+        mame_config_lookup_async (
+                NULL, cancellable, callback, user_data,
+                gva_mame_get_version_async);
+}
+
+/**
+ * gva_mame_get_version_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_get_version_async().
+ * If an error occurred, it returns %NULL and sets @error.
+ *
+ * Returns: the MAME version, or %NULL
+ **/
+gchar *
+gva_mame_get_version_finish (GAsyncResult *result,
+                             GError **error)
+{
+        return mame_config_lookup_finish (
+                result, gva_mame_get_version_async, error);
+}
+
+/**
+ * gva_mame_get_version:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns the version of the MAME executable that
+ * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  If an
+ * error occurs, it returns %NULL and sets @error.
+ *
+ * The version is cached along with MAME's configuration; see
+ * gva_mame_get_config_value().
+ *
+ * Returns: the MAME version, or %NULL
+ **/
+gchar *
+gva_mame_get_version (GError **error)
+{
+        return mame_config_lookup (NULL, gva_mame_get_version_async, error);
 }
 
 /**
@@ -257,25 +958,23 @@ gva_mame_get_version_int (void)
         return version_int;
 }
 
-/**
- * gva_mame_get_total_supported:
- * @error: return location for a #GError, or %NULL
- *
- * Returns the number of games supported by the MAME executable that
- * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  If an
- * error occurs, it returns zero and sets @error.
- *
- * Returns: number of supported games, or zero
- **/
-guint
-gva_mame_get_total_supported (GError **error)
+static void
+mame_get_total_supported_cb (GObject *source_object,
+                             GAsyncResult *result,
+                             GSimpleAsyncResult *simple)
 {
-        gchar **lines;
+        gchar **lines = NULL;
         guint num_lines;
+        GError *error = NULL;
 
-        /* Execute the command "${mame} -listfull". */
-        if (gva_mame_command ("-listfull", &lines, NULL, error) != 0)
-                return 0;
+        if (gva_mame_command_finish (result, &lines, NULL, &error) != 0)
+        {
+                if (error != NULL)
+                        g_simple_async_result_take_error (simple, error);
+                else
+                        g_strfreev (lines);
+                goto exit;
+        }
 
         /* Output is as follows:
          *
@@ -290,7 +989,138 @@ gva_mame_get_total_supported (GError **error)
         g_strfreev (lines);
 
         /* Count the lines, excluding the header. */
-        return (num_lines > 1) ? num_lines - 1 : 0;
+        g_simple_async_result_set_op_res_gssize (
+                simple, (num_lines > 1) ? num_lines - 1 : 0);
+
+exit:
+        g_simple_async_result_complete (simple);
+        g_object_unref (simple);
+}
+
+/**
+ * gva_mame_get_total_supported_async:
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the count is known
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously counts the games supported by the MAME executable that
+ * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  Call
+ * gva_mame_get_total_supported_finish() from @callback to get the
+ * result.
+ **/
+void
+gva_mame_get_total_supported_async (GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+        GSimpleAsyncResult *simple;
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data,
+                gva_mame_get_total_supported_async);
+
+        /* Execute the command "${mame} -listfull". */
+        gva_mame_command_async (
+                "-listfull", cancellable, (GAsyncReadyCallback)
+                mame_get_total_supported_cb, simple);
+}
+
+/**
+ * gva_mame_get_total_supported_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with
+ * gva_mame_get_total_supported_async().  If an error occurred, it
+ * returns zero and sets @error.
+ *
+ * Returns: number of supported games, or zero
+ **/
+guint
+gva_mame_get_total_supported_finish (GAsyncResult *result,
+                                     GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_mame_get_total_supported_async), 0);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return 0;
+
+        return (guint) g_simple_async_result_get_op_res_gssize (simple);
+}
+
+/**
+ * gva_mame_get_total_supported:
+ * @error: return location for a #GError, or %NULL
+ *
+ * Returns the number of games supported by the MAME executable that
+ * <emphasis>GNOME Video Arcade</emphasis> is configured to use.  If an
+ * error occurs, it returns zero and sets @error.
+ *
+ * Returns: number of supported games, or zero
+ **/
+guint
+gva_mame_get_total_supported (GError **error)
+{
+        GAsyncResult *result = NULL;
+        guint total_supported;
+
+        gva_mame_get_total_supported_async (
+                NULL, (GAsyncReadyCallback) mame_sync_cb, &result);
+        mame_sync_wait (&result);
+
+        total_supported = gva_mame_get_total_supported_finish (result, error);
+        g_object_unref (result);
+
+        return total_supported;
+}
+
+/**
+ * gva_mame_get_config_value_async:
+ * @config_key: a configuration key
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the value is known
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously looks up the value of @config_key in MAME's
+ * configuration.  Call gva_mame_get_config_value_finish() from
+ * @callback to get the result.
+ **/
+void
+gva_mame_get_config_value_async (const gchar *config_key,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        g_return_if_fail (config_key != NULL);
+
+        mame_config_lookup_async (
+                config_key, cancellable, callback, user_data,
+                gva_mame_get_config_value_async);
+}
+
+/**
+ * gva_mame_get_config_value_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_get_config_value_async().
+ * If an error occurred, or if the configuration key was not found, it
+ * returns %NULL and sets @error.
+ *
+ * Returns: the value of the configuration key, or %NULL
+ **/
+gchar *
+gva_mame_get_config_value_finish (GAsyncResult *result,
+                                  GError **error)
+{
+        return mame_config_lookup_finish (
+                result, gva_mame_get_config_value_async, error);
 }
 
 /**
@@ -298,60 +1128,24 @@ gva_mame_get_total_supported (GError **error)
  * @config_key: a configuration key
  * @error: return location for a #GError, or %NULL
  *
- * Runs "MAME -showconfig" and extracts from the output the value of
+ * Extracts from the output of "MAME -showconfig" the value of
  * @config_key.  If an error occurs, or if @config_key is not found in
  * MAME's configuration, the function returns %NULL and sets @error.
  *
+ * The output is cached until the MAME executable or its
+ * <filename>mame.ini</filename> file changes, and the cache is saved
+ * in the game database, so most calls need not run MAME.
+ *
  * Returns: the value of @config_key, or %NULL
  **/
 gchar *
 gva_mame_get_config_value (const gchar *config_key,
                            GError **error)
 {
-        gchar *config_value = NULL;
-        gchar **lines;
-        guint num_lines, ii;
-
         g_return_val_if_fail (config_key != NULL, NULL);
 
-        /* Execute the command "${mame} -showconfig". */
-        if (gva_mame_command ("-showconfig", &lines, NULL, error) != 0)
-                return NULL;
-
-        /* Output is as follows:
-         *
-         * # Lines that start with '#' are comments.
-         * config_key           config_value
-         * config_key           config_value
-         * ...
-         */
-
-        num_lines = (lines != NULL) ? g_strv_length (lines) : 0;
-
-        for (ii = 0; ii < num_lines; ii++)
-        {
-                if (g_str_has_prefix (lines[ii], config_key))
-                {
-                        gchar *cp = lines[ii] + strlen (config_key);
-                        config_value = g_strdup (g_strstrip (cp));
-                        break;
-                }
-        }
-
-        g_strfreev (lines);
-
-        if (config_value != NULL)
-        {
-                mame_expand_string (&config_value);
-        }
-        else
-        {
-                g_set_error (
-                        error, GVA_ERROR, GVA_ERROR_MAME,
-                        _("%s: No such configuration key"), config_key);
-        }
-
-        return config_value;
+        return mame_config_lookup (
+                config_key, gva_mame_get_config_value_async, error);
 }
 
 /**
@@ -389,6 +1183,21 @@ gva_mame_has_config_value (const gchar *config_key)
         return result;
 }
 
+static gchar **
+mame_split_search_paths (const gchar *config_value)
+{
+        gchar **search_paths;
+        guint ii;
+
+        search_paths = g_strsplit (config_value, ";", -1);
+        g_return_val_if_fail (search_paths != NULL, NULL);
+
+        for (ii = 0; search_paths[ii] != NULL; ii++)
+                mame_expand_string (&search_paths[ii]);
+
+        return search_paths;
+}
+
 /**
  * gva_mame_get_search_paths:
  * @config_key: a configuration key
@@ -409,17 +1218,67 @@ gva_mame_get_search_paths (const gchar *config_key,
 {
         gchar *config_value;
         gchar **search_paths;
-        guint ii;
 
         config_value = gva_mame_get_config_value (config_key, error);
         if (config_value == NULL)
                 return NULL;
 
-        search_paths = g_strsplit (config_value, ";", -1);
-        g_return_val_if_fail (search_paths != NULL, NULL);
+        search_paths = mame_split_search_paths (config_value);
+        g_free (config_value);
 
-        for (ii = 0; search_paths[ii] != NULL; ii++)
-                mame_expand_string (&search_paths[ii]);
+        return search_paths;
+}
+
+/**
+ * gva_mame_get_search_paths_async:
+ * @config_key: a configuration key
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the paths are known
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously looks up the value of @config_key as an ordered list of
+ * search paths, like gva_mame_get_search_paths().  Call
+ * gva_mame_get_search_paths_finish() from @callback to get the result.
+ **/
+void
+gva_mame_get_search_paths_async (const gchar *config_key,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+        g_return_if_fail (config_key != NULL);
+
+        mame_config_lookup_async (
+                config_key, cancellable, callback, user_data,
+                gva_mame_get_search_paths_async);
+}
+
+/**
+ * gva_mame_get_search_paths_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_get_search_paths_async().
+ * If an error occurred, or if the configuration key was not found, it
+ * returns %NULL and sets @error.
+ *
+ * Returns: a newly-allocated %NULL-terminated array of paths, or %NULL.
+ *          Use g_strfreev() to free it.
+ **/
+gchar **
+gva_mame_get_search_paths_finish (GAsyncResult *result,
+                                  GError **error)
+{
+        gchar *config_value;
+        gchar **search_paths;
+
+        config_value = mame_config_lookup_finish (
+                result, gva_mame_get_search_paths_async, error);
+        if (config_value == NULL)
+                return NULL;
+
+        search_paths = mame_split_search_paths (config_value);
+        g_free (config_value);
 
         return search_paths;
 }
@@ -488,37 +1347,52 @@ gva_mame_list_xml (GError **error)
 }
 
 /**
- * gva_mame_verify_roms:
- * @name: the name of a ROM set
+ * gva_mame_list_xml_game:
+ * @name: the name of a game
  * @error: return location for a #GError, or %NULL
  *
- * Verifies the contents of the ROM set @name and returns the status, which
- * may be "good", "bad", "best available", "not found", or "not supported".
- * If an error occurs, it returns %NULL and sets @error.
+ * Spawns a "MAME -listxml" child process for @name alone and returns a
+ * #GvaProcess so the output can be read asynchronously.  MAME also lists
+ * the devices the game uses.  If an error occurs while spawning, it
+ * returns %NULL and sets @error.
  *
- * Returns: verification status, or %NULL
+ * Returns: a new #GvaProcess, or %NULL
  **/
-gchar *
-gva_mame_verify_roms (const gchar *name,
-                      GError **error)
+GvaProcess *
+gva_mame_list_xml_game (const gchar *name,
+                        GError **error)
 {
+        GvaProcess *process;
         gchar *arguments;
-        gchar **stdout_lines;
-        gchar **stderr_lines;
-        gchar *status = NULL;
-        gint exit_status;
-        gint ii;
 
         g_return_val_if_fail (name != NULL, NULL);
 
-        /* Execute the command "${mame} -verifyroms %{name}". */
-        arguments = g_strdup_printf ("-verifyroms %s", name);
-        exit_status = gva_mame_command (
-                arguments, &stdout_lines, &stderr_lines, error);
+        /* Execute the command "${mame} -listxml ${name}". */
+        arguments = g_strdup_printf ("-listxml %s", name);
+        process = gva_mame_process_spawn (
+                arguments, G_PRIORITY_DEFAULT_IDLE, error);
         g_free (arguments);
 
-        if (exit_status < 0)
-                return NULL;
+        return process;
+}
+
+static void
+mame_verify_cb (GObject *source_object,
+                GAsyncResult *result,
+                GSimpleAsyncResult *simple)
+{
+        gchar **stdout_lines;
+        gchar **stderr_lines;
+        gchar *status = NULL;
+        GError *error = NULL;
+        gint ii;
+
+        if (gva_mame_command_finish (
+                result, &stdout_lines, &stderr_lines, &error) < 0)
+        {
+                g_simple_async_result_take_error (simple, error);
+                goto exit;
+        }
 
         /* First try to extract a status from standard output. */
         for (ii = 0; status == NULL && stdout_lines[ii] != NULL; ii++)
@@ -531,9 +1405,172 @@ gva_mame_verify_roms (const gchar *name,
         g_strfreev (stdout_lines);
         g_strfreev (stderr_lines);
 
+        g_simple_async_result_set_op_res_gpointer (
+                simple, status, (GDestroyNotify) g_free);
+
+exit:
+        g_simple_async_result_complete (simple);
+        g_object_unref (simple);
+}
+
+static void
+mame_verify_async (const gchar *option,
+                   const gchar *name,
+                   GCancellable *cancellable,
+                   GAsyncReadyCallback callback,
+                   gpointer user_data,
+                   gpointer source_tag)
+{
+        GSimpleAsyncResult *simple;
+        gchar *arguments;
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data, source_tag);
+
+        arguments = g_strdup_printf ("%s %s", option, name);
+        gva_mame_command_async (
+                arguments, cancellable,
+                (GAsyncReadyCallback) mame_verify_cb, simple);
+        g_free (arguments);
+}
+
+static gchar *
+mame_verify_finish (GAsyncResult *result,
+                    gpointer source_tag,
+                    GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, source_tag), NULL);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return NULL;
+
+        return g_strdup (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
+/**
+ * gva_mame_verify_roms_async:
+ * @name: the name of a ROM set
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when verification finishes
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously verifies the contents of the ROM set @name.  Call
+ * gva_mame_verify_roms_finish() from @callback to get the status.
+ **/
+void
+gva_mame_verify_roms_async (const gchar *name,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+        g_return_if_fail (name != NULL);
+
+        /* Execute the command "${mame} -verifyroms %{name}". */
+        mame_verify_async (
+                "-verifyroms", name, cancellable, callback,
+                user_data, gva_mame_verify_roms_async);
+}
+
+/**
+ * gva_mame_verify_roms_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_verify_roms_async() and
+ * returns the status, which may be "good", "bad", "best available",
+ * "not found", or "not supported".  If an error occurred, it returns
+ * %NULL and sets @error.
+ *
+ * Returns: verification status, or %NULL
+ **/
+gchar *
+gva_mame_verify_roms_finish (GAsyncResult *result,
+                             GError **error)
+{
+        return mame_verify_finish (
+                result, gva_mame_verify_roms_async, error);
+}
+
+/**
+ * gva_mame_verify_roms:
+ * @name: the name of a ROM set
+ * @error: return location for a #GError, or %NULL
+ *
+ * Verifies the contents of the ROM set @name and returns the status, which
+ * may be "good", "bad", "best available", "not found", or "not supported".
+ * If an error occurs, it returns %NULL and sets @error.
+ *
+ * Returns: verification status, or %NULL
+ **/
+gchar *
+gva_mame_verify_roms (const gchar *name,
+                      GError **error)
+{
+        GAsyncResult *result = NULL;
+        gchar *status;
+
+        g_return_val_if_fail (name != NULL, NULL);
+
+        gva_mame_verify_roms_async (
+                name, NULL, (GAsyncReadyCallback) mame_sync_cb, &result);
+        mame_sync_wait (&result);
+
+        status = gva_mame_verify_roms_finish (result, error);
+        g_object_unref (result);
+
         return status;
 }
 
+/**
+ * gva_mame_verify_samples_async:
+ * @name: the name of a sample set
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when verification finishes
+ * @user_data: data to pass to @callback
+ *
+ * Asynchronously verifies the contents of the sample set @name.  Call
+ * gva_mame_verify_samples_finish() from @callback to get the status.
+ **/
+void
+gva_mame_verify_samples_async (const gchar *name,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+        g_return_if_fail (name != NULL);
+
+        /* Execute the command "${mame} -verifysamples %{name}". */
+        mame_verify_async (
+                "-verifysamples", name, cancellable, callback,
+                user_data, gva_mame_verify_samples_async);
+}
+
+/**
+ * gva_mame_verify_samples_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_mame_verify_samples_async()
+ * and returns the status, which may be "good", "bad", "best available",
+ * "not found", or "not supported".  If an error occurred, it returns
+ * %NULL and sets @error.
+ *
+ * Returns: verification status, or %NULL
+ **/
+gchar *
+gva_mame_verify_samples_finish (GAsyncResult *result,
+                                GError **error)
+{
+        return mame_verify_finish (
+                result, gva_mame_verify_samples_async, error);
+}
+
 /**
  * gva_mame_verify_samples:
  * @name: the name of a sample set
@@ -549,34 +1586,17 @@ gchar *
 gva_mame_verify_samples (const gchar *name,
                          GError **error)
 {
-        gchar *arguments;
-        gchar **stdout_lines;
-        gchar **stderr_lines;
-        gchar *status = NULL;
-        gint exit_status;
-        gint ii;
+        GAsyncResult *result = NULL;
+        gchar *status;
 
         g_return_val_if_fail (name != NULL, NULL);
 
-        /* Execute the command "${mame} -verifysamples %{name}". */
-        arguments = g_strdup_printf ("-verifysamples %s", name);
-        exit_status = gva_mame_command (
-                arguments, &stdout_lines, &stderr_lines, error);
-        g_free (arguments);
-
-        if (exit_status < 0)
-                return NULL;
-
-        /* First try to extract a status from standard output. */
-        for (ii = 0; status == NULL && stdout_lines[ii] != NULL; ii++)
-                gva_mame_verify_parse (stdout_lines[ii], NULL, &status);
-
-        /* If that fails, try to extract a status from standard error. */
-        for (ii = 0; status == NULL && stderr_lines[ii] != NULL; ii++)
-                gva_mame_verify_parse (stderr_lines[ii], NULL, &status);
+        gva_mame_verify_samples_async (
+                name, NULL, (GAsyncReadyCallback) mame_sync_cb, &result);
+        mame_sync_wait (&result);
 
-        g_strfreev (stdout_lines);
-        g_strfreev (stderr_lines);
+        status = gva_mame_verify_samples_finish (result, error);
+        g_object_unref (result);
 
         return status;
 }
@@ -617,6 +1637,71 @@ gva_mame_verify_all_samples (GError **error)
                 "-verifysamples", G_PRIORITY_DEFAULT_IDLE, error);
 }
 
+/**
+ * gva_mame_verify_some_roms:
+ * @names: a %NULL-terminated array of ROM set names
+ * @error: return location for a #GError, or %NULL
+ *
+ * Spawns a "MAME -verifyroms" child process for the ROM sets in @names
+ * and returns a #GvaProcess so the output can be read asynchronously.
+ * If an error occurs while spawning, it returns %NULL and sets @error.
+ *
+ * Returns: a new #GvaProcess, or %NULL
+ **/
+GvaProcess *
+gva_mame_verify_some_roms (gchar **names,
+                           GError **error)
+{
+        GvaProcess *process;
+        gchar *arguments;
+        gchar *joined;
+
+        g_return_val_if_fail (names != NULL, NULL);
+
+        /* Execute the command "${mame} -verifyroms %{names}". */
+        joined = g_strjoinv (" ", names);
+        arguments = g_strdup_printf ("-verifyroms %s", joined);
+        process = gva_mame_process_spawn (
+                arguments, G_PRIORITY_DEFAULT_IDLE, error);
+        g_free (arguments);
+        g_free (joined);
+
+        return process;
+}
+
+/**
+ * gva_mame_verify_some_samples:
+ * @names: a %NULL-terminated array of sample set names
+ * @error: return location for a #GError, or %NULL
+ *
+ * Spawns a "MAME -verifysamples" child process for the sample sets in
+ * @names and returns a #GvaProcess so the output can be read
+ * asynchronously.  If an error occurs while spawning, it returns %NULL
+ * and sets @error.
+ *
+ * Returns: a new #GvaProcess, or %NULL
+ **/
+GvaProcess *
+gva_mame_verify_some_samples (gchar **names,
+                              GError **error)
+{
+        GvaProcess *process;
+        gchar *arguments;
+        gchar *joined;
+
+        g_return_val_if_fail (names != NULL, NULL);
+
+        /* Execute the command "${mame} -verifysamples %{names}". */
+        joined = g_strjoinv (" ", names);
+        arguments = g_strdup_printf ("-verifysamples %s", joined);
+        process = gva_mame_process_spawn (
+                arguments, G_PRIORITY_DEFAULT_IDLE, error);
+        g_free (arguments);
+        g_free (joined);
+
+        return process;
+}
+
 /**
  * gva_mame_verify_parse:
  * @line: output line from a MAME process
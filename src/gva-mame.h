@@ -31,42 +31,90 @@
 
 G_BEGIN_DECLS
 
-gint            gva_mame_command                (const gchar *arguments,
-                                                 gchar ***stdout_lines,
-                                                 gchar ***stderr_lines,
-                                                 GError **error);
-gchar *         gva_mame_get_version            (GError **error);
-guint           gva_mame_get_version_int        (void);
-guint           gva_mame_get_total_supported    (GError **error);
-gchar *         gva_mame_get_config_value       (const gchar *config_key,
-                                                 GError **error);
-gboolean        gva_mame_has_config_value       (const gchar *config_key);
-gchar **        gva_mame_get_search_paths       (const gchar *config_key,
-                                                 GError **error);
-GList *         gva_mame_get_input_files        (GError **error);
-GvaProcess *    gva_mame_list_xml               (GError **error);
-gchar *         gva_mame_verify_roms            (const gchar *name,
-                                                 GError **error);
-gchar *         gva_mame_verify_samples         (const gchar *name,
-                                                 GError **error);
-GvaProcess *    gva_mame_verify_all_roms        (GError **error);
-GvaProcess *    gva_mame_verify_all_samples     (GError **error);
-gboolean        gva_mame_verify_parse           (const gchar *line,
-                                                 gchar **out_name,
-                                                 gchar **out_status);
-GvaProcess *    gva_mame_run_game               (const gchar *name,
-                                                 GError **error);
-GvaProcess *    gva_mame_record_game            (const gchar *name,
-                                                 const gchar *inpname,
-                                                 GError **error);
-GvaProcess *    gva_mame_playback_game          (const gchar *name,
-                                                 const gchar *inpname,
-                                                 GError **error);
-gchar *         gva_mame_get_save_state_file    (const gchar *name);
-void            gva_mame_delete_save_state      (const gchar *name);
-const gchar *   gva_mame_get_input_directory    (GError **error);
-const gchar *   gva_mame_get_snapshot_directory (GError **error);
-const gchar *   gva_mame_get_state_directory    (GError **error);
+void            gva_mame_command_async              (const gchar *arguments,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gint            gva_mame_command_finish             (GAsyncResult *result,
+                                                     gchar ***stdout_lines,
+                                                     gchar ***stderr_lines,
+                                                     GError **error);
+gint            gva_mame_command                    (const gchar *arguments,
+                                                     gchar ***stdout_lines,
+                                                     gchar ***stderr_lines,
+                                                     GError **error);
+void            gva_mame_get_version_async          (GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar *         gva_mame_get_version_finish         (GAsyncResult *result,
+                                                     GError **error);
+gchar *         gva_mame_get_version                (GError **error);
+guint           gva_mame_get_version_int            (void);
+void            gva_mame_get_total_supported_async  (GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+guint           gva_mame_get_total_supported_finish (GAsyncResult *result,
+                                                     GError **error);
+guint           gva_mame_get_total_supported        (GError **error);
+void            gva_mame_get_config_value_async     (const gchar *config_key,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar *         gva_mame_get_config_value_finish    (GAsyncResult *result,
+                                                     GError **error);
+gchar *         gva_mame_get_config_value           (const gchar *config_key,
+                                                     GError **error);
+gboolean        gva_mame_has_config_value           (const gchar *config_key);
+gchar **        gva_mame_get_search_paths           (const gchar *config_key,
+                                                     GError **error);
+void            gva_mame_get_search_paths_async     (const gchar *config_key,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar **        gva_mame_get_search_paths_finish    (GAsyncResult *result,
+                                                     GError **error);
+GList *         gva_mame_get_input_files            (GError **error);
+GvaProcess *    gva_mame_list_xml                   (GError **error);
+GvaProcess *    gva_mame_list_xml_game              (const gchar *name,
+                                                     GError **error);
+void            gva_mame_verify_roms_async          (const gchar *name,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar *         gva_mame_verify_roms_finish         (GAsyncResult *result,
+                                                     GError **error);
+gchar *         gva_mame_verify_roms                (const gchar *name,
+                                                     GError **error);
+void            gva_mame_verify_samples_async       (const gchar *name,
+                                                     GCancellable *cancellable,
+                                                     GAsyncReadyCallback callback,
+                                                     gpointer user_data);
+gchar *         gva_mame_verify_samples_finish      (GAsyncResult *result,
+                                                     GError **error);
+gchar *         gva_mame_verify_samples             (const gchar *name,
+                                                     GError **error);
+GvaProcess *    gva_mame_verify_all_roms            (GError **error);
+GvaProcess *    gva_mame_verify_all_samples         (GError **error);
+GvaProcess *    gva_mame_verify_some_roms           (gchar **names,
+                                                     GError **error);
+GvaProcess *    gva_mame_verify_some_samples        (gchar **names,
+                                                     GError **error);
+gboolean        gva_mame_verify_parse               (const gchar *line,
+                                                     gchar **out_name,
+                                                     gchar **out_status);
+GvaProcess *    gva_mame_run_game                   (const gchar *name,
+                                                     GError **error);
+GvaProcess *    gva_mame_record_game                (const gchar *name,
+                                                     const gchar *inpname,
+                                                     GError **error);
+GvaProcess *    gva_mame_playback_game              (const gchar *name,
+                                                     const gchar *inpname,
+                                                     GError **error);
+gchar *         gva_mame_get_save_state_file        (const gchar *name);
+void            gva_mame_delete_save_state          (const gchar *name);
+const gchar *   gva_mame_get_input_directory        (GError **error);
+const gchar *   gva_mame_get_snapshot_directory     (GError **error);
+const gchar *   gva_mame_get_state_directory        (GError **error);
 
 /* Test for supported options */
 
@@ -45,6 +45,7 @@ enum
 {
         STDOUT_READY,
         STDERR_READY,
+        DATA_READY,
         EXITED,
         LAST_SIGNAL
 };
@@ -59,6 +60,14 @@ struct _GvaProcessPrivate
         GQueue *stdout_lines;
         GQueue *stderr_lines;
 
+        /* Ring buffer of raw stdout bytes, used
+         * instead of stdout_lines in stream mode. */
+        gchar *ring;
+        gsize ring_size;
+        gsize ring_head;
+        gsize ring_length;
+        gboolean stdout_paused;
+
         guint child_source_id;
         guint stdout_source_id;
         guint stderr_source_id;
@@ -117,6 +126,7 @@ process_source_removed (GvaProcess *process)
 
         n_active_sources += (process->priv->child_source_id > 0);
         n_active_sources += (process->priv->stdout_source_id > 0);
+        n_active_sources += process->priv->stdout_paused;
         n_active_sources += (process->priv->stderr_source_id > 0);
 
         if (n_active_sources == 0)
@@ -182,6 +192,52 @@ process_read_line (GvaProcess *process,
         return status;
 }
 
+static GIOStatus
+process_read_stream (GvaProcess *process,
+                     GIOChannel *channel)
+{
+        GvaProcessPrivate *priv = process->priv;
+        GIOStatus status = G_IO_STATUS_NORMAL;
+        gsize total_read = 0;
+        GError *error = NULL;
+
+        /* The channel is unbuffered and non-blocking in stream mode,
+         * so keep reading until the ring buffer is full or the pipe
+         * runs dry.  The free space may wrap around the end of the
+         * buffer, so this can take more than one read. */
+        while (status == G_IO_STATUS_NORMAL &&
+               priv->ring_length < priv->ring_size)
+        {
+                gsize bytes_read = 0;
+                gsize offset;
+                gsize count;
+
+                offset = (priv->ring_head + priv->ring_length) %
+                        priv->ring_size;
+                count = MIN (
+                        priv->ring_size - priv->ring_length,
+                        priv->ring_size - offset);
+
+                status = g_io_channel_read_chars (
+                        channel, priv->ring + offset,
+                        count, &bytes_read, &error);
+
+                priv->ring_length += bytes_read;
+                total_read += bytes_read;
+        }
+
+        /* Coalesce everything read during this wakeup into one signal. */
+        if (total_read > 0)
+                g_signal_emit (process, signals[DATA_READY], 0);
+
+        if (status == G_IO_STATUS_AGAIN)
+                status = G_IO_STATUS_NORMAL;
+        else
+                process_propagate_error (process, error);
+
+        return status;
+}
+
 static gboolean
 process_stdout_ready (GIOChannel *channel,
                       GIOCondition condition,
@@ -193,7 +249,26 @@ process_stdout_ready (GIOChannel *channel,
 
         GIOStatus status;
 
-        if (condition & G_IO_IN)
+        if ((condition & G_IO_IN) && process->priv->ring != NULL)
+        {
+                status = process_read_stream (process, channel);
+
+                /* Stop watching the pipe while the ring buffer is full,
+                 * otherwise we would spin.  The child process blocks on
+                 * the full pipe until gva_process_stdout_consume() makes
+                 * room and resumes watching. */
+                if (status == G_IO_STATUS_NORMAL &&
+                    process->priv->ring_length == process->priv->ring_size)
+                {
+                        process->priv->stdout_paused = TRUE;
+                        process->priv->stdout_source_id = 0;
+                        return FALSE;
+                }
+
+                if (status == G_IO_STATUS_NORMAL)
+                        return TRUE;
+        }
+        else if (condition & G_IO_IN)
         {
                 /* For better performance, keep reading lines as long as
                  * there's more data available.  This assumes the stderr
@@ -271,6 +346,17 @@ process_debug_message (GvaProcess *process,
         g_free (copy);
 }
 
+static void
+process_watch_stdout (GvaProcess *process)
+{
+        GvaProcessPrivate *priv = process->priv;
+
+        priv->stdout_source_id = g_io_add_watch_full (
+                priv->stdout_channel, priv->priority,
+                G_IO_IN | G_IO_HUP, (GIOFunc) process_stdout_ready,
+                process, (GDestroyNotify) process_source_removed);
+}
+
 static GObject *
 process_constructor (GType type,
                      guint n_construct_properties,
@@ -290,10 +376,7 @@ process_constructor (GType type,
                 (GChildWatchFunc) process_exited, object,
                 (GDestroyNotify) process_source_removed);
 
-        priv->stdout_source_id = g_io_add_watch_full (
-                priv->stdout_channel, priv->priority,
-                G_IO_IN | G_IO_HUP, (GIOFunc) process_stdout_ready,
-                object, (GDestroyNotify) process_source_removed);
+        process_watch_stdout (GVA_PROCESS (object));
 
         priv->stderr_source_id = g_io_add_watch_full (
                 priv->stderr_channel, priv->priority,
@@ -423,6 +506,8 @@ process_finalize (GObject *object)
         g_queue_free (process->priv->stdout_lines);
         g_queue_free (process->priv->stderr_lines);
 
+        g_free (process->priv->ring);
+
         /* Chain up to parent's finalize() method. */
         G_OBJECT_CLASS (gva_process_parent_class)->finalize (object);
 }
@@ -564,6 +649,7 @@ gva_process_class_init (GvaProcessClass *class)
          *
          * The ::stdout-ready signal is emitted when one or more lines
          * from the child process' stdout pipe are available for reading.
+         * It is not emitted in stream mode; see #GvaProcess::data-ready.
          **/
         signals[STDOUT_READY] = g_signal_new (
                 "stdout-ready",
@@ -590,6 +676,26 @@ gva_process_class_init (GvaProcessClass *class)
                 g_cclosure_marshal_VOID__VOID,
                 G_TYPE_NONE, 0);
 
+        /**
+         * GvaProcess::data-ready:
+         * @process: the #GvaProcess that received the signal
+         *
+         * The ::data-ready signal is emitted in stream mode (see
+         * gva_process_set_stream_mode()) when new bytes from the child
+         * process' stdout pipe are available for reading.  It is emitted
+         * at most once per main loop wakeup, regardless of how much data
+         * arrived.  Use gva_process_stdout_peek() and
+         * gva_process_stdout_consume() to read the data.
+         **/
+        signals[DATA_READY] = g_signal_new (
+                "data-ready",
+                G_TYPE_FROM_CLASS (class),
+                G_SIGNAL_RUN_LAST,
+                G_STRUCT_OFFSET (GvaProcessClass, data_ready),
+                NULL, NULL,
+                g_cclosure_marshal_VOID__VOID,
+                G_TYPE_NONE, 0);
+
         /**
          * GvaProcess::exited:
          * @process: the #GvaProcess that received the signal
@@ -920,6 +1026,145 @@ gva_process_stderr_read_lines (GvaProcess *process)
         return lines;
 }
 
+/**
+ * gva_process_set_stream_mode:
+ * @process: a #GvaProcess
+ * @buffer_size: size of the ring buffer in bytes
+ *
+ * Switches the stdout pipe of the child process represented by @process
+ * from line-oriented reading to a byte stream stored in a preallocated
+ * ring buffer of @buffer_size bytes.  This avoids per-line allocations and
+ * signal emissions for commands that produce a lot of output, such as
+ * "MAME -listxml".  In stream mode the #GvaProcess::data-ready signal is
+ * emitted instead of #GvaProcess::stdout-ready, and the data is read with
+ * gva_process_stdout_peek() and gva_process_stdout_consume().
+ *
+ * If the ring buffer fills up, @process stops reading from the pipe until
+ * some of the data is consumed.  The #GvaProcess::exited signal is not
+ * emitted until all the data has been read from the pipe.
+ *
+ * This must be called before returning to the main loop after creating
+ * @process, and only once.
+ **/
+void
+gva_process_set_stream_mode (GvaProcess *process,
+                             gsize buffer_size)
+{
+        GIOChannel *channel;
+        GError *error = NULL;
+
+        g_return_if_fail (GVA_IS_PROCESS (process));
+        g_return_if_fail (process->priv->ring == NULL);
+        g_return_if_fail (buffer_size > 0);
+
+        channel = process->priv->stdout_channel;
+        g_return_if_fail (channel != NULL);
+
+        g_io_channel_set_buffered (channel, FALSE);
+        g_io_channel_set_flags (channel, G_IO_FLAG_NONBLOCK, &error);
+        gva_error_handle (&error);
+
+        process->priv->ring = g_malloc (buffer_size);
+        process->priv->ring_size = buffer_size;
+        process->priv->ring_head = 0;
+        process->priv->ring_length = 0;
+}
+
+/**
+ * gva_process_stdout_num_bytes:
+ * @process: a #GvaProcess
+ *
+ * Returns the number of bytes from the stdout pipe of the child process
+ * represented by @process that are buffered and not yet consumed.  This
+ * is only meaningful in stream mode.
+ *
+ * Returns: number of bytes available for reading
+ **/
+gsize
+gva_process_stdout_num_bytes (GvaProcess *process)
+{
+        g_return_val_if_fail (GVA_IS_PROCESS (process), 0);
+
+        return process->priv->ring_length;
+}
+
+/**
+ * gva_process_stdout_peek:
+ * @process: a #GvaProcess
+ * @data: return location for a pointer to the buffered data
+ *
+ * Points @data directly at the oldest unconsumed bytes from the stdout pipe
+ * of the child process represented by @process, without copying, and
+ * returns how many contiguous bytes may be read there.  Because the data
+ * lives in a ring buffer, this may be less than
+ * gva_process_stdout_num_bytes(); consume the bytes and peek again to get
+ * the rest.  The data is not nul-terminated and remains valid until the
+ * next call to gva_process_stdout_consume().  This is only valid in stream
+ * mode.  The function does not block; it returns zero if no data is
+ * available.
+ *
+ * Returns: number of contiguous bytes at @data
+ **/
+gsize
+gva_process_stdout_peek (GvaProcess *process,
+                         const gchar **data)
+{
+        GvaProcessPrivate *priv;
+
+        g_return_val_if_fail (GVA_IS_PROCESS (process), 0);
+        g_return_val_if_fail (data != NULL, 0);
+
+        priv = process->priv;
+        g_return_val_if_fail (priv->ring != NULL, 0);
+
+        *data = priv->ring + priv->ring_head;
+
+        return MIN (priv->ring_length, priv->ring_size - priv->ring_head);
+}
+
+/**
+ * gva_process_stdout_consume:
+ * @process: a #GvaProcess
+ * @length: number of bytes to discard
+ *
+ * Discards the oldest @length bytes from the stdout ring buffer of the
+ * child process represented by @process, making room for more data.
+ * This is only valid in stream mode.
+ **/
+void
+gva_process_stdout_consume (GvaProcess *process,
+                            gsize length)
+{
+        GvaProcessPrivate *priv;
+
+        g_return_if_fail (GVA_IS_PROCESS (process));
+
+        priv = process->priv;
+        g_return_if_fail (priv->ring != NULL);
+        g_return_if_fail (length <= priv->ring_length);
+
+        if (length == 0)
+                return;
+
+        g_log (
+                G_LOG_DOMAIN, GVA_DEBUG_IO,
+                "Process %d >>> (%" G_GSIZE_FORMAT " bytes)",
+                (gint) priv->pid, length);
+
+        priv->ring_head = (priv->ring_head + length) % priv->ring_size;
+        priv->ring_length -= length;
+
+        /* Rewind when empty so reads stay contiguous. */
+        if (priv->ring_length == 0)
+                priv->ring_head = 0;
+
+        if (priv->stdout_paused)
+        {
+                priv->stdout_paused = FALSE;
+                process_watch_stdout (process);
+        }
+}
+
 /**
  * gva_process_get_progress:
  * @process: a #GvaProcess
@@ -79,6 +79,7 @@ struct _GvaProcessClass
         /* Signals */
         void            (*stdout_ready)         (GvaProcess *process);
         void            (*stderr_ready)         (GvaProcess *process);
+        void            (*data_ready)           (GvaProcess *process);
         void            (*exited)               (GvaProcess *process,
                                                  gint status);
 };
@@ -103,6 +104,13 @@ gchar *         gva_process_stdout_read_line    (GvaProcess *process);
 gchar *         gva_process_stderr_read_line    (GvaProcess *process);
 gchar **        gva_process_stdout_read_lines   (GvaProcess *process);
 gchar **        gva_process_stderr_read_lines   (GvaProcess *process);
+void            gva_process_set_stream_mode     (GvaProcess *process,
+                                                 gsize buffer_size);
+gsize           gva_process_stdout_num_bytes    (GvaProcess *process);
+gsize           gva_process_stdout_peek         (GvaProcess *process,
+                                                 const gchar **data);
+void            gva_process_stdout_consume      (GvaProcess *process,
+                                                 gsize length);
 guint           gva_process_get_progress        (GvaProcess *process);
 void            gva_process_inc_progress        (GvaProcess *process);
 void            gva_process_set_progress        (GvaProcess *process,
@@ -692,6 +692,27 @@ properties_update_video (const gchar *name)
         g_free (sql);
 }
 
+static void
+properties_load_details (const gchar *game)
+{
+        GvaProcess *process;
+        GError *error = NULL;
+
+        /* ROM, disk and DIP switch details are not part of the game
+         * database build.  Load them in the background the first time
+         * a game is shown. */
+        if (gva_db_has_details (game))
+                return;
+
+        process = gva_db_load_details (game, &error);
+        gva_error_handle (&error);
+
+        if (process != NULL)
+                g_signal_connect_after (
+                        process, "exited",
+                        G_CALLBACK (g_object_unref), NULL);
+}
+
 static gboolean
 properties_update_timeout_cb (void)
 {
@@ -832,6 +853,8 @@ gva_properties_show_game (const gchar *game)
                 properties_update_status (model, &iter);
                 properties_update_video (game);
 
+                properties_load_details (game);
+
                 g_object_unref (model);
         }
 }
@@ -34,6 +34,23 @@
 #define SQL_SELECT_GAMES \
         "SELECT %s FROM available"
 
+typedef struct _TreeViewUpdate TreeViewUpdate;
+
+/* A tree view update whose rows arrive in batches. */
+struct _TreeViewUpdate
+{
+        GtkTreeModel *model;
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+        guint serial;
+        gboolean shown;
+        GError *error;
+};
+
+/* Bumped by every tree view update, so a streaming
+ * update stops once a newer update has replaced it. */
+static guint update_serial;
+
 void
 tree_view_add_search_expression (GString *expression)
 {
@@ -47,19 +64,24 @@ tree_view_add_search_expression (GString *expression)
         {
                 search_text = gva_main_get_last_search_text ();
                 if (search_text != NULL && *search_text != '\0')
+                {
+                        gchar *search_key;
+
+                        /* The bios, category, description and
+                         * manufacturer are matched on collation
+                         * keys stored in the search table. */
+                        search_key = gva_search_collate_key (search_text);
                         g_string_append_printf (
                                 expression,
                                 "(name LIKE '%s' OR "
-                                "bios MATCH '%s' OR "
-                                "category MATCH '%s' OR "
                                 "sourcefile LIKE '%s' OR "
-                                "description MATCH '%s' OR "
-                                "manufacturer MATCH '%s' OR "
-                                "year LIKE '%s')",
-                                search_text, search_text,
+                                "year LIKE '%s' OR "
+                                "name IN (SELECT name FROM search "
+                                "WHERE key GLOB '*%s*'))",
                                 search_text, search_text,
-                                search_text, search_text,
-                                search_text);
+                                search_text, search_key);
+                        g_free (search_key);
+                }
                 else
                         g_string_append (expression, "name ISNULL");
         }
@@ -68,6 +90,137 @@ tree_view_add_search_expression (GString *expression)
         g_free (search_text);
 }
 
+static void
+tree_view_add_view_expression (GString *expression)
+{
+        switch (gva_tree_view_get_selected_view ())
+        {
+                case 0:  /* Available Games */
+                        break;
+
+                case 1:  /* Favorite Games */
+                        g_string_append (expression, "favorite == \"yes\"");
+                        break;
+
+                case 2:  /* Search Results */
+                        tree_view_add_search_expression (expression);
+                        break;
+
+                default:
+                        g_assert_not_reached ();
+        }
+
+        if (!gva_preferences_get_show_clones ())
+        {
+                if (expression->len > 0)
+                        g_string_append (expression, " AND ");
+                g_string_append (expression, "cloneof ISNULL");
+        }
+}
+
+/* Returns a query for the tree view's columns of the games matching
+ * @expression, which may be empty. */
+static gchar *
+tree_view_build_query (const gchar *expression)
+{
+        GtkTreeView *view;
+        GString *string;
+        GSList *list;
+        const gchar **strv;
+        gchar *columns;
+        gint ii = 0;
+
+        view = GTK_TREE_VIEW (GVA_WIDGET_MAIN_TREE_VIEW);
+
+        /* Build a comma-separated list of column names. */
+        list = gva_columns_get_names_full (view);
+        strv = g_new0 (const gchar *, g_slist_length (list) + 1);
+        while (list != NULL)
+        {
+                strv[ii++] = list->data;
+                list = g_slist_delete_link (list, list);
+        }
+        columns = g_strjoinv (", ", (gchar **) strv);
+        g_free (strv);
+
+        string = g_string_new (NULL);
+        g_string_printf (string, SQL_SELECT_GAMES, columns);
+        g_free (columns);
+
+        if (expression != NULL && *expression != '\0')
+                g_string_append_printf (string, " WHERE %s", expression);
+
+        return g_string_free (string, FALSE);
+}
+
+/* Copies the rows for the games in @names from @changes to @model,
+ * replacing existing rows, and removes the rows for those games that
+ * are missing from @changes. */
+static void
+tree_view_merge_games (GtkTreeModel *model,
+                       GtkTreeModel *changes,
+                       gchar **names)
+{
+        guint ii;
+
+        for (ii = 0; names[ii] != NULL; ii++)
+        {
+                GtkTreePath *path;
+                GtkTreeIter iter;
+                GtkTreeIter source;
+                gboolean have_row = FALSE;
+                gboolean have_source = FALSE;
+                gint column;
+
+                path = gva_game_store_index_lookup (
+                        GVA_GAME_STORE (model), names[ii]);
+                if (path != NULL)
+                {
+                        have_row = gtk_tree_model_get_iter (
+                                model, &iter, path);
+                        gtk_tree_path_free (path);
+                }
+
+                path = gva_game_store_index_lookup (
+                        GVA_GAME_STORE (changes), names[ii]);
+                if (path != NULL)
+                {
+                        have_source = gtk_tree_model_get_iter (
+                                changes, &source, path);
+                        gtk_tree_path_free (path);
+                }
+
+                /* The game no longer belongs in the view. */
+                if (!have_source)
+                {
+                        if (have_row)
+                                gtk_list_store_remove (
+                                        GTK_LIST_STORE (model), &iter);
+                        continue;
+                }
+
+                if (!have_row)
+                {
+                        gtk_list_store_append (GTK_LIST_STORE (model), &iter);
+                        gva_game_store_index_insert (
+                                GVA_GAME_STORE (model), names[ii], &iter);
+                }
+
+                for (column = 0; column < GVA_GAME_STORE_NUM_COLUMNS; column++)
+                {
+                        GValue value;
+
+                        memset (&value, 0, sizeof (GValue));
+                        gtk_tree_model_get_value (
+                                changes, &source, column, &value);
+                        gtk_list_store_set_value (
+                                GTK_LIST_STORE (model), &iter,
+                                column, &value);
+                        g_value_unset (&value);
+                }
+        }
+}
+
 static gboolean
 tree_view_show_popup_menu (GdkEventButton *event,
                            GtkTreeViewColumn *column)
@@ -132,14 +285,39 @@ tree_view_sort_column_changed_cb (GtkTreeSortable *sortable)
         gva_tree_view_set_last_sort_column_id (column_id, order);
 }
 
+/* Sorts @model the way the user last sorted the tree view and shows it. */
+static void
+tree_view_set_model (GtkTreeModel *model)
+{
+        GvaGameStoreColumn column_id;
+        GtkSortType order;
+        GtkTreeView *view;
+
+        view = GTK_TREE_VIEW (GVA_WIDGET_MAIN_TREE_VIEW);
+
+        gva_tree_view_get_last_sort_column_id (&column_id, &order);
+
+        gtk_tree_sortable_set_sort_column_id (
+                GTK_TREE_SORTABLE (model), column_id, order);
+
+        g_signal_connect (
+                model, "sort-column-changed",
+                G_CALLBACK (tree_view_sort_column_changed_cb), NULL);
+
+        gtk_tree_view_set_model (view, model);
+        gtk_tree_view_columns_autosize (view);
+        gva_tree_view_update_status_bar ();
+}
+
 static gboolean
 tree_view_search_equal (GtkTreeModel *model,
                         gint column,
                         const gchar *key,
                         GtkTreeIter *iter)
 {
-        gchar *title;
-        gchar *s1, *s2;
+        gchar *title_key;
+        gchar search_key[256];
+        gsize length;
         gboolean retval;
 
         /* XXX In earlier versions of GVA we set the tree view search
@@ -156,21 +334,25 @@ tree_view_search_equal (GtkTreeModel *model,
          *     me that we can just hard-code it here and do away with
          *     the assertion and having to repeatedly set the search
          *     column -- just leave it unset.
+         *
+         *     The database stores the DESCRIPTION column's collation
+         *     key alongside it, so only the typed key is computed.
          */
 
-        column = GVA_GAME_STORE_COLUMN_DESCRIPTION;
-        gtk_tree_model_get (model, iter, column, &title, -1);
-        g_assert (title != NULL);
+        column = GVA_GAME_STORE_COLUMN_DESCRIPTION_KEY;
+        gtk_tree_model_get (model, iter, column, &title_key, -1);
+        g_assert (title_key != NULL);
 
-        s1 = gva_search_collate_key (key);
-        s2 = gva_search_collate_key (title);
+        /* A key too long for the buffer is truncated, which only
+         * matters for prefixes longer than anyone types. */
+        length = gva_search_collate_key_to_buffer (
+                key, search_key, sizeof (search_key));
+        length = MIN (length, sizeof (search_key) - 1);
 
         /* Return FALSE if the row matches. */
-        retval = (strncmp (s1, s2, strlen (s1)) != 0);
+        retval = (strncmp (search_key, title_key, length) != 0);
 
-        g_free (title);
-        g_free (s1);
-        g_free (s2);
+        g_free (title_key);
 
         return retval;
 }
@@ -245,30 +427,7 @@ gva_tree_view_update (GError **error)
         gboolean success;
 
         expression = g_string_sized_new (128);
-
-        switch (gva_tree_view_get_selected_view ())
-        {
-                case 0:  /* Available Games */
-                        break;
-
-                case 1:  /* Favorite Games */
-                        g_string_append (expression, "favorite == \"yes\"");
-                        break;
-
-                case 2:  /* Search Results */
-                        tree_view_add_search_expression (expression);
-                        break;
-
-                default:
-                        g_assert_not_reached ();
-        }
-
-        if (!gva_preferences_get_show_clones ())
-        {
-                if (expression->len > 0)
-                        g_string_append (expression, " AND ");
-                g_string_append (expression, "cloneof ISNULL");
-        }
+        tree_view_add_view_expression (expression);
 
         success = gva_tree_view_run_query (expression->str, error);
         g_string_free (expression, TRUE);
@@ -295,6 +454,262 @@ gva_tree_view_update (GError **error)
         return TRUE;
 }
 
+/**
+ * gva_tree_view_update_games:
+ * @names: a %NULL-terminated array of game names
+ * @error: return location for a #GError, or %NULL
+ *
+ * Refreshes only the rows for the games in @names, in place, after their
+ * records in the game database have changed.  Rows are updated, added or
+ * removed according to the criteria for the currently selected game list
+ * view, and the rest of the tree view is left alone.  If an error occurs,
+ * it returns %FALSE and sets @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_tree_view_update_games (gchar **names,
+                            GError **error)
+{
+        GtkTreeModel *model;
+        GtkTreeModel *changes;
+        GString *expression;
+        GString *criteria;
+        gchar *sql;
+        guint ii;
+
+        g_return_val_if_fail (names != NULL, FALSE);
+
+        model = gva_tree_view_get_model ();
+
+        /* Nothing to refresh yet. */
+        if (model == NULL || names[0] == NULL)
+                return TRUE;
+
+        /* Apply the view's criteria to just the given games. */
+        criteria = g_string_sized_new (128);
+        tree_view_add_view_expression (criteria);
+
+        expression = g_string_sized_new (1024);
+        if (criteria->len > 0)
+                g_string_append_printf (
+                        expression, "(%s) AND ", criteria->str);
+        g_string_free (criteria, TRUE);
+
+        g_string_append (expression, "name IN (");
+        for (ii = 0; names[ii] != NULL; ii++)
+                g_string_append_printf (
+                        expression, "%s\"%s\"",
+                        (ii > 0) ? ", " : "", names[ii]);
+        g_string_append_c (expression, ')');
+
+        sql = tree_view_build_query (expression->str);
+        changes = gva_game_store_new_from_query (sql, error);
+        g_string_free (expression, TRUE);
+        g_free (sql);
+
+        if (changes == NULL)
+                return FALSE;
+
+        tree_view_merge_games (model, changes, names);
+        g_object_unref (changes);
+
+        gtk_widget_set_sensitive (
+                GVA_WIDGET_MAIN_TREE_VIEW,
+                gtk_tree_model_iter_n_children (model, NULL) > 0);
+        gva_tree_view_update_status_bar ();
+
+        return TRUE;
+}
+
+static void
+tree_view_update_free (TreeViewUpdate *update)
+{
+        if (update->cancellable != NULL)
+                g_object_unref (update->cancellable);
+
+        if (update->error != NULL)
+                g_error_free (update->error);
+
+        g_object_unref (update->model);
+        g_object_unref (update->simple);
+
+        g_slice_free (TreeViewUpdate, update);
+}
+
+static gboolean
+tree_view_update_is_current (TreeViewUpdate *update)
+{
+        return (update->serial == update_serial) &&
+                !g_cancellable_is_cancelled (update->cancellable);
+}
+
+/* Shows the new model in place of the old one. */
+static void
+tree_view_update_show (TreeViewUpdate *update)
+{
+        gint n_rows;
+
+        n_rows = gtk_tree_model_iter_n_children (update->model, NULL);
+        gtk_widget_set_sensitive (GVA_WIDGET_MAIN_TREE_VIEW, n_rows > 0);
+
+        if (update->shown)
+        {
+                gva_tree_view_update_status_bar ();
+                return;
+        }
+
+        tree_view_set_model (update->model);
+        update->shown = TRUE;
+}
+
+static void
+tree_view_update_names_cb (gchar **names,
+                           TreeViewUpdate *update)
+{
+        GtkTreeModel *changes;
+        GString *expression;
+        gchar *sql;
+        guint ii;
+
+        if (!tree_view_update_is_current (update) || update->error != NULL)
+                return;
+
+        /* The background query found the names.  Fetching the
+         * rows for them by name is quick by comparison. */
+        expression = g_string_sized_new (1024);
+        g_string_append (expression, "name IN (");
+        for (ii = 0; names[ii] != NULL; ii++)
+                g_string_append_printf (
+                        expression, "%s\"%s\"",
+                        (ii > 0) ? ", " : "", names[ii]);
+        g_string_append_c (expression, ')');
+
+        sql = tree_view_build_query (expression->str);
+        changes = gva_game_store_new_from_query (sql, &update->error);
+        g_string_free (expression, TRUE);
+        g_free (sql);
+
+        if (changes == NULL)
+                return;
+
+        /* Fetching the rows runs the main loop, which
+         * may have cancelled or replaced this update. */
+        if (tree_view_update_is_current (update))
+        {
+                tree_view_merge_games (update->model, changes, names);
+                tree_view_update_show (update);
+        }
+
+        g_object_unref (changes);
+}
+
+static void
+tree_view_update_done_cb (GObject *source_object,
+                          GAsyncResult *result,
+                          TreeViewUpdate *update)
+{
+        GSimpleAsyncResult *simple = update->simple;
+        GError *error = NULL;
+
+        if (!gva_db_select_names_finish (result, &error))
+                g_simple_async_result_take_error (simple, error);
+        else if (update->error != NULL)
+                g_simple_async_result_set_from_error (simple, update->error);
+        else if (!tree_view_update_is_current (update))
+                g_simple_async_result_set_error (
+                        simple, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                        "Replaced by a later update");
+
+        /* Show the results even if there were none. */
+        else
+                tree_view_update_show (update);
+
+        g_simple_async_result_complete (simple);
+
+        tree_view_update_free (update);
+}
+
+/**
+ * gva_tree_view_update_async:
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the update is finished
+ * @user_data: data to pass to @callback
+ *
+ * Like gva_tree_view_update(), but queries the game database in the
+ * background and returns immediately.  The tree view keeps showing the
+ * old results until the first matching games are found, and then shows
+ * the new results as they arrive.  Unlike gva_tree_view_update(), the
+ * function leaves the selection and the input focus alone.
+ *
+ * A later update, or cancelling @cancellable, stops the update.
+ *
+ * When the update is finished, @callback will be called.  You can then
+ * call gva_tree_view_update_finish() to get the result of the operation.
+ **/
+void
+gva_tree_view_update_async (GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+        TreeViewUpdate *update;
+        GString *criteria;
+        GString *sql;
+
+        update = g_slice_new0 (TreeViewUpdate);
+        update->model = gva_game_store_new ();
+        update->serial = ++update_serial;
+        update->simple = g_simple_async_result_new (
+                NULL, callback, user_data, gva_tree_view_update_async);
+
+        if (cancellable != NULL)
+                update->cancellable = g_object_ref (cancellable);
+
+        criteria = g_string_sized_new (128);
+        tree_view_add_view_expression (criteria);
+
+        /* Only the names are queried in the background. */
+        sql = g_string_sized_new (256);
+        g_string_printf (sql, SQL_SELECT_GAMES, "name");
+        if (criteria->len > 0)
+                g_string_append_printf (sql, " WHERE %s", criteria->str);
+        g_string_free (criteria, TRUE);
+
+        gva_db_select_names_async (
+                sql->str, (GvaDbNamesFunc)
+                tree_view_update_names_cb, update,
+                cancellable, (GAsyncReadyCallback)
+                tree_view_update_done_cb, update);
+
+        g_string_free (sql, TRUE);
+}
+
+/**
+ * gva_tree_view_update_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_tree_view_update_async().  If
+ * an error occurred or the update was stopped, it returns %FALSE and sets
+ * @error.
+ *
+ * Returns: %TRUE on success, %FALSE if an error occurred
+ **/
+gboolean
+gva_tree_view_update_finish (GAsyncResult *result,
+                             GError **error)
+{
+        GSimpleAsyncResult *simple;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_tree_view_update_async), FALSE);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        return !g_simple_async_result_propagate_error (simple, error);
+}
+
 /**
  * gva_tree_view_run_query:
  * @expression: an SQL "where" expression
@@ -309,41 +724,20 @@ gboolean
 gva_tree_view_run_query (const gchar *expression,
                          GError **error)
 {
-        GvaGameStoreColumn column_id;
-        GtkSortType order;
         GtkTreeView *view;
         GtkTreeModel *model;
-        GString *string;
-        GSList *list;
-        const gchar **strv;
         gboolean sensitive;
-        gchar *columns;
-        gint ii = 0;
+        gchar *sql;
 
         view = GTK_TREE_VIEW (GVA_WIDGET_MAIN_TREE_VIEW);
 
-        /* Build a comma-separated list of column names. */
-        list = gva_columns_get_names_full (view);
-        strv = g_new0 (const gchar *, g_slist_length (list) + 1);
-        while (list != NULL)
-        {
-                strv[ii++] = list->data;
-                list = g_slist_delete_link (list, list);
-        }
-        columns = g_strjoinv (", ", (gchar **) strv);
-        g_free (strv);
-
-        string = g_string_new (NULL);
-        g_string_printf (string, SQL_SELECT_GAMES, columns);
-        g_free (columns);
-
-        if (expression != NULL && *expression != '\0')
-                g_string_append_printf (string, " WHERE %s", expression);
+        sql = tree_view_build_query (expression);
+        update_serial++;
 
         gtk_widget_set_sensitive (GTK_WIDGET (view), FALSE);
         gva_main_cursor_busy ();
 
-        model = gva_game_store_new_from_query (string->str, error);
+        model = gva_game_store_new_from_query (sql, error);
 
         /* Don't touch widgets if gtk_main_quit() has been called. */
         if (model != NULL && !gtk_main_iteration_do (FALSE))
@@ -353,23 +747,12 @@ gva_tree_view_run_query (const gchar *expression,
                 gva_main_cursor_normal ();
         }
 
-        g_string_free (string, TRUE);
+        g_free (sql);
 
         if (model == NULL)
                 return FALSE;
 
-        gva_tree_view_get_last_sort_column_id (&column_id, &order);
-
-        gtk_tree_sortable_set_sort_column_id (
-                GTK_TREE_SORTABLE (model), column_id, order);
-
-        g_signal_connect (
-                model, "sort-column-changed",
-                G_CALLBACK (tree_view_sort_column_changed_cb), NULL);
-
-        gtk_tree_view_set_model (view, model);
-        gtk_tree_view_columns_autosize (view);
-        gva_tree_view_update_status_bar ();
+        tree_view_set_model (model);
         g_object_unref (model);
 
         return TRUE;
@@ -395,15 +778,10 @@ gva_tree_view_get_model (void)
         return gtk_tree_view_get_model (view);
 }
 
-/**
- * gva_tree_view_update_status_bar:
- *
- * Puts a message in the main status bar containing the MAME version and the
- * number of games displayed in the current view.  This message gets shown
- * when the status bar has nothing more important to show.
- **/
-void
-gva_tree_view_update_status_bar (void)
+static void
+tree_view_update_status_bar_cb (GObject *source_object,
+                                GAsyncResult *result,
+                                gpointer user_data)
 {
         GtkTreeView *view;
         GtkTreeModel *model;
@@ -418,7 +796,7 @@ gva_tree_view_update_status_bar (void)
         model = gtk_tree_view_get_model (view);
         message = g_string_sized_new (128);
 
-        mame_version = gva_mame_get_version (&error);
+        mame_version = gva_mame_get_version_finish (result, &error);
         gva_error_handle (&error);
 
         if (model != NULL)
@@ -476,6 +854,22 @@ gva_tree_view_update_status_bar (void)
         g_string_free (message, TRUE);
 }
 
+/**
+ * gva_tree_view_update_status_bar:
+ *
+ * Puts a message in the main status bar containing the MAME version and the
+ * number of games displayed in the current view.  This message gets shown
+ * when the status bar has nothing more important to show.
+ **/
+void
+gva_tree_view_update_status_bar (void)
+{
+        /* The message is counted when the version comes back,
+         * so it describes the view as it is by then. */
+        gva_mame_get_version_async (
+                NULL, tree_view_update_status_bar_cb, NULL);
+}
+
 /**
  * gva_tree_view_get_selected_game:
  *
@@ -34,6 +34,13 @@ G_BEGIN_DECLS
 void           gva_tree_view_init                    (void);
 GtkTreePath *  gva_tree_view_lookup                  (const gchar *game);
 gboolean       gva_tree_view_update                  (GError **error);
+void           gva_tree_view_update_async            (GCancellable *cancellable,
+                                                      GAsyncReadyCallback callback,
+                                                      gpointer user_data);
+gboolean       gva_tree_view_update_finish           (GAsyncResult *result,
+                                                      GError **error);
+gboolean       gva_tree_view_update_games            (gchar **names,
+                                                      GError **error);
 gboolean       gva_tree_view_run_query               (const gchar *expression,
                                                       GError **error);
 GtkTreeModel * gva_tree_view_get_model               (void);
@@ -19,6 +19,13 @@
 #include "gva-util.h"
 
 #include <errno.h>
+#include <string.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) && defined (__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "gva-error.h"
 #include "gva-mame.h"
@@ -155,11 +162,12 @@ gva_get_debug_flags (void)
         {
                 static const GDebugKey debug_keys[] =
                 {
-                        { "mame",  GVA_DEBUG_MAME },
-                        { "sql",   GVA_DEBUG_SQL },
-                        { "io",    GVA_DEBUG_IO },
-                        { "inp",   GVA_DEBUG_INP },
-                        { "http",  GVA_DEBUG_HTTP }
+                        { "mame",   GVA_DEBUG_MAME },
+                        { "sql",    GVA_DEBUG_SQL },
+                        { "io",     GVA_DEBUG_IO },
+                        { "inp",    GVA_DEBUG_INP },
+                        { "http",   GVA_DEBUG_HTTP },
+                        { "search", GVA_DEBUG_SEARCH }
                 };
 
                 const gchar *env = g_getenv ("GVA_DEBUG");
@@ -457,6 +465,241 @@ gva_save_window_state (GtkWindow *window,
                 g_settings_set_boolean (settings, maximized_key, maximized);
 }
 
+/* Letters of Latin-1 Supplement and Latin Extended-A (U+00C0 through
+ * U+017F) folded to lowercase ASCII, so typing "pokemon" matches
+ * "Pok\xc3\xa9mon".  The multiplication and division signs fold away. */
+static const gchar *const collate_latin_fold[] =
+{
+        "a", "a", "a", "a", "a", "a", "ae", "c",    /* U+00C0 */
+        "e", "e", "e", "e", "i", "i", "i", "i",     /* U+00C8 */
+        "d", "n", "o", "o", "o", "o", "o", "",      /* U+00D0 */
+        "o", "u", "u", "u", "u", "y", "th", "ss",   /* U+00D8 */
+        "a", "a", "a", "a", "a", "a", "ae", "c",    /* U+00E0 */
+        "e", "e", "e", "e", "i", "i", "i", "i",     /* U+00E8 */
+        "d", "n", "o", "o", "o", "o", "o", "",      /* U+00F0 */
+        "o", "u", "u", "u", "u", "y", "th", "y",    /* U+00F8 */
+        "a", "a", "a", "a", "a", "a", "c", "c",     /* U+0100 */
+        "c", "c", "c", "c", "c", "c", "d", "d",     /* U+0108 */
+        "d", "d", "e", "e", "e", "e", "e", "e",     /* U+0110 */
+        "e", "e", "e", "e", "g", "g", "g", "g",     /* U+0118 */
+        "g", "g", "g", "g", "h", "h", "h", "h",     /* U+0120 */
+        "i", "i", "i", "i", "i", "i", "i", "i",     /* U+0128 */
+        "i", "i", "ij", "ij", "j", "j", "k", "k",   /* U+0130 */
+        "k", "l", "l", "l", "l", "l", "l", "l",     /* U+0138 */
+        "l", "l", "l", "n", "n", "n", "n", "n",     /* U+0140 */
+        "n", "n", "n", "n", "o", "o", "o", "o",     /* U+0148 */
+        "o", "o", "oe", "oe", "r", "r", "r", "r",   /* U+0150 */
+        "r", "r", "s", "s", "s", "s", "s", "s",     /* U+0158 */
+        "s", "s", "t", "t", "t", "t", "t", "t",     /* U+0160 */
+        "u", "u", "u", "u", "u", "u", "u", "u",     /* U+0168 */
+        "u", "u", "u", "u", "w", "w", "y", "y",     /* U+0170 */
+        "y", "z", "z", "z", "z", "z", "z", "s"      /* U+0178 */
+};
+
+#define COLLATE_IS_ALNUM(c) \
+        (((c) >= 'a' && (c) <= 'z') || ((c) >= '0' && (c) <= '9'))
+
+/* Appends to a collation key, or truncates it for good if the buffer
+ * is full.  The length keeps counting either way. */
+static void
+collate_emit (gchar *buffer,
+              gsize buffer_size,
+              gsize *length,
+              const gchar *bytes,
+              gsize n_bytes)
+{
+        if (*length + n_bytes < buffer_size)
+                memcpy (buffer + *length, bytes, n_bytes);
+        else if (*length < buffer_size)
+                buffer[*length] = '\0';
+
+        *length += n_bytes;
+}
+
+/* Converts runs of 16 ASCII characters at a time, stopping at the first
+ * run with a non-ASCII byte or with fewer than 16 bytes left.  Letters
+ * and digits are the bytes that fall in range once the 0x20 bit is set,
+ * which is also what lowercases the letters and leaves digits alone. */
+static const guchar *
+collate_key_blocks (const guchar *in,
+                    const guchar *end,
+                    gchar *buffer,
+                    gsize buffer_size,
+                    gsize *length)
+{
+#if defined (__SSE2__)
+        while (end - in >= 16)
+        {
+                __m128i block, folded, alpha, digit;
+                gchar lower[16];
+                gint keep, ii;
+
+                block = _mm_loadu_si128 ((const __m128i *) in);
+
+                if (_mm_movemask_epi8 (block) != 0)
+                        break;
+
+                folded = _mm_or_si128 (block, _mm_set1_epi8 (0x20));
+                alpha = _mm_and_si128 (
+                        _mm_cmpgt_epi8 (folded, _mm_set1_epi8 ('a' - 1)),
+                        _mm_cmplt_epi8 (folded, _mm_set1_epi8 ('z' + 1)));
+                digit = _mm_and_si128 (
+                        _mm_cmpgt_epi8 (block, _mm_set1_epi8 ('0' - 1)),
+                        _mm_cmplt_epi8 (block, _mm_set1_epi8 ('9' + 1)));
+                keep = _mm_movemask_epi8 (_mm_or_si128 (alpha, digit));
+
+                in += 16;
+
+                if (keep == 0xFFFF && *length + 16 < buffer_size)
+                {
+                        _mm_storeu_si128 (
+                                (__m128i *) (buffer + *length), folded);
+                        *length += 16;
+                        continue;
+                }
+
+                _mm_storeu_si128 ((__m128i *) lower, folded);
+
+                for (ii = 0; ii < 16; ii++)
+                        if (keep & (1 << ii))
+                                collate_emit (
+                                        buffer, buffer_size,
+                                        length, &lower[ii], 1);
+        }
+#elif defined (__ARM_NEON) && defined (__aarch64__)
+        while (end - in >= 16)
+        {
+                uint8x16_t block, folded, alpha, digit, keep;
+                guint8 lower[16];
+                guint8 mask[16];
+                gint ii;
+
+                block = vld1q_u8 (in);
+
+                if (vmaxvq_u8 (block) >= 0x80)
+                        break;
+
+                folded = vorrq_u8 (block, vdupq_n_u8 (0x20));
+                alpha = vcleq_u8 (
+                        vsubq_u8 (folded, vdupq_n_u8 ('a')),
+                        vdupq_n_u8 ('z' - 'a'));
+                digit = vcleq_u8 (
+                        vsubq_u8 (block, vdupq_n_u8 ('0')),
+                        vdupq_n_u8 ('9' - '0'));
+                keep = vorrq_u8 (alpha, digit);
+
+                in += 16;
+
+                if (vminvq_u8 (keep) == 0xFF && *length + 16 < buffer_size)
+                {
+                        vst1q_u8 ((guint8 *) buffer + *length, folded);
+                        *length += 16;
+                        continue;
+                }
+
+                vst1q_u8 (lower, folded);
+                vst1q_u8 (mask, keep);
+
+                for (ii = 0; ii < 16; ii++)
+                        if (mask[ii] != 0)
+                                collate_emit (
+                                        buffer, buffer_size, length,
+                                        (const gchar *) &lower[ii], 1);
+        }
+#endif
+
+        return in;
+}
+
+/* Converts one character, which may be a multibyte UTF-8 sequence. */
+static const guchar *
+collate_key_char (const guchar *in,
+                  gchar *buffer,
+                  gsize buffer_size,
+                  gsize *length)
+{
+        gchar utf8[6];
+        gunichar uc;
+        gint n_bytes;
+
+        if (*in < 0x80)
+        {
+                gchar c = g_ascii_tolower (*in);
+
+                if (COLLATE_IS_ALNUM (c))
+                        collate_emit (buffer, buffer_size, length, &c, 1);
+
+                return in + 1;
+        }
+
+        uc = g_utf8_get_char_validated ((const gchar *) in, -1);
+
+        /* Skip stray bytes that are not valid UTF-8. */
+        if (uc == (gunichar) -1 || uc == (gunichar) -2)
+                return in + 1;
+
+        in = (const guchar *) g_utf8_next_char (in);
+
+        if (uc >= 0xC0 && uc - 0xC0 < G_N_ELEMENTS (collate_latin_fold))
+        {
+                const gchar *fold = collate_latin_fold[uc - 0xC0];
+
+                collate_emit (
+                        buffer, buffer_size, length, fold, strlen (fold));
+        }
+        else if (g_unichar_isalnum (uc))
+        {
+                n_bytes = g_unichar_to_utf8 (g_unichar_tolower (uc), utf8);
+                collate_emit (buffer, buffer_size, length, utf8, n_bytes);
+        }
+
+        return in;
+}
+
+/**
+ * gva_search_collate_key_to_buffer:
+ * @string: a string
+ * @buffer: a buffer to hold the collation key, or %NULL
+ * @buffer_size: size of @buffer in bytes
+ *
+ * Like gva_search_collate_key(), but writes the collation key to @buffer
+ * instead of allocating it.  The key is truncated to fit @buffer and is
+ * always nul-terminated unless @buffer_size is zero.  The return value is
+ * the length of the whole key, so the key was truncated if it is not less
+ * than @buffer_size.
+ *
+ * Returns: the length of the collation key
+ **/
+gsize
+gva_search_collate_key_to_buffer (const gchar *string,
+                                  gchar *buffer,
+                                  gsize buffer_size)
+{
+        const guchar *in;
+        const guchar *end;
+        gsize length = 0;
+
+        g_return_val_if_fail (string != NULL, 0);
+        g_return_val_if_fail (buffer != NULL || buffer_size == 0, 0);
+
+        in = (const guchar *) string;
+        end = in + strlen (string);
+
+        while (in < end)
+        {
+                in = collate_key_blocks (
+                        in, end, buffer, buffer_size, &length);
+                if (in < end)
+                        in = collate_key_char (
+                                in, buffer, buffer_size, &length);
+        }
+
+        if (length < buffer_size)
+                buffer[length] = '\0';
+
+        return length;
+}
+
 /**
  * gva_search_collate_key:
  * @string: a string
@@ -466,32 +709,30 @@ gva_save_window_state (GtkWindow *window,
  *
  * Specifically, the function filters out spaces and punctuation from @string
  * for easier comparison with what a human is likely to type in an interactive
- * search.  e.g. Typing "mspacman" will match "Ms. Pac-Man".
+ * search.  e.g. Typing "mspacman" will match "Ms. Pac-Man".  Letters are
+ * lowercased, and accented Latin letters lose their accents.
  *
  * Returns: a newly-allocated collation key
  **/
 gchar *
 gva_search_collate_key (const gchar *string)
 {
-        const gchar *valid_chars;
-        gchar **str_array;
-        gchar *temp;
-
-        /* FIXME This doesn't take UTF-8 into account. */
+        gchar buffer[256];
+        gchar *key;
+        gsize length;
 
         g_return_val_if_fail (string != NULL, NULL);
 
-        valid_chars = "abcdefghijklmnopqrstuvwxyz"
-                      "0123456789";
+        length = gva_search_collate_key_to_buffer (
+                string, buffer, sizeof (buffer));
+
+        if (length < sizeof (buffer))
+                return g_strndup (buffer, length);
 
-        temp = g_ascii_strdown (string, -1);
-        g_strcanon (temp, valid_chars, '?');
-        str_array = g_strsplit_set (temp, "?", -1);
-        g_free (temp);
-        temp = g_strjoinv (NULL, str_array);
-        g_strfreev (str_array);
+        key = g_malloc (length + 1);
+        gva_search_collate_key_to_buffer (string, key, length + 1);
 
-        return temp;
+        return key;
 }
 
 /**
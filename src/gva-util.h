@@ -36,29 +36,34 @@ G_BEGIN_DECLS
  * @GVA_DEBUG_NONE:
  *      Print no messages.
  * @GVA_DEBUG_MAME:
- *      Print shell commands invoking MAME.
+ *      Print shell commands invoking MAME, and configuration cache
+ *      hits and misses.
  * @GVA_DEBUG_SQL:
- *      Print SQL commands to the game database.
+ *      Print SQL commands to the game database, and warn about
+ *      commands that scan a table the game database indexes.
  * @GVA_DEBUG_IO:
  *      Print all communication between GVA and MAME.
  * @GVA_DEBUG_INP:
  *      Print information about input files.
  * @GVA_DEBUG_HTTP:
  *      Print HTTP communication.
+ * @GVA_DEBUG_SEARCH:
+ *      Print how long searches take to show results.
  *
  * These flags indicate which types of debugging messages will be triggered
  * at runtime. Debugging messages can be triggered by setting the GVA_DEBUG
  * environment variable to a colon-separated list of "mame", "sql", "io",
- * "inp", "gst" and "http".
+ * "inp", "gst", "http" and "search".
  **/
 typedef enum
 {
-        GVA_DEBUG_NONE  = 0,
-        GVA_DEBUG_MAME  = 1 << (G_LOG_LEVEL_USER_SHIFT + 0),
-        GVA_DEBUG_SQL   = 1 << (G_LOG_LEVEL_USER_SHIFT + 1),
-        GVA_DEBUG_IO    = 1 << (G_LOG_LEVEL_USER_SHIFT + 2),
-        GVA_DEBUG_INP   = 1 << (G_LOG_LEVEL_USER_SHIFT + 3),
-        GVA_DEBUG_HTTP  = 1 << (G_LOG_LEVEL_USER_SHIFT + 4)
+        GVA_DEBUG_NONE   = 0,
+        GVA_DEBUG_MAME   = 1 << (G_LOG_LEVEL_USER_SHIFT + 0),
+        GVA_DEBUG_SQL    = 1 << (G_LOG_LEVEL_USER_SHIFT + 1),
+        GVA_DEBUG_IO     = 1 << (G_LOG_LEVEL_USER_SHIFT + 2),
+        GVA_DEBUG_INP    = 1 << (G_LOG_LEVEL_USER_SHIFT + 3),
+        GVA_DEBUG_HTTP   = 1 << (G_LOG_LEVEL_USER_SHIFT + 4),
+        GVA_DEBUG_SEARCH = 1 << (G_LOG_LEVEL_USER_SHIFT + 5)
 } GvaDebugFlags;
 
 gchar *         gva_choose_inpname              (const gchar *game);
@@ -80,6 +85,10 @@ void            gva_save_window_state           (GtkWindow *window,
                                                  const gchar *x_key,
                                                  const gchar *y_key);
 gchar *         gva_search_collate_key          (const gchar *string);
+gsize           gva_search_collate_key_to_buffer
+                                                (const gchar *string,
+                                                 gchar *buffer,
+                                                 gsize buffer_size);
 gboolean        gva_spawn_with_pipes            (const gchar *command_line,
                                                  GPid *child_pid,
                                                  gint *standard_input,
@@ -0,0 +1,1101 @@
+/* Copyright 2007-2015 Matthew Barnes
+ *
+ * This file is part of GNOME Video Arcade.
+ *
+ * GNOME Video Arcade is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * GNOME Video Arcade is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gva-verify.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gva-db.h"
+#include "gva-mame.h"
+#include "gva-util.h"
+
+#define SQL_SELECT_GAMES \
+        "SELECT name, cloneof, romof FROM game"
+
+/* Names of the games being verified, which can be all of them. */
+#define SQL_CREATE_VERIFY_NAMES \
+        "CREATE TEMP TABLE IF NOT EXISTS verify_names (" \
+                "name PRIMARY KEY ON CONFLICT IGNORE); " \
+        "DELETE FROM temp.verify_names;"
+
+#define SQL_INSERT_VERIFY_NAMES \
+        "INSERT INTO temp.verify_names VALUES (?1)"
+
+#define SQL_SELECT_ROMS \
+        "SELECT game, name, size, crc, sha1, merge, status FROM rom " \
+        "WHERE game IN (SELECT name FROM temp.verify_names)"
+
+#define SQL_SELECT_DISKS \
+        "SELECT DISTINCT game FROM disk " \
+        "WHERE game IN (SELECT name FROM temp.verify_names)"
+
+/* Size of the buffer for hashing loose ROM files. */
+#define VERIFY_BUFFER_SIZE (64 * 1024)
+
+/* How far to follow "romof" attributes, in case they loop. */
+#define VERIFY_MAX_DEPTH 8
+
+/* Zip archive record signatures and sizes.  The end of central
+ * directory record may be followed by a comment of up to 64 KiB. */
+#define ZIP_END_SIGNATURE       0x06054b50
+#define ZIP_END_SIZE            22
+#define ZIP_ENTRY_SIGNATURE     0x02014b50
+#define ZIP_ENTRY_SIZE          46
+#define ZIP_MAX_COMMENT_SIZE    0xffff
+
+typedef struct _VerifyData VerifyData;
+typedef struct _VerifyFile VerifyFile;
+typedef struct _VerifyGame VerifyGame;
+typedef struct _VerifyRom VerifyRom;
+typedef struct _VerifySet VerifySet;
+
+/* A file in a ROM set, either a zip archive member
+ * or a loose file in a directory named after the set. */
+struct _VerifyFile
+{
+        gchar *name;
+        guint64 size;
+        guint32 crc;
+
+        /* Only loose files are hashed, so this
+         * is NULL for zip archive members. */
+        gchar *sha1;
+};
+
+/* A ROM set, as found in all the "rompath" directories.  Worker
+ * threads fill these in, one set per task. */
+struct _VerifySet
+{
+        const gchar *name;
+        GArray *files;
+
+        /* The set is in a form we can't read, such as a 7-Zip
+         * archive, so games that search it are left to MAME. */
+        gboolean unreadable;
+};
+
+/* A ROM a game needs, from the rom table. */
+struct _VerifyRom
+{
+        const gchar *name;
+        const gchar *sha1;
+        guint64 size;
+        guint32 crc;
+        gboolean has_crc;
+        gboolean shared;
+        gboolean nodump;
+        gboolean baddump;
+};
+
+struct _VerifyGame
+{
+        const gchar *name;
+        const gchar *cloneof;
+        const gchar *romof;
+        GArray *roms;
+        gboolean has_disks;
+};
+
+struct _VerifyData
+{
+        /* Strings for the tables below. */
+        GStringChunk *strings;
+
+        GHashTable *games;
+        GHashTable *sets;
+        gchar **names;
+        gchar **search_paths;
+
+        GThreadPool *pool;
+        guint n_threads;
+        volatile gint n_pending;
+
+        GSimpleAsyncResult *simple;
+        GCancellable *cancellable;
+        GTimer *timer;
+
+        /* Results, in the form of MAME's output. */
+        GPtrArray *lines;
+        GPtrArray *deferred;
+};
+
+static guint32 crc_table[8][256];
+
+static gpointer
+verify_init_crc_table (gpointer unused)
+{
+        guint ii, jj;
+
+        for (ii = 0; ii < 256; ii++)
+        {
+                guint32 crc = ii;
+
+                for (jj = 0; jj < 8; jj++)
+                        crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+
+                crc_table[0][ii] = crc;
+        }
+
+        /* Entry [jj][ii] is the CRC of byte ii followed by jj zeros. */
+        for (ii = 0; ii < 256; ii++)
+                for (jj = 1; jj < 8; jj++)
+                        crc_table[jj][ii] =
+                                (crc_table[jj - 1][ii] >> 8) ^
+                                crc_table[0][crc_table[jj - 1][ii] & 0xff];
+
+        return NULL;
+}
+
+static void
+verify_file_clear (VerifyFile *file)
+{
+        g_free (file->name);
+        g_free (file->sha1);
+}
+
+static VerifySet *
+verify_set_new (const gchar *name)
+{
+        VerifySet *set;
+
+        set = g_slice_new0 (VerifySet);
+        set->name = name;
+        set->files = g_array_new (FALSE, FALSE, sizeof (VerifyFile));
+
+        return set;
+}
+
+static void
+verify_set_free (VerifySet *set)
+{
+        guint ii;
+
+        for (ii = 0; ii < set->files->len; ii++)
+                verify_file_clear (
+                        &g_array_index (set->files, VerifyFile, ii));
+
+        g_array_free (set->files, TRUE);
+        g_slice_free (VerifySet, set);
+}
+
+static void
+verify_game_free (VerifyGame *game)
+{
+        if (game->roms != NULL)
+                g_array_free (game->roms, TRUE);
+
+        g_slice_free (VerifyGame, game);
+}
+
+static void
+verify_data_free (VerifyData *data)
+{
+        g_hash_table_destroy (data->games);
+        g_hash_table_destroy (data->sets);
+        g_string_chunk_free (data->strings);
+        g_strfreev (data->names);
+        g_strfreev (data->search_paths);
+
+        if (data->cancellable != NULL)
+                g_object_unref (data->cancellable);
+
+        g_timer_destroy (data->timer);
+
+        g_ptr_array_foreach (data->lines, (GFunc) g_free, NULL);
+        g_ptr_array_free (data->lines, TRUE);
+        g_ptr_array_foreach (data->deferred, (GFunc) g_free, NULL);
+        g_ptr_array_free (data->deferred, TRUE);
+
+        g_slice_free (VerifyData, data);
+}
+
+static guint16
+verify_get_le16 (const guchar *cp)
+{
+        return (guint16) (cp[0] | (cp[1] << 8));
+}
+
+static guint32
+verify_get_le32 (const guchar *cp)
+{
+        return (guint32) cp[0] | ((guint32) cp[1] << 8) |
+                ((guint32) cp[2] << 16) | ((guint32) cp[3] << 24);
+}
+
+/* Lists the members of a zip archive from its central directory, which
+ * records each member's size and CRC-32, so nothing is decompressed.
+ * Returns FALSE if the archive is damaged or uses ZIP64 extensions. */
+static gboolean
+verify_read_zip (VerifySet *set,
+                 const gchar *filename)
+{
+        GMappedFile *mapped_file;
+        const guchar *contents;
+        const guchar *end = NULL;
+        const guchar *cp;
+        const guchar *stop;
+        gsize length;
+        guint32 offset;
+        guint32 size;
+        guint n_entries;
+        guint ii;
+        gboolean success = FALSE;
+
+        mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+        if (mapped_file == NULL)
+                return FALSE;
+
+        contents = (const guchar *) g_mapped_file_get_contents (mapped_file);
+        length = g_mapped_file_get_length (mapped_file);
+
+        if (length < ZIP_END_SIZE)
+                goto exit;
+
+        /* Search backwards for the end of central directory record. */
+        stop = (length > ZIP_END_SIZE + ZIP_MAX_COMMENT_SIZE) ?
+                contents + length - ZIP_END_SIZE - ZIP_MAX_COMMENT_SIZE :
+                contents;
+        for (cp = contents + length - ZIP_END_SIZE; end == NULL; cp--)
+        {
+                if (verify_get_le32 (cp) == ZIP_END_SIGNATURE)
+                        end = cp;
+                if (cp == stop)
+                        break;
+        }
+
+        if (end == NULL)
+                goto exit;
+
+        n_entries = verify_get_le16 (end + 10);
+        size = verify_get_le32 (end + 12);
+        offset = verify_get_le32 (end + 16);
+
+        if (n_entries == 0xffff || offset == 0xffffffff)
+                goto exit;
+
+        if ((gsize) offset + size > (gsize) (end - contents))
+                goto exit;
+
+        cp = contents + offset;
+        stop = cp + size;
+
+        for (ii = 0; ii < n_entries; ii++)
+        {
+                VerifyFile file;
+                guint name_length;
+                guint extra_length;
+                guint comment_length;
+
+                if (cp + ZIP_ENTRY_SIZE > stop)
+                        goto exit;
+
+                if (verify_get_le32 (cp) != ZIP_ENTRY_SIGNATURE)
+                        goto exit;
+
+                name_length = verify_get_le16 (cp + 28);
+                extra_length = verify_get_le16 (cp + 30);
+                comment_length = verify_get_le16 (cp + 32);
+
+                if (cp + ZIP_ENTRY_SIZE + name_length > stop)
+                        goto exit;
+
+                file.name = g_strndup (
+                        (const gchar *) cp + ZIP_ENTRY_SIZE, name_length);
+                file.size = verify_get_le32 (cp + 24);
+                file.crc = verify_get_le32 (cp + 16);
+                file.sha1 = NULL;
+
+                /* Skip directory entries. */
+                if (g_str_has_suffix (file.name, "/"))
+                        verify_file_clear (&file);
+                else
+                        g_array_append_val (set->files, file);
+
+                cp += ZIP_ENTRY_SIZE +
+                        name_length + extra_length + comment_length;
+        }
+
+        success = TRUE;
+
+exit:
+        g_mapped_file_unref (mapped_file);
+
+        return success;
+}
+
+/* Hashes one loose file.  Returns FALSE if it can't be read. */
+static gboolean
+verify_read_file (VerifyFile *file,
+                  const gchar *filename,
+                  guchar *buffer,
+                  GCancellable *cancellable)
+{
+        GChecksum *checksum;
+        FILE *fp;
+        gsize length;
+        gboolean success;
+
+        fp = fopen (filename, "rb");
+        if (fp == NULL)
+                return FALSE;
+
+        checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+        file->size = 0;
+        file->crc = 0;
+
+        while ((length = fread (buffer, 1, VERIFY_BUFFER_SIZE, fp)) > 0)
+        {
+                if (g_cancellable_is_cancelled (cancellable))
+                        break;
+
+                file->crc = gva_verify_crc32 (file->crc, buffer, length);
+                g_checksum_update (checksum, buffer, length);
+                file->size += length;
+        }
+
+        success = !ferror (fp) && !g_cancellable_is_cancelled (cancellable);
+
+        if (success)
+                file->sha1 = g_strdup (g_checksum_get_string (checksum));
+
+        g_checksum_free (checksum);
+        fclose (fp);
+
+        return success;
+}
+
+/* Hashes the loose files in a directory named after the set. */
+static void
+verify_read_directory (VerifySet *set,
+                       const gchar *directory,
+                       GCancellable *cancellable)
+{
+        GDir *dir;
+        const gchar *basename;
+        guchar *buffer;
+
+        dir = g_dir_open (directory, 0, NULL);
+        if (dir == NULL)
+                return;
+
+        buffer = g_malloc (VERIFY_BUFFER_SIZE);
+
+        while ((basename = g_dir_read_name (dir)) != NULL)
+        {
+                VerifyFile file;
+                gchar *filename;
+
+                /* Disk images are huge, and left to MAME. */
+                if (g_str_has_suffix (basename, ".chd"))
+                        continue;
+
+                filename = g_build_filename (directory, basename, NULL);
+
+                if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+                {
+                        file.name = g_strdup (basename);
+                        file.sha1 = NULL;
+
+                        if (verify_read_file (
+                                &file, filename, buffer, cancellable))
+                                g_array_append_val (set->files, file);
+                        else
+                                verify_file_clear (&file);
+                }
+
+                g_free (filename);
+        }
+
+        g_free (buffer);
+        g_dir_close (dir);
+}
+
+/* Looks for a ROM in a set by its CRC-32 and size, as MAME does. */
+static const VerifyFile *
+verify_find_by_hash (VerifySet *set,
+                     const VerifyRom *rom)
+{
+        guint ii;
+
+        if (!rom->has_crc)
+                return NULL;
+
+        for (ii = 0; ii < set->files->len; ii++)
+        {
+                const VerifyFile *file;
+
+                file = &g_array_index (set->files, VerifyFile, ii);
+                if (file->crc == rom->crc && file->size == rom->size)
+                        return file;
+        }
+
+        return NULL;
+}
+
+/* Looks for a ROM in a set by name, to explain a hash mismatch. */
+static const VerifyFile *
+verify_find_by_name (VerifySet *set,
+                     const VerifyRom *rom)
+{
+        guint ii;
+
+        for (ii = 0; ii < set->files->len; ii++)
+        {
+                const VerifyFile *file;
+                const gchar *basename;
+
+                file = &g_array_index (set->files, VerifyFile, ii);
+                basename = strrchr (file->name, '/');
+                basename = (basename != NULL) ? basename + 1 : file->name;
+                if (g_ascii_strcasecmp (basename, rom->name) == 0)
+                        return file;
+        }
+
+        return NULL;
+}
+
+/* Verifies one game against the sets read by the worker threads,
+ * adding lines like those of "MAME -verifyroms" to the results. */
+static void
+verify_game (VerifyData *data,
+             VerifyGame *game)
+{
+        VerifySet *chain[VERIFY_MAX_DEPTH];
+        const gchar *name;
+        guint n_chain = 0;
+        guint n_lines;
+        guint required = 0;
+        guint found = 0;
+        gboolean bad = FALSE;
+        gboolean best = FALSE;
+        guint ii;
+
+        /* Disk images are left to MAME. */
+        if (game->has_disks)
+        {
+                g_ptr_array_add (data->deferred, g_strdup (game->name));
+                return;
+        }
+
+        /* MAME says nothing about games without ROMs. */
+        if (game->roms == NULL)
+                return;
+
+        /* MAME searches the game's own set, then the sets named by its
+         * chain of "romof" attributes: typically a parent, then a BIOS. */
+        for (name = game->name; name != NULL; )
+        {
+                VerifyGame *other;
+                VerifySet *set;
+
+                set = g_hash_table_lookup (data->sets, name);
+                if (set == NULL)
+                        break;
+
+                if (set->unreadable)
+                {
+                        g_ptr_array_add (
+                                data->deferred, g_strdup (game->name));
+                        return;
+                }
+
+                chain[n_chain++] = set;
+                if (n_chain == VERIFY_MAX_DEPTH)
+                        break;
+
+                other = g_hash_table_lookup (data->games, name);
+                name = (other != NULL) ? other->romof : NULL;
+        }
+
+        n_lines = data->lines->len;
+
+        for (ii = 0; ii < game->roms->len; ii++)
+        {
+                const VerifyRom *rom;
+                const VerifyFile *file = NULL;
+                gchar *problem = NULL;
+                guint jj;
+
+                rom = &g_array_index (game->roms, VerifyRom, ii);
+
+                if (!rom->nodump && !rom->shared)
+                        required++;
+
+                for (jj = 0; jj < n_chain && file == NULL; jj++)
+                        file = verify_find_by_hash (chain[jj], rom);
+
+                for (jj = 0; jj < n_chain && file == NULL; jj++)
+                        file = verify_find_by_name (chain[jj], rom);
+
+                if (rom->nodump)
+                {
+                        problem = g_strdup ("NO GOOD DUMP KNOWN");
+                        best = TRUE;
+                }
+                else if (file == NULL)
+                {
+                        problem = g_strdup ("NOT FOUND");
+                        bad = TRUE;
+                }
+                else
+                {
+                        if (!rom->shared)
+                                found++;
+
+                        if (file->size != rom->size)
+                        {
+                                problem = g_strdup_printf (
+                                        "INCORRECT LENGTH: %"
+                                        G_GUINT64_FORMAT " bytes",
+                                        file->size);
+                                bad = TRUE;
+                        }
+                        else if ((rom->has_crc && file->crc != rom->crc) ||
+                                 (rom->sha1 != NULL && file->sha1 != NULL &&
+                                  g_ascii_strcasecmp (
+                                  rom->sha1, file->sha1) != 0))
+                        {
+                                problem = g_strdup ("INCORRECT CHECKSUM");
+                                bad = TRUE;
+                        }
+                        else if (rom->baddump)
+                        {
+                                problem = g_strdup ("NEEDS REDUMP");
+                                best = TRUE;
+                        }
+                }
+
+                if (problem != NULL)
+                        g_ptr_array_add (data->lines, g_strdup_printf (
+                                "%-8s: %s (%" G_GUINT64_FORMAT " bytes) - %s",
+                                game->name, rom->name, rom->size, problem));
+
+                g_free (problem);
+        }
+
+        /* MAME doesn't report sets it found none of, either. */
+        if (required > 0 && found == 0)
+        {
+                for (ii = n_lines; ii < data->lines->len; ii++)
+                        g_free (g_ptr_array_index (data->lines, ii));
+                g_ptr_array_set_size (data->lines, n_lines);
+                return;
+        }
+
+        if (game->cloneof != NULL)
+                g_ptr_array_add (data->lines, g_strdup_printf (
+                        "romset %s [%s] is %s", game->name, game->cloneof,
+                        bad ? "bad" : best ? "best available" : "good"));
+        else
+                g_ptr_array_add (data->lines, g_strdup_printf (
+                        "romset %s is %s", game->name,
+                        bad ? "bad" : best ? "best available" : "good"));
+}
+
+static gboolean
+verify_done_idle_cb (VerifyData *data)
+{
+        GSimpleAsyncResult *simple = data->simple;
+        GError *error = NULL;
+        guint ii;
+
+        /* Every task is done, so this returns right away. */
+        if (data->pool != NULL)
+        {
+                g_thread_pool_free (data->pool, FALSE, TRUE);
+                data->pool = NULL;
+        }
+
+        if (g_cancellable_set_error_if_cancelled (data->cancellable, &error))
+        {
+                g_simple_async_result_take_error (simple, error);
+                verify_data_free (data);
+        }
+        else
+        {
+                for (ii = 0; data->names[ii] != NULL; ii++)
+                {
+                        VerifyGame *game;
+
+                        game = g_hash_table_lookup (
+                                data->games, data->names[ii]);
+                        if (game != NULL)
+                                verify_game (data, game);
+                }
+
+                g_log (
+                        G_LOG_DOMAIN, GVA_DEBUG_MAME,
+                        "Verified %u games in %.2f seconds, "
+                        "leaving %u to MAME",
+                        g_strv_length (data->names) - data->deferred->len,
+                        g_timer_elapsed (data->timer, NULL),
+                        data->deferred->len);
+
+                g_simple_async_result_set_op_res_gpointer (
+                        simple, data, (GDestroyNotify) verify_data_free);
+        }
+
+        g_simple_async_result_complete (simple);
+        g_object_unref (simple);
+
+        return FALSE;
+}
+
+/* Thread pool function: reads one set from every
+ * "rompath" directory, as MAME would search them. */
+static void
+verify_read_set (VerifySet *set,
+                 VerifyData *data)
+{
+        guint ii;
+
+        for (ii = 0; data->search_paths[ii] != NULL; ii++)
+        {
+                gchar *filename;
+
+                if (g_cancellable_is_cancelled (data->cancellable))
+                        break;
+
+                filename = g_build_filename (
+                        data->search_paths[ii], set->name, NULL);
+
+                if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+                        verify_read_directory (
+                                set, filename, data->cancellable);
+
+                g_free (filename);
+
+                filename = g_strdup_printf (
+                        "%s" G_DIR_SEPARATOR_S "%s.zip",
+                        data->search_paths[ii], set->name);
+
+                if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+                        if (!verify_read_zip (set, filename))
+                                set->unreadable = TRUE;
+
+                g_free (filename);
+
+                filename = g_strdup_printf (
+                        "%s" G_DIR_SEPARATOR_S "%s.7z",
+                        data->search_paths[ii], set->name);
+
+                if (g_file_test (filename, G_FILE_TEST_EXISTS))
+                        set->unreadable = TRUE;
+
+                g_free (filename);
+        }
+
+        if (g_atomic_int_dec_and_test (&data->n_pending))
+                g_idle_add ((GSourceFunc) verify_done_idle_cb, data);
+}
+
+/* Fills the verify_names table with the games being verified, so the
+ * queries below can join against it instead of listing every name. */
+static gboolean
+verify_insert_names (gchar **names,
+                     GError **error)
+{
+        sqlite3_stmt *stmt;
+        gboolean success;
+        guint ii;
+
+        if (!gva_db_execute (SQL_CREATE_VERIFY_NAMES, error))
+                return FALSE;
+
+        if (!gva_db_prepare (SQL_INSERT_VERIFY_NAMES, &stmt, error))
+                return FALSE;
+
+        success = gva_db_transaction_begin (error);
+
+        for (ii = 0; success && names[ii] != NULL; ii++)
+        {
+                sqlite3_bind_text (stmt, 1, names[ii], -1, SQLITE_STATIC);
+
+                if (sqlite3_step (stmt) != SQLITE_DONE)
+                {
+                        gva_db_set_error (error, 0, NULL);
+                        success = FALSE;
+                }
+
+                sqlite3_reset (stmt);
+        }
+
+        sqlite3_finalize (stmt);
+
+        if (success)
+                success = gva_db_transaction_commit (error);
+        else
+                gva_db_transaction_rollback (NULL);
+
+        return success;
+}
+
+static void
+verify_load_game (VerifyData *data,
+                  sqlite3_stmt *stmt)
+{
+        VerifyGame *game;
+        const gchar *text;
+
+        game = g_slice_new0 (VerifyGame);
+
+        text = (const gchar *) sqlite3_column_text (stmt, 0);
+        game->name = g_string_chunk_insert_const (data->strings, text);
+
+        text = (const gchar *) sqlite3_column_text (stmt, 1);
+        if (text != NULL)
+                game->cloneof = g_string_chunk_insert_const (
+                        data->strings, text);
+
+        text = (const gchar *) sqlite3_column_text (stmt, 2);
+        if (text != NULL)
+                game->romof = g_string_chunk_insert_const (
+                        data->strings, text);
+
+        g_hash_table_insert (data->games, (gpointer) game->name, game);
+}
+
+static void
+verify_load_rom (VerifyData *data,
+                 sqlite3_stmt *stmt)
+{
+        VerifyGame *game;
+        VerifyRom rom;
+        const gchar *text;
+
+        text = (const gchar *) sqlite3_column_text (stmt, 0);
+        game = g_hash_table_lookup (data->games, text);
+        if (game == NULL)
+                return;
+
+        memset (&rom, 0, sizeof (VerifyRom));
+
+        text = (const gchar *) sqlite3_column_text (stmt, 1);
+        rom.name = g_string_chunk_insert (
+                data->strings, (text != NULL) ? text : "");
+
+        rom.size = (guint64) sqlite3_column_int64 (stmt, 2);
+
+        text = (const gchar *) sqlite3_column_text (stmt, 3);
+        if (text != NULL)
+        {
+                rom.crc = (guint32) g_ascii_strtoull (text, NULL, 16);
+                rom.has_crc = TRUE;
+        }
+
+        text = (const gchar *) sqlite3_column_text (stmt, 4);
+        if (text != NULL)
+                rom.sha1 = g_string_chunk_insert (data->strings, text);
+
+        /* ROMs with a "merge" attribute come from the parent. */
+        rom.shared = (sqlite3_column_type (stmt, 5) != SQLITE_NULL);
+
+        text = (const gchar *) sqlite3_column_text (stmt, 6);
+        rom.nodump = (g_strcmp0 (text, "nodump") == 0);
+        rom.baddump = (g_strcmp0 (text, "baddump") == 0);
+
+        if (game->roms == NULL)
+                game->roms = g_array_new (FALSE, FALSE, sizeof (VerifyRom));
+
+        g_array_append_val (game->roms, rom);
+}
+
+static void
+verify_load_disk (VerifyData *data,
+                  sqlite3_stmt *stmt)
+{
+        VerifyGame *game;
+        const gchar *text;
+
+        text = (const gchar *) sqlite3_column_text (stmt, 0);
+        game = g_hash_table_lookup (data->games, text);
+        if (game != NULL)
+                game->has_disks = TRUE;
+}
+
+/* Runs a query, passing each row to the given function. */
+static gboolean
+verify_load (VerifyData *data,
+             const gchar *sql,
+             void (*load_func) (VerifyData *data, sqlite3_stmt *stmt),
+             GError **error)
+{
+        sqlite3_stmt *stmt;
+        gint errcode;
+
+        if (!gva_db_prepare (sql, &stmt, error))
+                return FALSE;
+
+        while ((errcode = sqlite3_step (stmt)) == SQLITE_ROW)
+                load_func (data, stmt);
+
+        if (errcode != SQLITE_DONE)
+                gva_db_set_error (error, 0, NULL);
+
+        sqlite3_finalize (stmt);
+
+        return (errcode == SQLITE_DONE);
+}
+
+/* Loads every game's "cloneof" and "romof" attributes,
+ * and the ROMs and disks of the games being verified. */
+static gboolean
+verify_load_games (VerifyData *data,
+                   GError **error)
+{
+        if (!verify_load (data, SQL_SELECT_GAMES, verify_load_game, error))
+                return FALSE;
+
+        if (!verify_insert_names (data->names, error))
+                return FALSE;
+
+        if (!verify_load (data, SQL_SELECT_ROMS, verify_load_rom, error))
+                return FALSE;
+
+        return verify_load (data, SQL_SELECT_DISKS, verify_load_disk, error);
+}
+
+/**
+ * gva_verify_crc32:
+ * @crc: the CRC-32 of the preceding data, or zero
+ * @buffer: data to add to the CRC-32
+ * @length: length of @buffer in bytes
+ *
+ * Updates a CRC-32 as used in zip archives and by MAME.  This uses the
+ * "slice-by-8" method, which looks up eight bytes at a time in a larger
+ * table instead of one byte at a time.
+ *
+ * Returns: the updated CRC-32
+ **/
+guint32
+gva_verify_crc32 (guint32 crc,
+                  const guchar *buffer,
+                  gsize length)
+{
+        static GOnce once = G_ONCE_INIT;
+
+        g_once (&once, verify_init_crc_table, NULL);
+
+        crc = ~crc;
+
+        while (length >= 8)
+        {
+                guint32 one, two;
+
+                memcpy (&one, buffer, 4);
+                memcpy (&two, buffer + 4, 4);
+                one = GUINT32_FROM_LE (one) ^ crc;
+                two = GUINT32_FROM_LE (two);
+
+                crc = crc_table[7][one & 0xff] ^
+                      crc_table[6][(one >> 8) & 0xff] ^
+                      crc_table[5][(one >> 16) & 0xff] ^
+                      crc_table[4][one >> 24] ^
+                      crc_table[3][two & 0xff] ^
+                      crc_table[2][(two >> 8) & 0xff] ^
+                      crc_table[1][(two >> 16) & 0xff] ^
+                      crc_table[0][two >> 24];
+
+                buffer += 8;
+                length -= 8;
+        }
+
+        while (length-- > 0)
+                crc = crc_table[0][(crc ^ *buffer++) & 0xff] ^ (crc >> 8);
+
+        return ~crc;
+}
+
+static void
+verify_search_paths_cb (GObject *source_object,
+                        GAsyncResult *result,
+                        VerifyData *data)
+{
+        GHashTableIter iter;
+        gpointer set;
+        guint ii;
+        GError *error = NULL;
+
+        data->search_paths = gva_mame_get_search_paths_finish (
+                result, &error);
+
+        if (data->search_paths == NULL || !verify_load_games (data, &error))
+        {
+                g_simple_async_result_take_error (data->simple, error);
+                g_simple_async_result_complete (data->simple);
+                g_object_unref (data->simple);
+                verify_data_free (data);
+                return;
+        }
+
+        /* Collect the sets to read: each game's own set, plus its
+         * parent and BIOS sets along the chain of "romof" names. */
+        for (ii = 0; data->names[ii] != NULL; ii++)
+        {
+                const gchar *name = data->names[ii];
+                guint depth;
+
+                for (depth = 0; name != NULL && depth < VERIFY_MAX_DEPTH;
+                     depth++)
+                {
+                        VerifyGame *game;
+
+                        game = g_hash_table_lookup (data->games, name);
+                        if (game == NULL)
+                                break;
+
+                        if (g_hash_table_lookup (data->sets, name) == NULL)
+                                g_hash_table_insert (
+                                        data->sets, (gpointer) game->name,
+                                        verify_set_new (game->name));
+
+                        name = game->romof;
+                }
+        }
+
+        data->n_pending = g_hash_table_size (data->sets);
+
+        if (data->n_pending == 0)
+        {
+                g_idle_add ((GSourceFunc) verify_done_idle_cb, data);
+                return;
+        }
+
+        /* Make sure the CRC table is ready before the threads start. */
+        gva_verify_crc32 (0, NULL, 0);
+
+        data->pool = g_thread_pool_new (
+                (GFunc) verify_read_set, data,
+                MAX (data->n_threads, 1), FALSE, NULL);
+
+        g_hash_table_iter_init (&iter, data->sets);
+        while (g_hash_table_iter_next (&iter, NULL, &set))
+                g_thread_pool_push (data->pool, set, NULL);
+}
+
+/**
+ * gva_verify_roms_async:
+ * @names: a %NULL-terminated array of game names
+ * @n_threads: the number of threads to read ROM sets with
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when verification finishes
+ * @user_data: data to pass to @callback
+ *
+ * Starts verifying the ROM sets for the games in @names against the rom
+ * table of the game database, without running MAME.  Each set is read
+ * from the directories in MAME's "rompath" configuration value by one
+ * of @n_threads worker threads: zip archives by their central directory
+ * and loose files by hashing them.  A game's parent and BIOS sets are
+ * searched too.  Games with disk images, and games whose sets are 7-Zip
+ * archives or otherwise unreadable, are left for MAME to verify.
+ *
+ * Call gva_verify_roms_finish() from @callback to get the results.
+ **/
+void
+gva_verify_roms_async (gchar **names,
+                       guint n_threads,
+                       GCancellable *cancellable,
+                       GAsyncReadyCallback callback,
+                       gpointer user_data)
+{
+        GSimpleAsyncResult *simple;
+        VerifyData *data;
+
+        g_return_if_fail (names != NULL);
+
+        simple = g_simple_async_result_new (
+                NULL, callback, user_data, gva_verify_roms_async);
+
+        data = g_slice_new0 (VerifyData);
+        data->strings = g_string_chunk_new (65536);
+        data->games = g_hash_table_new_full (
+                g_str_hash, g_str_equal,
+                (GDestroyNotify) NULL,
+                (GDestroyNotify) verify_game_free);
+        data->sets = g_hash_table_new_full (
+                g_str_hash, g_str_equal,
+                (GDestroyNotify) NULL,
+                (GDestroyNotify) verify_set_free);
+        data->names = g_strdupv (names);
+        data->n_threads = n_threads;
+        data->simple = simple;
+        data->timer = g_timer_new ();
+        data->lines = g_ptr_array_new ();
+        data->deferred = g_ptr_array_new ();
+
+        if (cancellable != NULL)
+                data->cancellable = g_object_ref (cancellable);
+
+        /* The sets are read from the directories in "rompath". */
+        gva_mame_get_search_paths_async (
+                "rompath", cancellable, (GAsyncReadyCallback)
+                verify_search_paths_cb, data);
+}
+
+/**
+ * gva_verify_roms_finish:
+ * @result: a #GAsyncResult
+ * @deferred: return location for games left to MAME, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes an operation started with gva_verify_roms_async().  The
+ * results are returned as lines of text like those written by "MAME
+ * -verifyroms", suitable for gva_mame_verify_parse().  The names of
+ * games that must still be verified by MAME are written to @deferred.
+ * Both are %NULL-terminated string arrays.  If verification failed or
+ * was cancelled, it returns %NULL and sets @error.
+ *
+ * Returns: a %NULL-terminated array of output lines, or %NULL.
+ *          Use g_strfreev() to free it.
+ **/
+gchar **
+gva_verify_roms_finish (GAsyncResult *result,
+                        gchar ***deferred,
+                        GError **error)
+{
+        GSimpleAsyncResult *simple;
+        VerifyData *data;
+        gchar **lines;
+
+        g_return_val_if_fail (
+                g_simple_async_result_is_valid (
+                result, NULL, gva_verify_roms_async), NULL);
+
+        simple = G_SIMPLE_ASYNC_RESULT (result);
+
+        if (g_simple_async_result_propagate_error (simple, error))
+                return NULL;
+
+        data = g_simple_async_result_get_op_res_gpointer (simple);
+
+        g_ptr_array_add (data->lines, NULL);
+        lines = (gchar **) g_ptr_array_free (data->lines, FALSE);
+        data->lines = g_ptr_array_new ();
+
+        if (deferred != NULL)
+        {
+                g_ptr_array_add (data->deferred, NULL);
+                *deferred = (gchar **) g_ptr_array_free (
+                        data->deferred, FALSE);
+                data->deferred = g_ptr_array_new ();
+        }
+
+        return lines;
+}
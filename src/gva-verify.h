@@ -0,0 +1,50 @@
+/* Copyright 2007-2015 Matthew Barnes
+ *
+ * This file is part of GNOME Video Arcade.
+ *
+ * GNOME Video Arcade is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * GNOME Video Arcade is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SECTION: gva-verify
+ * @short_description: Verify ROM Sets Without MAME
+ *
+ * These functions check ROM sets against the sizes and checksums in the
+ * game database directly, reading zip archive directories and hashing
+ * loose files on a pool of threads.  The results take the same form as
+ * the output of "MAME -verifyroms".
+ **/
+
+#ifndef GVA_VERIFY_H
+#define GVA_VERIFY_H
+
+#include "gva-common.h"
+
+G_BEGIN_DECLS
+
+void            gva_verify_roms_async           (gchar **names,
+                                                 guint n_threads,
+                                                 GCancellable *cancellable,
+                                                 GAsyncReadyCallback callback,
+                                                 gpointer user_data);
+gchar **        gva_verify_roms_finish          (GAsyncResult *result,
+                                                 gchar ***deferred,
+                                                 GError **error);
+guint32         gva_verify_crc32                (guint32 crc,
+                                                 const guchar *buffer,
+                                                 gsize length);
+
+G_END_DECLS
+
+#endif /* GVA_VERIFY_H */
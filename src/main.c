@@ -120,91 +120,188 @@ warn_if_no_roms (void)
         gtk_widget_destroy (dialog);
 }
 
+/* Seconds to let ROM files settle after the last change before
+ * verifying them, so copying a batch of files verifies them once. */
+#define ROMPATH_SETTLE_SECONDS 3
+
+/* Number of games to verify at a time in the background. */
+#define ROMPATH_BATCH_SIZE 200
+
+static guint rompath_timeout_id;
+static gboolean rompath_busy;
+static gboolean rompath_failed;
+static gchar **rompath_names;
+static gchar **rompath_batch;
+static guint rompath_offset;
+static guint rompath_n_running;
+static guint rompath_context_id;
+
 static void
-rompath_changed_cb (GFileMonitor *monitor,
-                    GFile *file,
-                    GFile *other_file,
-                    GFileMonitorEvent event_type)
+rompath_audit_done_cb (GObject *source_object,
+                       GAsyncResult *result,
+                       GSourceFunc next)
 {
-        static GtkWidget *dialog = NULL;
-        gint response;
+        GError *error = NULL;
+        gboolean success;
 
-        if (dialog != NULL)
+        if (g_simple_async_result_is_valid (
+                result, NULL, gva_audit_roms_async))
+                success = gva_audit_roms_finish (result, &error);
+        else
+                success = gva_audit_samples_finish (result, &error);
+
+        if (!success)
+                rompath_failed = TRUE;
+        gva_error_handle (&error);
+
+        if (--rompath_n_running > 0)
                 return;
 
-        /* Filter out events we don't care about. */
-        switch (event_type)
+        /* Refresh the batch's rows without disturbing the rest. */
+        if (!rompath_failed)
         {
-                case G_FILE_MONITOR_EVENT_CHANGED:
-                case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
-                case G_FILE_MONITOR_EVENT_DELETED:
-                case G_FILE_MONITOR_EVENT_CREATED:
-                        break;
-                default:
-                        return;
+                gva_tree_view_update_games (rompath_batch, &error);
+                gva_error_handle (&error);
         }
 
-        dialog = gtk_message_dialog_new_with_markup (
-                GTK_WINDOW (GVA_WIDGET_MAIN_WINDOW),
-                GTK_DIALOG_DESTROY_WITH_PARENT,
-                GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
-                "<big><b>%s</b></big>",
-                _("Changes detected in ROM files"));
+        next (NULL);
+}
 
-        gtk_message_dialog_format_secondary_text (
-                GTK_MESSAGE_DIALOG (dialog),
-                _("GNOME Video Arcade has detected changes in your "
-                  "ROM files and will need to audit them in order to "
-                  "update the game list. However the audit may take "
-                  "several minutes to complete. Would you like to "
-                  "perform the audit now?\n\nIf you skip the audit now, "
-                  "it will be performed automatically the next time you "
-                  "start GNOME Video Arcade."));
-
-        gtk_dialog_add_buttons (
-                GTK_DIALOG (dialog),
-                _("_Skip Audit"), GTK_RESPONSE_NO,
-                _("_Audit ROM Files"), GTK_RESPONSE_YES,
-                NULL);
-
-        response = gtk_dialog_run (GTK_DIALOG (dialog));
-
-        /* Don't destroy the dialog just yet.  If the file monitor
-         * trips again while we're analyzing ROMs, we want the NULL
-         * check at the top of the function to evaluate TRUE so we
-         * return immediately. */
-        gtk_widget_hide (dialog);
-
-        if (response == GTK_RESPONSE_YES)
+static gboolean
+rompath_verify_next (gpointer unused)
+{
+        GError *error = NULL;
+        guint length;
+
+        g_free (rompath_batch);
+        rompath_batch = NULL;
+
+        length = g_strv_length (rompath_names + rompath_offset);
+
+        if (length > 0 && !rompath_failed)
         {
-                GError *error = NULL;
+                length = MIN (length, ROMPATH_BATCH_SIZE);
 
-                gva_ui_lock ();
+                /* The audits copy the names they are given. */
+                rompath_batch = g_new0 (gchar *, length + 1);
+                memcpy (
+                        rompath_batch, rompath_names + rompath_offset,
+                        length * sizeof (gchar *));
+                rompath_offset += length;
 
-                gva_main_analyze_roms (&error);
-                gva_error_handle (&error);
+                rompath_n_running = 2;
 
-                gva_tree_view_update (&error);
+                gva_audit_roms_async (
+                        rompath_batch, NULL, NULL, NULL,
+                        (GAsyncReadyCallback) rompath_audit_done_cb,
+                        (gpointer) rompath_verify_next);
+
+                gva_audit_samples_async (
+                        rompath_batch, NULL, NULL, NULL,
+                        (GAsyncReadyCallback) rompath_audit_done_cb,
+                        (gpointer) rompath_verify_next);
+
+                return FALSE;
+        }
+
+        /* Leave the games marked if an audit failed, so the next
+         * session audits them again. */
+        if (!rompath_failed)
+        {
+                gva_db_clear_unaudited (&error);
                 gva_error_handle (&error);
+        }
+
+        gva_main_statusbar_pop (rompath_context_id);
+
+        g_strfreev (rompath_names);
+        rompath_names = NULL;
+        rompath_busy = FALSE;
+
+        return FALSE;
+}
+
+static void
+rompath_detect_changes_cb (GObject *source_object,
+                           GAsyncResult *result,
+                           gpointer user_data)
+{
+        gboolean changed;
+        GError *error = NULL;
 
-                gva_ui_unlock ();
+        changed = gva_audit_detect_changes_finish (result, &error);
+        gva_error_handle (&error);
 
-                /* Present a helpful dialog if no ROMs were found. */
-                warn_if_no_roms ();
+        if (changed)
+        {
+                rompath_names = gva_db_get_unaudited (&error);
+                gva_error_handle (&error);
         }
-        else
+
+        if (rompath_names == NULL)
         {
-                /* Don't bother the user again during this session. */
-                g_signal_handlers_disconnect_by_func (
-                        monitor, rompath_changed_cb, NULL);
+                rompath_busy = FALSE;
+                return;
         }
 
-        gtk_widget_destroy (dialog);
-        dialog = NULL;
+        rompath_failed = FALSE;
+        rompath_offset = 0;
+
+        rompath_context_id = gva_main_statusbar_get_context_id (G_STRFUNC);
+        gva_main_statusbar_push (
+                rompath_context_id, _("Verifying changed ROM files..."));
+
+        rompath_verify_next (NULL);
 }
 
 static gboolean
-setup_file_monitors (void)
+rompath_timeout_cb (gpointer unused)
+{
+        /* Try again later if we're still verifying earlier changes. */
+        if (rompath_busy)
+                return TRUE;
+
+        rompath_timeout_id = 0;
+        rompath_busy = TRUE;
+
+        /* This maps the changed files to the games that use them. */
+        gva_audit_detect_changes_async (
+                NULL, rompath_detect_changes_cb, NULL);
+
+        return FALSE;
+}
+
+static void
+rompath_changed_cb (GFileMonitor *monitor,
+                    GFile *file,
+                    GFile *other_file,
+                    GFileMonitorEvent event_type)
+{
+        /* Filter out events we don't care about. */
+        switch (event_type)
+        {
+                case G_FILE_MONITOR_EVENT_CHANGED:
+                case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+                case G_FILE_MONITOR_EVENT_DELETED:
+                case G_FILE_MONITOR_EVENT_CREATED:
+                        break;
+                default:
+                        return;
+        }
+
+        /* Wait for the files to settle.  Each event starts the
+         * wait over, so a burst of events is handled all at once. */
+        if (rompath_timeout_id > 0)
+                g_source_remove (rompath_timeout_id);
+
+        rompath_timeout_id = g_timeout_add_seconds (
+                ROMPATH_SETTLE_SECONDS, rompath_timeout_cb, NULL);
+}
+
+static void
+setup_file_monitors_cb (GObject *source_object,
+                        GAsyncResult *result,
+                        gpointer user_data)
 {
         gchar **search_paths;
         guint length, ii;
@@ -212,7 +309,7 @@ setup_file_monitors (void)
         /* We don't care about errors while setting up file monitors
          * since it's just a "nice to have" feature. */
 
-        search_paths = gva_mame_get_search_paths ("rompath", NULL);
+        search_paths = gva_mame_get_search_paths_finish (result, NULL);
         length = (search_paths != NULL) ? g_strv_length (search_paths) : 0;
 
         for (ii = 0; ii < length; ii++)
@@ -240,46 +337,39 @@ setup_file_monitors (void)
         }
 
         g_strfreev (search_paths);
+}
 
-        return FALSE;
+static void
+setup_file_monitors (void)
+{
+        gva_mame_get_search_paths_async (
+                "rompath", NULL, setup_file_monitors_cb, NULL);
 }
 
+/* Whether the game list is showing yet. */
+static gboolean games_shown;
+
 static void
-start (void)
+start_show_games (void)
 {
         GSettings *settings;
-        GError *error = NULL;
 
         settings = gva_get_settings ();
 
-        if (gva_db_needs_rebuilt ())
-        {
-                if (!gva_main_build_database (&error))
-                {
-                        gva_error_handle (&error);
-                        return;
-                }
+        gva_ui_unlock ();
 
-                if (!gva_main_analyze_roms (&error))
-                {
-                        gva_error_handle (&error);
-                        return;
-                }
+        g_settings_bind (
+                settings, GVA_SETTING_SELECTED_VIEW,
+                GVA_ACTION_VIEW_AVAILABLE, "current-value",
+                G_SETTINGS_BIND_DEFAULT);
 
-                if (!gva_db_mark_complete (&error))
-                {
-                        gva_error_handle (&error);
-                        return;
-                }
-        }
-        else if (gva_audit_detect_changes ())
-        {
-                if (!gva_main_analyze_roms (&error))
-                {
-                        gva_error_handle (&error);
-                        return;
-                }
-        }
+        games_shown = TRUE;
+}
+
+static void
+start_finish (void)
+{
+        GError *error = NULL;
 
         /* Do this after ROMs are analyzed. */
         if (!gva_main_init_search_completion (&error))
@@ -288,12 +378,14 @@ start (void)
                 return;
         }
 
-        gva_ui_unlock ();
-
-        g_settings_bind (
-                settings, GVA_SETTING_SELECTED_VIEW,
-                GVA_ACTION_VIEW_AVAILABLE, "current-value",
-                G_SETTINGS_BIND_DEFAULT);
+        /* Reload a game list shown during the build. */
+        if (games_shown)
+        {
+                gva_tree_view_update (&error);
+                gva_error_handle (&error);
+        }
+        else
+                start_show_games ();
 
         /* Present a helpful dialog if no ROMs were found. */
         warn_if_no_roms ();
@@ -302,6 +394,86 @@ start (void)
         setup_file_monitors ();
 }
 
+static void
+start_detect_changes_cb (GObject *source_object,
+                         GAsyncResult *result,
+                         gpointer user_data)
+{
+        gboolean changed;
+        GError *error = NULL;
+
+        changed = gva_audit_detect_changes_finish (result, &error);
+        gva_error_handle (&error);
+
+        if (changed && !gva_main_analyze_unaudited_roms (&error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        start_finish ();
+}
+
+static void
+start_version_cb (GObject *source_object,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+        gchar *version;
+        GError *error = NULL;
+
+        /* The version is only looked up to load MAME's configuration.
+         * gva_db_needs_rebuilt() reports it if the lookup failed. */
+        version = gva_mame_get_version_finish (result, &error);
+        g_clear_error (&error);
+        g_free (version);
+
+        if (!gva_db_needs_rebuilt ())
+        {
+                gva_audit_detect_changes_async (
+                        NULL, start_detect_changes_cb, NULL);
+                return;
+        }
+
+        /* The build replaces the database only once it's done,
+         * so show the previous game list in the meantime. */
+        if (gva_db_has_games ())
+        {
+                if (!gva_main_init_search_completion (&error))
+                        gva_error_handle (&error);
+
+                start_show_games ();
+        }
+
+        if (!gva_main_build_database (&error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        if (!gva_main_analyze_unaudited_roms (&error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        if (!gva_db_mark_complete (&error))
+        {
+                gva_error_handle (&error);
+                return;
+        }
+
+        start_finish ();
+}
+
+static void
+start (void)
+{
+        /* Load MAME's configuration without blocking first, so the
+         * database checks that follow find it cached. */
+        gva_mame_get_version_async (NULL, start_version_cb, NULL);
+}
+
 static gboolean
 idle_start (gpointer unused)
 {
@@ -358,6 +530,10 @@ main (gint argc, gchar **argv)
         bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
         textdomain (GETTEXT_PACKAGE);
 
+        /* The game database is built on worker threads. */
+        if (!g_thread_supported ())
+                g_thread_init (NULL);
+
         gtk_init_with_args (
                 &argc, &argv, NULL, entries, GETTEXT_PACKAGE, &error);
         if (error != NULL)